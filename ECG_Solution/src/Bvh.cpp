@@ -0,0 +1,271 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// objects per leaf the build stops at, and the number of bins the split candidates are taken from
+static const unsigned int MAX_LEAF_SIZE = 4;
+static const unsigned int BIN_COUNT = 12;
+
+static float surfaceArea(glm::vec3 min, glm::vec3 max)
+{
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+Bvh::Bvh()
+{
+}
+
+void Bvh::fitNode(Node& node) const
+{
+	node.min = glm::vec3(FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX);
+	if (node.left != 0) {
+		for (unsigned int child = node.left; child <= node.left + 1; child++) {
+			node.min = glm::min(node.min, _nodes[child].min);
+			node.max = glm::max(node.max, _nodes[child].max);
+		}
+		return;
+	}
+	for (unsigned int i = node.first; i < node.first + node.count; i++) {
+		const Bounds& bounds = _bounds[_objects[i]];
+		node.min = glm::min(node.min, bounds.center - bounds.extents);
+		node.max = glm::max(node.max, bounds.center + bounds.extents);
+	}
+}
+
+void Bvh::build(const std::vector<Bounds>& bounds)
+{
+	_bounds = bounds;
+	_nodes.clear();
+	_objects.resize(bounds.size());
+	for (unsigned int i = 0; i < _objects.size(); i++)
+		_objects[i] = i;
+	if (bounds.empty()) return;
+
+	std::vector<glm::vec3> centroids(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		centroids[i] = bounds[i].center;
+
+	// a binary tree with n leaves has 2n - 1 nodes
+	_nodes.reserve(2 * bounds.size());
+	Node root;
+	root.first = 0;
+	root.count = (unsigned int)bounds.size();
+	root.left = 0;
+	_nodes.push_back(root);
+	split(0, centroids);
+
+	// children follow their parents, so fitting backwards sees every child first
+	for (size_t i = _nodes.size(); i-- > 0;)
+		fitNode(_nodes[i]);
+}
+
+void Bvh::split(unsigned int nodeIndex, const std::vector<glm::vec3>& centroids)
+{
+	unsigned int first = _nodes[nodeIndex].first;
+	unsigned int count = _nodes[nodeIndex].count;
+	if (count <= MAX_LEAF_SIZE) return;
+
+	// the bins are spread over the centroids, not the boxes, so large objects can't crowd them
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	glm::vec3 nodeMin(FLT_MAX), nodeMax(-FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++) {
+		const Bounds& bounds = _bounds[_objects[i]];
+		centroidMin = glm::min(centroidMin, centroids[_objects[i]]);
+		centroidMax = glm::max(centroidMax, centroids[_objects[i]]);
+		nodeMin = glm::min(nodeMin, bounds.center - bounds.extents);
+		nodeMax = glm::max(nodeMax, bounds.center + bounds.extents);
+	}
+
+	int bestAxis = -1;
+	unsigned int bestBin = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) continue;
+
+		struct Bin {
+			glm::vec3 min = glm::vec3(FLT_MAX), max = glm::vec3(-FLT_MAX);
+			unsigned int count = 0;
+		} bins[BIN_COUNT];
+
+		float scale = BIN_COUNT / extent;
+		for (unsigned int i = first; i < first + count; i++) {
+			const Bounds& bounds = _bounds[_objects[i]];
+			unsigned int bin = std::min((unsigned int)((centroids[_objects[i]][axis] - centroidMin[axis]) * scale), BIN_COUNT - 1);
+			bins[bin].min = glm::min(bins[bin].min, bounds.center - bounds.extents);
+			bins[bin].max = glm::max(bins[bin].max, bounds.center + bounds.extents);
+			bins[bin].count++;
+		}
+
+		// areas and counts left of every boundary in one sweep, right of it in another
+		float leftArea[BIN_COUNT - 1];
+		unsigned int leftCount[BIN_COUNT - 1];
+		glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		unsigned int sweepCount = 0;
+		for (unsigned int b = 0; b < BIN_COUNT - 1; b++) {
+			sweepMin = glm::min(sweepMin, bins[b].min);
+			sweepMax = glm::max(sweepMax, bins[b].max);
+			sweepCount += bins[b].count;
+			leftArea[b] = sweepCount > 0 ? surfaceArea(sweepMin, sweepMax) : 0.0f;
+			leftCount[b] = sweepCount;
+		}
+
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (unsigned int b = BIN_COUNT - 1; b > 0; b--) {
+			sweepMin = glm::min(sweepMin, bins[b].min);
+			sweepMax = glm::max(sweepMax, bins[b].max);
+			sweepCount += bins[b].count;
+			if (leftCount[b - 1] == 0 || sweepCount == 0) continue;
+
+			float cost = leftArea[b - 1] * leftCount[b - 1] + surfaceArea(sweepMin, sweepMax) * sweepCount;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	// all centroids in one point, the objects can't be told apart
+	if (bestAxis < 0) return;
+
+	// a leaf is cheaper if visiting two children costs more than testing all objects
+	float nodeArea = surfaceArea(nodeMin, nodeMax);
+	if (nodeArea > 0.0f && count <= 4 * MAX_LEAF_SIZE && 1.0f + bestCost / nodeArea >= float(count)) return;
+
+	float scale = BIN_COUNT / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+	float axisMin = centroidMin[bestAxis];
+	unsigned int* middle = std::partition(&_objects[first], &_objects[first] + count, [&](unsigned int object) {
+		return std::min((unsigned int)((centroids[object][bestAxis] - axisMin) * scale), BIN_COUNT - 1) < bestBin;
+	});
+	unsigned int leftCount = (unsigned int)(middle - &_objects[first]);
+
+	Node left, right;
+	left.first = first;
+	left.count = leftCount;
+	left.left = 0;
+	right.first = first + leftCount;
+	right.count = count - leftCount;
+	right.left = 0;
+
+	unsigned int leftIndex = (unsigned int)_nodes.size();
+	_nodes[nodeIndex].left = leftIndex;
+	_nodes.push_back(left);
+	_nodes.push_back(right);
+
+	split(leftIndex, centroids);
+	split(leftIndex + 1, centroids);
+}
+
+void Bvh::refit(const std::vector<Bounds>& bounds)
+{
+	if (bounds.size() != _bounds.size()) {
+		build(bounds);
+		return;
+	}
+
+	_bounds = bounds;
+	for (size_t i = _nodes.size(); i-- > 0;)
+		fitNode(_nodes[i]);
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<unsigned int>& result) const
+{
+	result.clear();
+	if (_nodes.empty()) return;
+
+	if (!CullingSet::isEnabled()) {
+		result = _objects;
+		CullingSet::addStats((unsigned int)result.size(), 0);
+		return;
+	}
+
+	// planes a node is completely inside of are not tested again for its subtree
+	struct Entry {
+		unsigned int node;
+		unsigned int planes;
+	};
+	Entry stack[64];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = { 0, 0x3f };
+
+	while (stackSize > 0) {
+		Entry entry = stack[--stackSize];
+		const Node& node = _nodes[entry.node];
+		glm::vec3 center = (node.min + node.max) * 0.5f;
+		glm::vec3 extents = (node.max - node.min) * 0.5f;
+
+		unsigned int planes = entry.planes;
+		bool outside = false;
+		for (unsigned int p = 0; p < 6 && !outside; p++) {
+			if (!(planes & (1u << p))) continue;
+			const glm::vec4& plane = frustum.getPlane(p);
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float extent = glm::dot(glm::abs(glm::vec3(plane)), extents);
+			if (distance < -extent) outside = true;
+			else if (distance >= extent) planes &= ~(1u << p);
+		}
+		if (outside) continue;
+
+		if (planes == 0) {
+			result.insert(result.end(), _objects.begin() + node.first, _objects.begin() + node.first + node.count);
+		}
+		else if (node.left == 0) {
+			for (unsigned int i = node.first; i < node.first + node.count; i++) {
+				if (frustum.isVisible(_bounds[_objects[i]]))
+					result.push_back(_objects[i]);
+			}
+		}
+		else if (stackSize + 2 <= 64) {
+			stack[stackSize++] = { node.left, planes };
+			stack[stackSize++] = { node.left + 1, planes };
+		}
+		else {
+			// deeper than any tree the build makes for sane input, fall back to the leaf test
+			for (unsigned int i = node.first; i < node.first + node.count; i++) {
+				if (frustum.isVisible(_bounds[_objects[i]]))
+					result.push_back(_objects[i]);
+			}
+		}
+	}
+
+	CullingSet::addStats((unsigned int)result.size(), size() - (unsigned int)result.size());
+}
+
+void Bvh::querySphere(glm::vec3 center, float radius, std::vector<unsigned int>& result) const
+{
+	result.clear();
+	if (_nodes.empty()) return;
+
+	float radius2 = radius * radius;
+	auto touches = [&](glm::vec3 min, glm::vec3 max) {
+		glm::vec3 offset = glm::clamp(center, min, max) - center;
+		return glm::dot(offset, offset) <= radius2;
+	};
+
+	unsigned int stack[64];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const Node& node = _nodes[stack[--stackSize]];
+		if (!touches(node.min, node.max)) continue;
+
+		if (node.left == 0 || stackSize + 2 > 64) {
+			for (unsigned int i = node.first; i < node.first + node.count; i++) {
+				const Bounds& bounds = _bounds[_objects[i]];
+				if (touches(bounds.center - bounds.extents, bounds.center + bounds.extents))
+					result.push_back(_objects[i]);
+			}
+		}
+		else {
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.left + 1;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Culling.h"
+
+/*!
+ * Bounding volume hierarchy over the bounds of many objects, for render-side scene queries
+ * The tree is built top down with a binned surface area heuristic, so static objects get a
+ * good tree once. Moving objects keep the tree and only refit its boxes every frame, which
+ * is cheap but lets the tree degrade if objects travel far; build() it again then.
+ * Every node covers a contiguous range of objects, so a node that is completely inside a
+ * frustum adds its whole range without visiting its children.
+ */
+class Bvh
+{
+protected:
+	struct Node {
+		glm::vec3 min, max;
+		/*!
+		 * Range of the subtree in _objects
+		 */
+		unsigned int first, count;
+		/*!
+		 * Index of the left child, the right child follows it; 0 for leaves
+		 */
+		unsigned int left;
+	};
+
+	std::vector<Node> _nodes;
+	/*!
+	 * Object indices in leaf order
+	 */
+	std::vector<unsigned int> _objects;
+	/*!
+	 * Bounds of every object, by object index
+	 */
+	std::vector<Bounds> _bounds;
+
+	/*!
+	 * Splits a node along the cheapest bin boundary, or keeps it as a leaf
+	 */
+	void split(unsigned int nodeIndex, const std::vector<glm::vec3>& centroids);
+
+	/*!
+	 * Sets the box of a node from its children or its objects
+	 */
+	void fitNode(Node& node) const;
+
+public:
+	Bvh();
+
+	/*!
+	 * Builds the tree from scratch
+	 * @param bounds: bounds of all objects, the index in this vector is the object index
+	 */
+	void build(const std::vector<Bounds>& bounds);
+
+	/*!
+	 * Updates the boxes of the tree for moved objects, the tree itself stays
+	 * @param bounds: new bounds of the same objects as in build()
+	 */
+	void refit(const std::vector<Bounds>& bounds);
+
+	/*!
+	 * Collects the objects inside a frustum and counts them in the CullingSet stats
+	 * @param frustum: view frustum of the camera or a light
+	 * @param result: receives the indices of the visible objects, in no particular order
+	 */
+	void queryFrustum(const Frustum& frustum, std::vector<unsigned int>& result) const;
+
+	/*!
+	 * Collects the objects whose box intersects a sphere, e.g. the range of a point light
+	 * @param result: receives the indices of the objects, in no particular order
+	 */
+	void querySphere(glm::vec3 center, float radius, std::vector<unsigned int>& result) const;
+
+	unsigned int size() const { return (unsigned int)_bounds.size(); }
+
+	unsigned int getNodeCount() const { return (unsigned int)_nodes.size(); }
+};
@@ -75,6 +75,11 @@ glm::mat4 CameraPlayer::getProjectionViewMatrix()
     return _projMatrix * getViewMatrix();
 }
 
+glm::mat4 CameraPlayer::getProjectionMatrix()
+{
+    return _projMatrix;
+}
+
 glm::vec3 CameraPlayer::getPosition()
 {
     btTransform transform;
@@ -82,6 +87,12 @@ glm::vec3 CameraPlayer::getPosition()
     return glm::vec3(transform.getOrigin().x(), transform.getOrigin().y(), transform.getOrigin().z());
 }
 
+glm::vec3 CameraPlayer::getVelocity()
+{
+    btVector3 velocity = _rigidBody->getLinearVelocity();
+    return glm::vec3(velocity.x(), velocity.y(), velocity.z());
+}
+
 void CameraPlayer::inputKeys(KeyInput& input, double deltaTime)
 {
     glm::vec3 dir = glm::vec3();
@@ -76,6 +76,9 @@ public:
     // returns the projection view matrix
     glm::mat4 getProjectionViewMatrix();
 
+    // returns the projection matrix
+    glm::mat4 getProjectionMatrix();
+
     // receive input from keyboard, move according the direction
     void inputKeys(KeyInput& input, double deltaTime);
 
@@ -87,6 +90,9 @@ public:
     virtual void moveTo(glm::vec3 newLocation);
     virtual glm::vec3 getPosition();
 
+    // returns the linear velocity of the player body
+    glm::vec3 getVelocity();
+
     // set pressed jump state 
     void setPressed(boolean value);
 };
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "CpuFeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static bool detectAvx()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 1) return false;
+
+	// the os has to save the ymm registers
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+
+static bool detectAvx2()
+{
+#ifdef _MSC_VER
+	if (!detectAvx()) return false;
+
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool CpuFeatures::hasAvx()
+{
+	static const bool avx = detectAvx();
+	return avx;
+}
+
+bool CpuFeatures::hasAvx2()
+{
+	static const bool avx2 = detectAvx2();
+	return avx2;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/*!
+ * Instruction set extensions of the cpu, detected once at startup
+ * An extension only counts as available if the os also saves its registers
+ */
+class CpuFeatures
+{
+public:
+	/*!
+	 * @return whether 256 bit float instructions can be used
+	 */
+	static bool hasAvx();
+
+	/*!
+	 * @return whether 256 bit integer instructions can be used
+	 */
+	static bool hasAvx2();
+};
@@ -0,0 +1,230 @@
+#include "Culling.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define AVX_FUNCTION
+#else
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+
+bool CullingSet::_enabled = true;
+CullStats CullingSet::_stats;
+
+/* --------------------------------------------- */
+// Bounds
+/* --------------------------------------------- */
+
+Bounds Bounds::compute(const glm::vec3* positions, size_t count, size_t stride)
+{
+	Bounds bounds;
+	if (count == 0) return bounds;
+
+	const unsigned char* bytes = (const unsigned char*)positions;
+	glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3& position = *(const glm::vec3*)(bytes + i * stride);
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+	bounds.center = (minimum + maximum) * 0.5f;
+	bounds.extents = (maximum - minimum) * 0.5f;
+
+	// the sphere around the box center, tighter than the box diagonal for round objects
+	float radius2 = 0.0f;
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 offset = *(const glm::vec3*)(bytes + i * stride) - bounds.center;
+		radius2 = std::max(radius2, glm::dot(offset, offset));
+	}
+	bounds.radius = std::sqrt(radius2);
+	return bounds;
+}
+
+Bounds Bounds::transform(const glm::mat4& modelMatrix) const
+{
+	Bounds bounds;
+	bounds.center = glm::vec3(modelMatrix * glm::vec4(center, 1.0f));
+
+	// every axis of the new box is the sum of the projected old axes
+	glm::mat3 axes(modelMatrix);
+	for (int column = 0; column < 3; column++)
+		axes[column] = glm::abs(axes[column]);
+	bounds.extents = axes * extents;
+
+	float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+	bounds.radius = radius * scale;
+	return bounds;
+}
+
+/* --------------------------------------------- */
+// Frustum
+/* --------------------------------------------- */
+
+Frustum::Frustum()
+{
+	for (glm::vec4& plane : _planes)
+		plane = glm::vec4(0.0f, 0.0f, 0.0f, FLT_MAX);
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// planes from the rows of the matrix (left, right, bottom, top, near, far)
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = 0; side < 2; side++) {
+			glm::vec4 plane;
+			for (int column = 0; column < 4; column++)
+				plane[column] = viewProjection[column][3] + (side == 0 ? 1.0f : -1.0f) * viewProjection[column][axis];
+			_planes[axis * 2 + side] = plane / glm::length(glm::vec3(plane));
+		}
+	}
+}
+
+bool Frustum::isVisible(const Bounds& bounds) const
+{
+	for (const glm::vec4& plane : _planes) {
+		float distance = glm::dot(glm::vec3(plane), bounds.center) + plane.w;
+		float extent = glm::dot(glm::abs(glm::vec3(plane)), bounds.extents);
+		if (distance < -std::min(extent, bounds.radius)) return false;
+	}
+	return true;
+}
+
+/* --------------------------------------------- */
+// CullingSet
+/* --------------------------------------------- */
+
+// plane components splatted once per cull() call
+struct PlaneConstants {
+	float x[6], y[6], z[6], w[6];
+	float absX[6], absY[6], absZ[6];
+};
+
+static void cullSse(const PlaneConstants& planes, const float* const* arrays, unsigned int count, std::vector<unsigned int>& visible)
+{
+	for (unsigned int i = 0; i < count; i += 4) {
+		__m128 cx = _mm_loadu_ps(arrays[0] + i), cy = _mm_loadu_ps(arrays[1] + i), cz = _mm_loadu_ps(arrays[2] + i);
+		__m128 ex = _mm_loadu_ps(arrays[3] + i), ey = _mm_loadu_ps(arrays[4] + i), ez = _mm_loadu_ps(arrays[5] + i);
+		__m128 radius = _mm_loadu_ps(arrays[6] + i);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.x[p]), cx), _mm_mul_ps(_mm_set1_ps(planes.y[p]), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.z[p]), cz), _mm_set1_ps(planes.w[p])));
+			__m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.absX[p]), ex), _mm_mul_ps(_mm_set1_ps(planes.absY[p]), ey)),
+				_mm_mul_ps(_mm_set1_ps(planes.absZ[p]), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(extent, radius)), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (unsigned int bit = 0; bit < 4 && i + bit < count; bit++)
+			if (mask & (1 << bit)) visible.push_back(i + bit);
+	}
+}
+
+AVX_FUNCTION static void cullAvx(const PlaneConstants& planes, const float* const* arrays, unsigned int count, std::vector<unsigned int>& visible)
+{
+	for (unsigned int i = 0; i < count; i += 8) {
+		__m256 cx = _mm256_loadu_ps(arrays[0] + i), cy = _mm256_loadu_ps(arrays[1] + i), cz = _mm256_loadu_ps(arrays[2] + i);
+		__m256 ex = _mm256_loadu_ps(arrays[3] + i), ey = _mm256_loadu_ps(arrays[4] + i), ez = _mm256_loadu_ps(arrays[5] + i);
+		__m256 radius = _mm256_loadu_ps(arrays[6] + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.x[p]), cx), _mm256_mul_ps(_mm256_set1_ps(planes.y[p]), cy)),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.z[p]), cz), _mm256_set1_ps(planes.w[p])));
+			__m256 extent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.absX[p]), ex), _mm256_mul_ps(_mm256_set1_ps(planes.absY[p]), ey)),
+				_mm256_mul_ps(_mm256_set1_ps(planes.absZ[p]), ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, _mm256_min_ps(extent, radius)), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (unsigned int bit = 0; bit < 8 && i + bit < count; bit++)
+			if (mask & (1 << bit)) visible.push_back(i + bit);
+	}
+}
+
+CullingSet::CullingSet() : _count(0)
+{
+}
+
+unsigned int CullingSet::add(const Bounds& bounds)
+{
+	// the padding lanes are tested too, their results are ignored
+	if (_count % 8 == 0) {
+		for (std::vector<float>* array : { &_centerX, &_centerY, &_centerZ, &_extentX, &_extentY, &_extentZ, &_radius })
+			array->resize(_count + 8, 0.0f);
+	}
+	set(_count, bounds);
+	return _count++;
+}
+
+void CullingSet::set(unsigned int i, const Bounds& bounds)
+{
+	_centerX[i] = bounds.center.x;
+	_centerY[i] = bounds.center.y;
+	_centerZ[i] = bounds.center.z;
+	_extentX[i] = bounds.extents.x;
+	_extentY[i] = bounds.extents.y;
+	_extentZ[i] = bounds.extents.z;
+	_radius[i] = bounds.radius;
+}
+
+void CullingSet::clear()
+{
+	_count = 0;
+	for (std::vector<float>* array : { &_centerX, &_centerY, &_centerZ, &_extentX, &_extentY, &_extentZ, &_radius })
+		array->clear();
+}
+
+void CullingSet::cull(const Frustum& frustum, std::vector<unsigned int>& visible) const
+{
+	visible.clear();
+	visible.reserve(_count);
+
+	if (!_enabled) {
+		for (unsigned int i = 0; i < _count; i++)
+			visible.push_back(i);
+	}
+	else if (_count > 0) {
+		PlaneConstants planes;
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.getPlane(p);
+			planes.x[p] = plane.x;
+			planes.y[p] = plane.y;
+			planes.z[p] = plane.z;
+			planes.w[p] = plane.w;
+			planes.absX[p] = std::abs(plane.x);
+			planes.absY[p] = std::abs(plane.y);
+			planes.absZ[p] = std::abs(plane.z);
+		}
+
+		const float* arrays[7] = { _centerX.data(), _centerY.data(), _centerZ.data(), _extentX.data(), _extentY.data(), _extentZ.data(), _radius.data() };
+		if (CpuFeatures::hasAvx())
+			cullAvx(planes, arrays, _count, visible);
+		else
+			cullSse(planes, arrays, _count, visible);
+	}
+
+	_stats.submitted += (unsigned int)visible.size();
+	_stats.culled += _count - (unsigned int)visible.size();
+}
+
+void CullingSet::resetStats()
+{
+	_stats = CullStats();
+}
+
+void CullingSet::addStats(unsigned int submitted, unsigned int culled)
+{
+	_stats.submitted += submitted;
+	_stats.culled += culled;
+}
+
+void CullingSet::setSettings(bool enabled)
+{
+	_enabled = enabled;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/*!
+ * Axis aligned box and bounding sphere around the same center
+ */
+struct Bounds {
+	glm::vec3 center = glm::vec3(0.0f);
+	/*!
+	 * Half the size of the box along every axis
+	 */
+	glm::vec3 extents = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	/*!
+	 * Bounds of a point set
+	 * @param positions: first position, read with the given stride
+	 * @param count: number of positions
+	 * @param stride: bytes between two positions
+	 */
+	static Bounds compute(const glm::vec3* positions, size_t count, size_t stride);
+
+	/*!
+	 * Bounds of the transformed object, the box stays axis aligned and grows with rotations
+	 * @param modelMatrix: affine transformation of the object
+	 */
+	Bounds transform(const glm::mat4& modelMatrix) const;
+};
+
+/*!
+ * The six clip planes of a view projection matrix, normalized, pointing inwards
+ */
+class Frustum
+{
+protected:
+	/*!
+	 * Left, right, bottom, top, near, far
+	 */
+	glm::vec4 _planes[6];
+
+public:
+	/*!
+	 * A frustum that contains everything
+	 */
+	Frustum();
+
+	/*!
+	 * @param viewProjection: projection * view matrix of a camera or light
+	 */
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	/*!
+	 * @return false if the bounds are completely outside of one plane
+	 */
+	bool isVisible(const Bounds& bounds) const;
+
+	const glm::vec4& getPlane(unsigned int i) const { return _planes[i]; }
+};
+
+/*!
+ * Objects culled and drawn since the last resetStats()
+ */
+struct CullStats {
+	unsigned int submitted = 0;
+	unsigned int culled = 0;
+};
+
+/*!
+ * Bounds of many objects stored as structure of arrays
+ * cull() tests 4 objects at a time with SSE, or 8 with AVX when the AVX2 kernels of the
+ * BlockEncoder are enabled. An object is culled if it is outside of a plane with both its
+ * box and its sphere, whichever is tighter for that plane.
+ */
+class CullingSet
+{
+protected:
+	unsigned int _count;
+	/*!
+	 * One array per component, padded to a multiple of 8
+	 */
+	std::vector<float> _centerX, _centerY, _centerZ;
+	std::vector<float> _extentX, _extentY, _extentZ;
+	std::vector<float> _radius;
+
+	static bool _enabled;
+	static CullStats _stats;
+
+public:
+	CullingSet();
+
+	/*!
+	 * @return index of the added bounds
+	 */
+	unsigned int add(const Bounds& bounds);
+
+	/*!
+	 * Replaces the bounds of an object, e.g. after it moved
+	 */
+	void set(unsigned int i, const Bounds& bounds);
+
+	void clear();
+
+	unsigned int size() const { return _count; }
+
+	/*!
+	 * Collects the objects inside the frustum and counts them in the stats
+	 * @param frustum: view frustum of the pass
+	 * @param visible: receives the indices of the visible objects in ascending order
+	 */
+	void cull(const Frustum& frustum, std::vector<unsigned int>& visible) const;
+
+	/*!
+	 * @return counts of all cull() calls since the last reset
+	 */
+	static const CullStats& getStats() { return _stats; }
+
+	static void resetStats();
+
+	/*!
+	 * Counts objects tested outside of a CullingSet, e.g. by a Bvh query
+	 */
+	static void addStats(unsigned int submitted, unsigned int culled);
+
+	/*!
+	 * @param enabled: if false, cull() reports every object as visible
+	 */
+	static void setSettings(bool enabled);
+
+	static bool isEnabled() { return _enabled; }
+};
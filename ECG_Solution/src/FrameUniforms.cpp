@@ -0,0 +1,60 @@
+#include "FrameUniforms.h"
+
+#include <algorithm>
+#include <cstring>
+
+// the structs are copied byte for byte, they have to have the std140 sizes
+static_assert(sizeof(glm::mat4) == 64 && sizeof(glm::vec4) == 16, "glm types are not tightly packed");
+
+FrameUniforms::FrameUniforms() : _buffer(0)
+{
+	static_assert(sizeof(FrameBlock) == 160, "Frame block does not match std140");
+	static_assert(sizeof(LightsBlock) == 16 + MAX_DIR_LIGHTS * 32 + MAX_POINT_LIGHTS * 48, "Lights block does not match std140");
+
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	_lightsOffset = (sizeof(FrameBlock) + alignment - 1) / alignment * alignment;
+	_data.assign(_lightsOffset + sizeof(LightsBlock), 0);
+
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+	glBufferData(GL_UNIFORM_BUFFER, _data.size(), _data.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING, _buffer, 0, sizeof(FrameBlock));
+	glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, _buffer, _lightsOffset, sizeof(LightsBlock));
+}
+
+FrameUniforms::~FrameUniforms()
+{
+	glDeleteBuffers(1, &_buffer);
+}
+
+void FrameUniforms::update(const glm::mat4& viewProjection, glm::vec3 camera, const glm::mat4& lightSpaceMatrix, float brightness, bool lightsOn,
+	const std::vector<DirectionalLight>& dirLights, const std::vector<std::shared_ptr<PointLight>>& pointLights)
+{
+	FrameBlock* frame = (FrameBlock*)_data.data();
+	frame->viewProjMatrix = viewProjection;
+	frame->lightSpaceMatrix = lightSpaceMatrix;
+	frame->cameraWorld = glm::vec4(camera, 1.0f);
+	frame->brightness = brightness;
+	frame->lightsOn = lightsOn ? 1 : 0;
+
+	LightsBlock* lights = (LightsBlock*)(_data.data() + _lightsOffset);
+	lights->dirLightCount = (int)std::min(dirLights.size(), (size_t)MAX_DIR_LIGHTS);
+	lights->pointLightCount = (int)std::min(pointLights.size(), (size_t)MAX_POINT_LIGHTS);
+	for (int i = 0; i < lights->dirLightCount; i++) {
+		lights->dirLights[i].color = glm::vec4(dirLights[i]._color, 0.0f);
+		lights->dirLights[i].direction = glm::vec4(dirLights[i]._direction, 0.0f);
+	}
+	for (int i = 0; i < lights->pointLightCount; i++) {
+		lights->pointLights[i].color = glm::vec4(pointLights[i]->_color, 0.0f);
+		lights->pointLights[i].position = glm::vec4(pointLights[i]->_position, 1.0f);
+		lights->pointLights[i].attenuation = glm::vec4(pointLights[i]->_attenuation, 0.0f);
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, _data.size(), _data.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
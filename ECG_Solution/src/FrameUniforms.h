@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Light.h"
+
+/*!
+ * Camera and light data every shader of a frame shares, in one uniform buffer
+ * The buffer holds two std140 blocks, Frame and Lights, bound to fixed binding points that
+ * the shaders name with layout(binding = ...). update() writes both with one call per frame.
+ * The block layouts here and in texture.vert, texture.frag, lightbox.frag and depth.vert have to match.
+ */
+class FrameUniforms
+{
+public:
+	static const GLuint FRAME_BINDING = 0;
+	static const GLuint LIGHTS_BINDING = 1;
+
+	/*!
+	 * Array sizes of the Lights block, the shaders only read as many lights as the buffer says
+	 */
+	static const unsigned int MAX_DIR_LIGHTS = 4;
+	static const unsigned int MAX_POINT_LIGHTS = 32;
+
+protected:
+	struct FrameBlock {
+		glm::mat4 viewProjMatrix;
+		glm::mat4 lightSpaceMatrix;
+		glm::vec4 cameraWorld;
+		float brightness;
+		int lightsOn;
+		int padding[2];
+	};
+
+	/*!
+	 * vec3 members are padded to vec4, std140 aligns them to 16 bytes anyway
+	 */
+	struct DirectionalLightData {
+		glm::vec4 color;
+		glm::vec4 direction;
+	};
+
+	struct PointLightData {
+		glm::vec4 color;
+		glm::vec4 position;
+		glm::vec4 attenuation;
+	};
+
+	struct LightsBlock {
+		int dirLightCount;
+		int pointLightCount;
+		int padding[2];
+		DirectionalLightData dirLights[MAX_DIR_LIGHTS];
+		PointLightData pointLights[MAX_POINT_LIGHTS];
+	};
+
+	GLuint _buffer;
+	/*!
+	 * Offset of the Lights block, rounded up to the uniform buffer offset alignment
+	 */
+	size_t _lightsOffset;
+	/*!
+	 * Both blocks as they are written to the buffer
+	 */
+	std::vector<unsigned char> _data;
+
+public:
+	/*!
+	 * Creates the buffer and binds both blocks, needs a current context
+	 */
+	FrameUniforms();
+	~FrameUniforms();
+
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+	/*!
+	 * Writes the data of this frame, lights beyond the array sizes are ignored
+	 * @param viewProjection: projection * view matrix of the camera
+	 * @param camera: position of the camera in world space
+	 * @param lightSpaceMatrix: view projection matrix of the shadow map
+	 * @param brightness: scale of all direct light
+	 * @param lightsOn: if false only the first point light is active
+	 */
+	void update(const glm::mat4& viewProjection, glm::vec3 camera, const glm::mat4& lightSpaceMatrix, float brightness, bool lightsOn,
+		const std::vector<DirectionalLight>& dirLights, const std::vector<std::shared_ptr<PointLight>>& pointLights);
+};
@@ -5,45 +5,39 @@
 */
 
 #include "Geometry.h"
+#include "MeshOptimizer.h"
 
 Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, std::shared_ptr<Material> material)
-	: _elements(data.indices.size()), _modelMatrix(modelMatrix), _material(material)
+	: _material(material), _transform(modelMatrix), _boundsVersion(~0u), _pointLightMask(-1), _normalMapped(false)
 {
 	// create VAO
 	glGenVertexArrays(1, &_vao);
 	glBindVertexArray(_vao);
 
-	// create positions VBO
-	glGenBuffers(1, &_vboPositions);
-	glBindBuffer(GL_ARRAY_BUFFER, _vboPositions);
-	glBufferData(GL_ARRAY_BUFFER, data.positions.size() * sizeof(glm::vec3), data.positions.data(), GL_STATIC_DRAW);
+	// interleave and quantize positions, normals and uvs into one VBO
+	_packedVertices = QuantizedVertices::pack(VertexFormat::getDefault(), data.positions.size(),
+		data.positions.data(), sizeof(glm::vec3),
+		data.normals.empty() ? nullptr : data.normals.data(), sizeof(glm::vec3),
+		data.uvs.empty() ? nullptr : data.uvs.data(), sizeof(glm::vec2));
 
-	// bind positions to location 0
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glGenBuffers(1, &_vboVertices);
+	glBindBuffer(GL_ARRAY_BUFFER, _vboVertices);
+	glBufferData(GL_ARRAY_BUFFER, _packedVertices.data.size(), _packedVertices.data.data(), GL_STATIC_DRAW);
+	std::vector<unsigned char>().swap(_packedVertices.data);
 
-	// create normals VBO
-	glGenBuffers(1, &_vboNormals);
-	glBindBuffer(GL_ARRAY_BUFFER, _vboNormals);
-	glBufferData(GL_ARRAY_BUFFER, data.normals.size() * sizeof(glm::vec3), data.normals.data(), GL_STATIC_DRAW);
-
-	// bind normals to location 1
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	// create uvs VBO
-	glGenBuffers(1, &_vboUVs);
-	glBindBuffer(GL_ARRAY_BUFFER, _vboUVs);
-	glBufferData(GL_ARRAY_BUFFER, data.uvs.size() * sizeof(glm::vec2), data.uvs.data(), GL_STATIC_DRAW);
-
-	// bind uvs to location 2
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	// bind positions to location 0, normals to location 1 and uvs to location 2
+	_packedVertices.setAttributes();
 
 	// create and bind indices VBO
 	glGenBuffers(1, &_vboIndices);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vboIndices);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(unsigned int), data.indices.data(), GL_STATIC_DRAW);
+	// the levels of detail follow the full detail indices
+	std::vector<unsigned int> indices = data.indices;
+	_lodChain.build(indices, data.lods, data.positions.data(), data.positions.size(), sizeof(glm::vec3));
+	_bounds = Bounds::compute(data.positions.data(), data.positions.size(), sizeof(glm::vec3));
+	PackedIndices packedIndices = PackedIndices::pack(indices, data.positions.size());
+	_indexType = packedIndices.type;
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIndices.data.size(), packedIndices.data.data(), GL_STATIC_DRAW);
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -51,9 +45,7 @@ Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, std::shared_ptr<Ma
 
 Geometry::~Geometry()
 {
-	glDeleteBuffers(1, &_vboPositions);
-	glDeleteBuffers(1, &_vboNormals);
-	glDeleteBuffers(1, &_vboUVs);
+	glDeleteBuffers(1, &_vboVertices);
 	glDeleteBuffers(1, &_vboIndices);
 	glDeleteVertexArrays(1, &_vao);
 }
@@ -63,13 +55,13 @@ void Geometry::draw()
 	Shader* shader = _material->getShader();
 	shader->use();
 
-	shader->setUniform("modelMatrix", _modelMatrix);
-	shader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(_modelMatrix))));
+	shader->setUniform("modelMatrix", _transform.getModelMatrix());
+	shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+	_packedVertices.setUniforms(shader);
+	shader->setUniform("pointLightMask", _pointLightMask);
 	_material->setUniforms();
 
-	glBindVertexArray(_vao);
-	glDrawElements(GL_TRIANGLES, _elements, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	drawLod();
 }
 
 void Geometry::drawNormal()
@@ -77,13 +69,13 @@ void Geometry::drawNormal()
 	Shader* shader = _material->getShader();
 	shader->use();
 
-	shader->setUniform("modelMatrix", _modelMatrix);
-	shader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(_modelMatrix))));
+	shader->setUniform("modelMatrix", _transform.getModelMatrix());
+	shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+	_packedVertices.setUniforms(shader);
+	shader->setUniform("pointLightMask", _pointLightMask);
 	_material->setUniforms();
 
-	glBindVertexArray(_vao);
-	glDrawElements(GL_TRIANGLES, _elements, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	drawLod();
 }
 
 void Geometry::drawShader(Shader* shader)
@@ -91,22 +83,66 @@ void Geometry::drawShader(Shader* shader)
 	// Shader* shader = _depthMaterial->getShader();
 	shader->use();
 
-	shader->setUniform("modelMatrix", _modelMatrix);
-	shader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(_modelMatrix))));
+	shader->setUniform("modelMatrix", _transform.getModelMatrix());
+	shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+	_packedVertices.setUniforms(shader);
+
+	drawLod();
+}
+
+void Geometry::submit(RenderQueue& queue, unsigned int pass, const glm::mat4& viewProjection, Shader* shader)
+{
+	float depth = RenderQueue::getDepth(viewProjection, getBounds().center);
+
+	// passes with their own shader ignore the material
+	uint64_t key;
+	if (shader)
+		key = RenderQueue::makeKey(pass, false, shader->getHandle(), 0, 0, _vao, depth);
+	else
+		key = RenderQueue::makeKey(pass, _material->isTransparent(), _material->getShader()->getHandle(), RenderQueue::getMaterialId(_material.get()), _material->getTextureHandle(), _vao, depth);
+	queue.submit(key, this);
+}
+
+void Geometry::drawQueued(RenderState& state, unsigned int)
+{
+	Shader* shader = state.getPassShader() ? state.getPassShader() : _material->getShader();
+	state.use(shader);
+
+	shader->setUniform("modelMatrix", _transform.getModelMatrix());
+	shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+	_packedVertices.setUniforms(shader);
+
+	if (!state.getPassShader()) {
+		shader->setUniform("pointLightMask", _pointLightMask);
+		state.setNormalMap(state.useNormalMaps() && _normalMapped);
+		if (state.bindMaterial(_material.get())) _material->setUniforms();
+	}
+
+	// the vertex array stays bound for the next draw of the queue
+	const LodRange& range = _lodChain.select(_transform.getModelMatrix());
+	unsigned int indexSize = _indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	state.bindVertexArray(_vao);
+	glDrawElements(GL_TRIANGLES, range.indexCount, _indexType, (void*)(size_t(range.firstIndex) * indexSize));
+}
+
+void Geometry::drawLod()
+{
+	const LodRange& range = _lodChain.select(_transform.getModelMatrix());
+	unsigned int indexSize = _indexType == GL_UNSIGNED_SHORT ? 2 : 4;
 
 	glBindVertexArray(_vao);
-	glDrawElements(GL_TRIANGLES, _elements, GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, range.indexCount, _indexType, (void*)(size_t(range.firstIndex) * indexSize));
 	glBindVertexArray(0);
 }
 
 void Geometry::transform(glm::mat4 transformation)
 {
-	_modelMatrix = transformation * _modelMatrix;
+	_transform.apply(transformation);
 }
 
 void Geometry::resetModelMatrix()
 {
-	_modelMatrix = glm::mat4(1);
+	_transform.set(glm::mat4(1.0f));
 }
 
 
@@ -234,6 +270,8 @@ GeometryData Geometry::createCubeGeometry(float width, float height, float depth
 		22, 23, 20
 };
 
+	MeshOptimizer::optimize(data);
+
 	return std::move(data);
 }
 
@@ -302,6 +340,9 @@ GeometryData Geometry::createCylinderGeometry(unsigned int segments, float heigh
 	}
 
 
+	MeshOptimizer::optimize(data);
+	MeshOptimizer::generateLods(data);
+
 	return std::move(data);
 }
 
@@ -354,11 +395,34 @@ GeometryData Geometry::createSphereGeometry(unsigned int longitudeSegments, unsi
 		}
 	}
 
+	MeshOptimizer::optimize(data);
+	MeshOptimizer::generateLods(data);
+
 	return std::move(data);
 }
 
 void Geometry::setModelMatrix(glm::mat4 modelMatrix) {
-	_modelMatrix = modelMatrix;
+	_transform.set(modelMatrix);
+}
+
+Bounds Geometry::getBounds() const
+{
+	// the world bounds follow the transform, they are only recomputed after it changed
+	if (_boundsVersion != _transform.getVersion()) {
+		_worldBounds = _bounds.transform(_transform.getModelMatrix());
+		_boundsVersion = _transform.getVersion();
+	}
+	return _worldBounds;
+}
+
+void Geometry::setPointLightMask(int pointLightMask)
+{
+	_pointLightMask = pointLightMask;
+}
+
+void Geometry::setNormalMapped(bool normalMapped)
+{
+	_normalMapped = normalMapped;
 }
 
 
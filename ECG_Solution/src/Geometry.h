@@ -13,6 +13,11 @@
 #include <GL\glew.h>
 #include "Material.h"
 #include "Shader.h"
+#include "VertexFormat.h"
+#include "LodChain.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+#include "Transform.h"
 
 /*!
  * Stores all data for a geometry object
@@ -34,10 +39,14 @@ struct GeometryData {
 	 * Vertex UV coordinates
 	 */
 	std::vector<glm::vec2> uvs;
+	/*!
+	 * Simplified levels of detail, indexing the same vertices
+	 */
+	std::vector<LodIndices> lods;
 };
 
 
-class Geometry
+class Geometry : public Renderable
 {
 protected:
 	/*!
@@ -45,26 +54,35 @@ protected:
 	 */
 	GLuint _vao;
 	/*!
-	 * Vertex buffer object that stores the vertex positions
+	 * Vertex buffer object that stores the interleaved vertex positions, normals and UV coordinates
 	 */
-	GLuint _vboPositions;
+	GLuint _vboVertices;
 	/*!
-	 * Vertex buffer object that stores the vertex normals
+	 * Layout and decode constants of the vertex buffer
 	 */
-	GLuint _vboNormals;
-	/*!
-	 * Vertex buffer object that stores the vertex UV coordinates
-	 */
-	GLuint _vboUVs;
+	QuantizedVertices _packedVertices;
 	/*!
 	 * Vertex buffer object that stores the indices
 	 */
 	GLuint _vboIndices;
 	
 	/*!
-	 * Number of elements to be rendered
+	 * Type of the indices, GL_UNSIGNED_SHORT for up to 65536 vertices
 	 */
-	unsigned int _elements;
+	GLenum _indexType;
+	/*!
+	 * Index ranges of the levels of detail
+	 */
+	LodChain _lodChain;
+	/*!
+	 * Bounds of the vertices in object space
+	 */
+	Bounds _bounds;
+
+	/*!
+	 * Draws the level of detail chosen for the current model matrix
+	 */
+	void drawLod();
 
 	/*!
 	 * Material of the geometry object
@@ -72,9 +90,25 @@ protected:
 	std::shared_ptr<Material> _material;
 
 	/*!
-	 * Model matrix of the object
+	 * Model matrix of the object and its cached normal matrix
+	 */
+	Transform _transform;
+
+	/*!
+	 * Bounds in world space and the transform version they were computed for
+	 */
+	mutable Bounds _worldBounds;
+	mutable unsigned int _boundsVersion;
+
+	/*!
+	 * Bit i is set if point light i reaches the object, all bits by default
 	 */
-	glm::mat4 _modelMatrix;
+	int _pointLightMask;
+
+	/*!
+	 * If the object is drawn with its normal map when the pass uses normal maps
+	 */
+	bool _normalMapped;
 	
 public:
 	/*!
@@ -97,6 +131,21 @@ public:
 
 	void drawShader(Shader* shader);
 
+	/*!
+	 * Submits the object with its depth in the given view
+	 * @param queue: queue of the pass
+	 * @param pass: pass of the key
+	 * @param viewProjection: camera or light matrix of the pass
+	 * @param shader: the shader of the pass if it replaces the material, e.g. for the shadow map
+	 */
+	void submit(RenderQueue& queue, unsigned int pass, const glm::mat4& viewProjection, Shader* shader = nullptr);
+
+	/*!
+	 * Draws the object for a RenderQueue, with the shader of the state if it has one
+	 * A Geometry is submitted as one part, the part index is not used
+	 */
+	virtual void drawQueued(RenderState& state, unsigned int part);
+
 	/*!
 	 * Transforms the object, i.e. updates the model matrix
 	 * @param transformation: the transformation matrix to be applied to the object
@@ -135,4 +184,16 @@ public:
 
 	void setModelMatrix(glm::mat4 modelMatrix);
 
+	/*!
+	 * @return bounds of the object in world space, for the current model matrix
+	 */
+	Bounds getBounds() const;
+
+	/*!
+	 * @param pointLightMask: point lights the shader evaluates for the object, bit i for light i
+	 */
+	void setPointLightMask(int pointLightMask);
+
+	void setNormalMapped(bool normalMapped);
+
 };
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "InstancedGeometry.h"
+
+#include <algorithm>
+#include <cstddef>
+
+// first attribute location of the instance data, after position, normal and uv
+static const GLuint INSTANCE_LOCATION = 3;
+
+InstancedGeometry::InstancedGeometry(GeometryData& data, std::vector<std::shared_ptr<Material>> materials)
+	: _vao(0), _vboVertices(0), _vboIndices(0), _vboInstances(0), _materials(materials), _normalMapped(false)
+{
+	_range.firstIndex = 0;
+	_range.indexCount = 0;
+	_range.error = 0.0f;
+
+	glGenVertexArrays(1, &_vao);
+	glBindVertexArray(_vao);
+
+	// the mesh itself is stored like a Geometry
+	_packedVertices = QuantizedVertices::pack(VertexFormat::getDefault(), data.positions.size(),
+		data.positions.data(), sizeof(glm::vec3),
+		data.normals.empty() ? nullptr : data.normals.data(), sizeof(glm::vec3),
+		data.uvs.empty() ? nullptr : data.uvs.data(), sizeof(glm::vec2));
+
+	glGenBuffers(1, &_vboVertices);
+	glBindBuffer(GL_ARRAY_BUFFER, _vboVertices);
+	glBufferData(GL_ARRAY_BUFFER, _packedVertices.data.size(), _packedVertices.data.data(), GL_STATIC_DRAW);
+	std::vector<unsigned char>().swap(_packedVertices.data);
+	_packedVertices.setAttributes();
+
+	glGenBuffers(1, &_vboIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vboIndices);
+	std::vector<unsigned int> indices = data.indices;
+	_lodChain.build(indices, data.lods, data.positions.data(), data.positions.size(), sizeof(glm::vec3));
+	_bounds = Bounds::compute(data.positions.data(), data.positions.size(), sizeof(glm::vec3));
+	PackedIndices packedIndices = PackedIndices::pack(indices, data.positions.size());
+	_indexType = packedIndices.type;
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIndices.data.size(), packedIndices.data.data(), GL_STATIC_DRAW);
+
+	// the instance attributes advance once per instance, a mat4 takes four locations and a mat3 three
+	glGenBuffers(1, &_vboInstances);
+	glBindBuffer(GL_ARRAY_BUFFER, _vboInstances);
+	GLsizei stride = sizeof(InstanceData);
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(INSTANCE_LOCATION + column);
+		glVertexAttribPointer(INSTANCE_LOCATION + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(INSTANCE_LOCATION + column, 1);
+	}
+	for (GLuint column = 0; column < 3; column++) {
+		glEnableVertexAttribArray(INSTANCE_LOCATION + 4 + column);
+		glVertexAttribPointer(INSTANCE_LOCATION + 4 + column, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(INSTANCE_LOCATION + 4 + column, 1);
+	}
+	glEnableVertexAttribArray(INSTANCE_LOCATION + 7);
+	glVertexAttribIPointer(INSTANCE_LOCATION + 7, 1, GL_INT, stride, (void*)offsetof(InstanceData, material));
+	glVertexAttribDivisor(INSTANCE_LOCATION + 7, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+InstancedGeometry::~InstancedGeometry()
+{
+	glDeleteBuffers(1, &_vboInstances);
+	glDeleteBuffers(1, &_vboVertices);
+	glDeleteBuffers(1, &_vboIndices);
+	glDeleteVertexArrays(1, &_vao);
+}
+
+unsigned int InstancedGeometry::addInstance(glm::mat4 modelMatrix, unsigned int material)
+{
+	Instance instance;
+	instance.transform.set(modelMatrix);
+	instance.material = material;
+	instance.pointLightMask = -1;
+	instance.boundsVersion = ~0u;
+	_instances.push_back(instance);
+	return (unsigned int)_instances.size() - 1;
+}
+
+void InstancedGeometry::setModelMatrix(unsigned int instance, glm::mat4 modelMatrix)
+{
+	_instances[instance].transform.set(modelMatrix);
+}
+
+void InstancedGeometry::setPointLightMask(unsigned int instance, int pointLightMask)
+{
+	_instances[instance].pointLightMask = pointLightMask;
+}
+
+void InstancedGeometry::setNormalMapped(bool normalMapped)
+{
+	_normalMapped = normalMapped;
+}
+
+Bounds InstancedGeometry::getBounds(unsigned int index)
+{
+	Instance& instance = _instances[index];
+	if (instance.boundsVersion != instance.transform.getVersion()) {
+		instance.worldBounds = _bounds.transform(instance.transform.getModelMatrix());
+		instance.boundsVersion = instance.transform.getVersion();
+	}
+	return instance.worldBounds;
+}
+
+void InstancedGeometry::submit(RenderQueue& queue, unsigned int pass, const glm::mat4& viewProjection, const std::vector<unsigned int>& visible, Shader* shader)
+{
+	_instanceData.clear();
+	_runs.clear();
+	if (visible.empty()) return;
+
+	// instances of a material next to each other, a pass shader draws them all in one run
+	std::vector<unsigned int> order(visible);
+	if (!shader) {
+		std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+			return _instances[a].material < _instances[b].material;
+		});
+	}
+
+	// one level of detail for all, fine enough for the closest instance
+	float nearestDepth = 1.0f;
+	float maxPixelsPerUnit = -1.0f;
+	unsigned int finest = order[0];
+	for (unsigned int i : order) {
+		Instance& instance = _instances[i];
+		const glm::mat4& modelMatrix = instance.transform.getModelMatrix();
+		const glm::mat3& normalMatrix = instance.transform.getNormalMatrix();
+
+		InstanceData data;
+		data.modelMatrix = modelMatrix;
+		for (int column = 0; column < 3; column++)
+			data.normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+		data.material = (GLint)instance.material;
+		_instanceData.push_back(data);
+
+		if (_runs.empty() || (!shader && _runs.back().material != instance.material)) {
+			Run run = { instance.material, (unsigned int)_instanceData.size() - 1, 1, instance.pointLightMask };
+			_runs.push_back(run);
+		}
+		else {
+			_runs.back().count++;
+			_runs.back().pointLightMask |= instance.pointLightMask;
+		}
+
+		nearestDepth = std::min(nearestDepth, RenderQueue::getDepth(viewProjection, getBounds(i).center));
+		float pixelsPerUnit = _lodChain.getPixelsPerUnit(modelMatrix);
+		if (pixelsPerUnit > maxPixelsPerUnit) {
+			maxPixelsPerUnit = pixelsPerUnit;
+			finest = i;
+		}
+	}
+	_range = _lodChain.select(_instances[finest].transform.getModelMatrix());
+
+	// orphaning the buffer lets the driver keep the data of the previous pass for draws still in flight
+	glBindBuffer(GL_ARRAY_BUFFER, _vboInstances);
+	glBufferData(GL_ARRAY_BUFFER, _instanceData.size() * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, _instanceData.size() * sizeof(InstanceData), _instanceData.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for (unsigned int r = 0; r < _runs.size(); r++) {
+		uint64_t key;
+		if (shader) {
+			key = RenderQueue::makeKey(pass, false, shader->getHandle(), 0, 0, _vao, nearestDepth);
+		}
+		else {
+			Material* material = _materials[_runs[r].material].get();
+			key = RenderQueue::makeKey(pass, material->isTransparent(), material->getShader()->getHandle(), RenderQueue::getMaterialId(material),
+				material->getTextureHandle(), _vao, nearestDepth);
+		}
+		queue.submit(key, this, r);
+	}
+}
+
+void InstancedGeometry::drawQueued(RenderState& state, unsigned int part)
+{
+	const Run& run = _runs[part];
+	Shader* shader = state.getPassShader() ? state.getPassShader() : _materials[run.material]->getShader();
+	state.use(shader);
+
+	// the transforms come from the instance buffer
+	shader->setUniform("instanced", true);
+	_packedVertices.setUniforms(shader);
+
+	if (!state.getPassShader()) {
+		Material* material = _materials[run.material].get();
+		shader->setUniform("pointLightMask", run.pointLightMask);
+		state.setNormalMap(state.useNormalMaps() && _normalMapped);
+		if (state.bindMaterial(material)) material->setUniforms();
+	}
+
+	unsigned int indexSize = _indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	state.bindVertexArray(_vao);
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, _range.indexCount, _indexType, (void*)(size_t(_range.firstIndex) * indexSize), run.count, run.first);
+
+	// single draws of the same shader read the uniforms again
+	shader->setUniform("instanced", false);
+}
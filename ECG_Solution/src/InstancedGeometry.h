@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Geometry.h"
+#include "Material.h"
+#include "Shader.h"
+#include "VertexFormat.h"
+#include "LodChain.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+#include "Transform.h"
+
+/*!
+ * Many copies of one mesh, drawn with glDrawElementsInstancedBaseInstance
+ * The mesh is uploaded once. Every instance has its own transform and material index, which
+ * are written into a per-instance vertex buffer for the instances visible in a pass. Instances
+ * of the same material are drawn with one call, passes with their own shader draw all
+ * instances with one call. The shaders read the instance attributes if "instanced" is set:
+ * model matrix at locations 3-6, normal matrix at 7-9 and material index at 10.
+ */
+class InstancedGeometry : public Renderable
+{
+protected:
+	/*!
+	 * Per-instance vertex data as it is written to the instance buffer
+	 */
+	struct InstanceData {
+		glm::mat4 modelMatrix;
+		/*!
+		 * Columns of the normal matrix, w unused
+		 */
+		glm::vec4 normalMatrix[3];
+		GLint material;
+		GLint padding[3];
+	};
+
+	struct Instance {
+		Transform transform;
+		unsigned int material;
+		int pointLightMask;
+		/*!
+		 * Bounds in world space and the transform version they were computed for
+		 */
+		Bounds worldBounds;
+		unsigned int boundsVersion;
+	};
+
+	/*!
+	 * Instances of one material in the instance buffer, drawn with one call
+	 */
+	struct Run {
+		unsigned int material;
+		unsigned int first;
+		unsigned int count;
+		/*!
+		 * Point lights reaching any instance of the run
+		 */
+		int pointLightMask;
+	};
+
+	GLuint _vao;
+	GLuint _vboVertices;
+	GLuint _vboIndices;
+	GLuint _vboInstances;
+	QuantizedVertices _packedVertices;
+	GLenum _indexType;
+	LodChain _lodChain;
+	/*!
+	 * Bounds of the mesh in object space
+	 */
+	Bounds _bounds;
+
+	std::vector<std::shared_ptr<Material>> _materials;
+	bool _normalMapped;
+	std::vector<Instance> _instances;
+
+	/*!
+	 * Instances of the last submit(), ordered by material, and their runs
+	 */
+	std::vector<InstanceData> _instanceData;
+	std::vector<Run> _runs;
+	/*!
+	 * Index range of the level of detail chosen in the last submit()
+	 */
+	LodRange _range;
+
+public:
+	/*!
+	 * @param data: the mesh in object space
+	 * @param materials: the materials instances can use; may be empty if the object is only drawn
+	 * with a pass shader, the material index is then free for the shader to use
+	 */
+	InstancedGeometry(GeometryData& data, std::vector<std::shared_ptr<Material>> materials);
+	~InstancedGeometry();
+
+	InstancedGeometry(const InstancedGeometry&) = delete;
+	InstancedGeometry& operator=(const InstancedGeometry&) = delete;
+
+	/*!
+	 * @param modelMatrix: model matrix of the new instance
+	 * @param material: index into the materials
+	 * @return index of the instance
+	 */
+	unsigned int addInstance(glm::mat4 modelMatrix, unsigned int material);
+
+	void setModelMatrix(unsigned int instance, glm::mat4 modelMatrix);
+
+	/*!
+	 * @param pointLightMask: point lights reaching the instance, bit i for light i
+	 */
+	void setPointLightMask(unsigned int instance, int pointLightMask);
+
+	/*!
+	 * @param normalMapped: if the instances are drawn with their normal maps when the pass uses normal maps
+	 */
+	void setNormalMapped(bool normalMapped);
+
+	/*!
+	 * @return bounds of an instance in world space
+	 */
+	Bounds getBounds(unsigned int instance);
+
+	unsigned int getInstanceCount() const { return (unsigned int)_instances.size(); }
+
+	/*!
+	 * Writes the visible instances into the instance buffer and submits one draw per material
+	 * The buffer holds one pass at a time, the queue has to be executed before the next submit()
+	 * @param queue: queue of the pass
+	 * @param pass: pass of the keys
+	 * @param viewProjection: camera or light matrix of the pass
+	 * @param visible: indices of the instances to draw
+	 * @param shader: the shader of the pass if it replaces the materials, all instances are then drawn with one call
+	 */
+	void submit(RenderQueue& queue, unsigned int pass, const glm::mat4& viewProjection, const std::vector<unsigned int>& visible, Shader* shader = nullptr);
+
+	/*!
+	 * Draws one run of the last submit()
+	 * @param part: index of the run
+	 */
+	virtual void drawQueued(RenderState& state, unsigned int part);
+};
@@ -0,0 +1,411 @@
+#include "LevelStreamer.h"
+#include "ModelLoader.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+#include "textures/TextureRegistry.h"
+
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+//reads one byte of every page of a mapped range, so the file is paged in by the caller
+static unsigned char touchPages(const void* data, size_t bytes)
+{
+    const volatile unsigned char* pages = (const volatile unsigned char*)data;
+    unsigned char sum = 0;
+    for (size_t offset = 0; offset < bytes; offset += 4096)
+        sum += pages[offset];
+    return sum;
+}
+
+//distance from a point to an axis aligned box, 0 inside
+static float distanceToBounds(glm::vec3 point, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    glm::vec3 closest = glm::clamp(point, boundsMin, boundsMax);
+    return glm::length(point - closest);
+}
+
+LevelStreamer::LevelStreamer(const string& path, glm::mat4 modelMatrix, std::shared_ptr<Material> material, btDiscreteDynamicsWorld* world, const LevelStreamingSettings& settings, BodyFactory createBody)
+    : _settings(settings), _transform(modelMatrix), _material(material), _world(world), _createBody(createBody), _residentBytes(0), _budgetWarningShown(false)
+{
+    //directory of the filepath
+    directory = path.substr(0, path.find_last_of('/'));
+
+    string cellPath = cellCachePath(path);
+    if (!MeshCache::isUpToDate(path, cellPath) || !_cache.open(cellPath))
+    {
+        if (!cookCells(path, cellPath) || !_cache.open(cellPath))
+        {
+            std::cout << "ERROR::STREAMING::could not create the cell cache " << cellPath << std::endl;
+            return;
+        }
+    }
+
+    buildCells();
+}
+
+LevelStreamer::~LevelStreamer()
+{
+    for (Cell& cell : _cells)
+    {
+        if (cell.state == CellState::LOADING)
+            cell.pending.wait();
+        evictCell(cell);
+    }
+}
+
+string LevelStreamer::cellCachePath(const string& path) const
+{
+    //the cell size is part of the name, so changing it in the settings cooks a new file
+    return path + ".cells" + std::to_string(int(_settings.cellSize)) + ".mesh";
+}
+
+bool LevelStreamer::cookCells(const string& path, const string& cellPath)
+{
+    if (!MeshCache::isUpToDate(path) && !ModelLoader::cookModel(path))
+        return false;
+
+    MeshCache source;
+    if (!source.open(MeshCache::cachePath(path)))
+        return false;
+
+    std::vector<MeshData> pieces;
+    for (unsigned int i = 0; i < source.getMeshCount(); i++)
+    {
+        std::vector<MeshData> parts = MeshOptimizer::splitByGrid(source.getMeshData(i), _settings.cellSize);
+        for (MeshData& part : parts)
+        {
+            //the borders of the pieces stay in place, so neighbouring cells don't crack at any level
+            MeshOptimizer::generateLods(part);
+            pieces.push_back(std::move(part));
+        }
+    }
+
+    std::cout << "Cooked " << source.getMeshCount() << " meshes into " << pieces.size() << " cell pieces" << std::endl;
+    return MeshCache::write(cellPath, pieces);
+}
+
+void LevelStreamer::buildCells()
+{
+    VertexFormat format = VertexFormat::getDefault();
+
+    for (unsigned int i = 0; i < _cache.getMeshCount(); i++)
+    {
+        MeshCacheView view = _cache.getMesh(i);
+
+        //world space bounds from the transformed corners of the mesh bounds
+        glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+        for (unsigned int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 local((corner & 1) ? view.boundsMax.x : view.boundsMin.x,
+                (corner & 2) ? view.boundsMax.y : view.boundsMin.y,
+                (corner & 4) ? view.boundsMax.z : view.boundsMin.z);
+            glm::vec3 world = glm::vec3(_transform.getModelMatrix() * glm::vec4(local, 1.0f));
+            boundsMin = glm::min(boundsMin, world);
+            boundsMax = glm::max(boundsMax, world);
+        }
+
+        glm::ivec3 key = glm::ivec3(glm::floor((boundsMin + boundsMax) * 0.5f / _settings.cellSize));
+        auto found = _cellIndex.find(key);
+        if (found == _cellIndex.end())
+        {
+            found = _cellIndex.insert(std::make_pair(key, (unsigned int)_cells.size())).first;
+            _cells.emplace_back();
+            _cells.back().boundsMin = boundsMin;
+            _cells.back().boundsMax = boundsMax;
+            _cells.back().bytes = 0;
+        }
+
+        Cell& cell = _cells[found->second];
+        cell.boundsMin = glm::min(cell.boundsMin, boundsMin);
+        cell.boundsMax = glm::max(cell.boundsMax, boundsMax);
+        cell.records.push_back(i);
+
+        //gpu buffers, the cpu copies are freed once the cell is uploaded
+        size_t indexSize = PackedIndices::chooseType(view.vertexCount) == GL_UNSIGNED_SHORT ? 2 : 4;
+        cell.bytes += size_t(view.vertexCount) * format.getStride();
+        cell.bytes += size_t(view.indexCount) * indexSize;
+        for (const MeshCacheLodView& lod : view.lods)
+            cell.bytes += size_t(lod.indexCount) * indexSize;
+    }
+
+    std::cout << "Streaming " << _cache.getMeshCount() << " meshes in " << _cells.size() << " cells" << std::endl;
+}
+
+void LevelStreamer::update(glm::vec3 position, glm::vec3 velocity)
+{
+    if (!_cache.isOpen())
+        return;
+
+    updateWanted(position, velocity);
+    evictCells();
+    requestCells();
+    uploadCells(false);
+}
+
+void LevelStreamer::loadAround(glm::vec3 position)
+{
+    if (!_cache.isOpen())
+        return;
+
+    updateWanted(position, glm::vec3(0.0f));
+    evictCells();
+
+    //request and upload until every wanted cell that fits the budget is resident
+    while (true)
+    {
+        requestCells();
+
+        bool loading = false;
+        for (Cell& cell : _cells)
+        {
+            if (cell.state != CellState::LOADING)
+                continue;
+            cell.pending.wait();
+            loading = true;
+        }
+        if (!loading)
+            break;
+
+        uploadCells(true);
+    }
+}
+
+void LevelStreamer::updateWanted(glm::vec3 position, glm::vec3 velocity)
+{
+    //sample the path the player will take during the prefetch time, one sample per cell
+    std::vector<glm::vec3> samples(1, position);
+    glm::vec3 ahead = velocity * _settings.prefetchSeconds;
+    unsigned int steps = (unsigned int)std::ceil(glm::length(ahead) / _settings.cellSize);
+    for (unsigned int i = 1; i <= steps; i++)
+        samples.push_back(position + ahead * (float(i) / float(steps)));
+
+    for (Cell& cell : _cells)
+    {
+        cell.distance = distanceToBounds(position, cell.boundsMin, cell.boundsMax);
+        cell.wanted = false;
+        for (const glm::vec3& sample : samples)
+        {
+            if (distanceToBounds(sample, cell.boundsMin, cell.boundsMax) <= _settings.loadRadius)
+            {
+                cell.wanted = true;
+                break;
+            }
+        }
+    }
+}
+
+void LevelStreamer::requestCells()
+{
+    unsigned int loading = 0;
+    std::vector<Cell*> candidates;
+    for (Cell& cell : _cells)
+    {
+        if (cell.state == CellState::LOADING)
+            loading++;
+        else if (cell.state == CellState::UNLOADED && cell.wanted)
+            candidates.push_back(&cell);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Cell* a, const Cell* b) { return a->distance < b->distance; });
+
+    for (Cell* cell : candidates)
+    {
+        if (loading >= _settings.maxLoadingCells)
+            break;
+
+        if (!makeRoom(cell->bytes))
+        {
+            if (!_budgetWarningShown)
+                std::cout << "ERROR::STREAMING::cells around the player exceed the memory budget" << std::endl;
+            _budgetWarningShown = true;
+            break;
+        }
+
+        //the worker pages in the mapped file, gpu objects are created from it on the context thread
+        std::vector<unsigned int> records = cell->records;
+        MeshCache* cache = &_cache;
+        cell->pending = ThreadPool::shared().submit([cache, records]() {
+            std::vector<MeshCacheView> meshes;
+            meshes.reserve(records.size());
+            for (unsigned int record : records)
+            {
+                MeshCacheView view = cache->getMesh(record);
+                size_t indexCount = view.indexCount;
+                for (const MeshCacheLodView& lod : view.lods)
+                    indexCount += lod.indexCount;
+                touchPages(view.vertices, size_t(view.vertexCount) * sizeof(Vertex));
+                touchPages(view.indices, indexCount * sizeof(unsigned int));
+                meshes.push_back(view);
+            }
+            return meshes;
+        });
+
+        cell->state = CellState::LOADING;
+        _residentBytes += cell->bytes;
+        loading++;
+    }
+}
+
+void LevelStreamer::uploadCells(bool all)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Cell*> ready;
+    for (Cell& cell : _cells)
+    {
+        if (cell.state == CellState::LOADING && cell.pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            ready.push_back(&cell);
+    }
+    std::sort(ready.begin(), ready.end(), [](const Cell* a, const Cell* b) { return a->distance < b->distance; });
+
+    for (Cell* cell : ready)
+    {
+        uploadCell(*cell);
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (!all && elapsed.count() >= _settings.uploadBudgetMs)
+            break;
+    }
+}
+
+void LevelStreamer::uploadCell(Cell& cell)
+{
+    std::vector<MeshCacheView> meshes = cell.pending.get();
+
+    //the player moved away while the cell was read
+    if (!cell.wanted)
+    {
+        cell.state = CellState::UNLOADED;
+        _residentBytes -= cell.bytes;
+        return;
+    }
+
+    for (const MeshCacheView& view : meshes)
+    {
+        std::vector<MeshTexture> textures;
+        for (const MeshTextureRef& ref : view.textures)
+        {
+            MeshTexture texture;
+            texture.id = TextureRegistry::instance().acquire(directory + '/' + ref.path, ref.type == "texture_diffuse" ? 1 : 0);
+            texture.type = ref.type;
+            texture.path = ref.path;
+            textures.push_back(texture);
+        }
+
+        //streamed cells are never batched, so the meshes need no cpu copies
+        cell.meshes.push_back(Mesh(view, textures, false));
+        cell.culling.add(cell.meshes.back()._bounds.transform(_transform.getModelMatrix()));
+
+        BulletBody* body = _createBody ? _createBody(CollisionMesh::create(view)) : nullptr;
+        if (body)
+            cell.bodies.push_back(body);
+    }
+
+    cell.state = CellState::LOADED;
+}
+
+void LevelStreamer::evictCells()
+{
+    for (Cell& cell : _cells)
+    {
+        if (cell.state == CellState::LOADED && !cell.wanted && cell.distance > _settings.evictRadius)
+            evictCell(cell);
+    }
+}
+
+void LevelStreamer::evictCell(Cell& cell)
+{
+    if (cell.state != CellState::LOADED)
+        return;
+
+    for (Mesh& mesh : cell.meshes)
+    {
+        for (const MeshTexture& texture : mesh._textures)
+            TextureRegistry::instance().release(texture.id);
+        mesh.releaseBuffers();
+    }
+    for (BulletBody* body : cell.bodies)
+    {
+        body->deleteBody(_world);
+        delete body;
+    }
+
+    std::vector<Mesh>().swap(cell.meshes);
+    cell.culling.clear();
+    cell.bodies.clear();
+    cell.state = CellState::UNLOADED;
+    _residentBytes -= cell.bytes;
+}
+
+bool LevelStreamer::makeRoom(size_t bytes)
+{
+    while (_residentBytes + bytes > _settings.memoryBudget)
+    {
+        Cell* farthest = nullptr;
+        for (Cell& cell : _cells)
+        {
+            if (cell.state == CellState::LOADED && !cell.wanted && (!farthest || cell.distance > farthest->distance))
+                farthest = &cell;
+        }
+        if (!farthest)
+            return false;
+        evictCell(*farthest);
+    }
+    return true;
+}
+
+void LevelStreamer::Draw(const Frustum& frustum)
+{
+    Shader* shader = _material->getShader();
+    //the level meshes bind plain textures, layers of earlier materials do not apply
+    shader->use();
+    shader->setUniform("videoLayer", -1);
+    shader->setUniform("atlasLayer", -1);
+    shader->setUniform("atlasNormalLayer", -1);
+    shader->setUniform("pointLightMask", -1);
+    drawCells(shader, frustum, true);
+}
+
+void LevelStreamer::DrawShader(Shader* shader, const Frustum& frustum)
+{
+    drawCells(shader, frustum, false);
+}
+
+void LevelStreamer::drawCells(Shader* shader, const Frustum& frustum, bool requestTextures)
+{
+    shader->use();
+
+    shader->setUniform("modelMatrix", _transform.getModelMatrix());
+    shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+
+    for (Cell& cell : _cells)
+    {
+        if (cell.state != CellState::LOADED)
+            continue;
+
+        cell.culling.cull(frustum, _visible);
+        for (unsigned int i : _visible)
+            cell.meshes[i].Draw(shader, _transform.getModelMatrix(), requestTextures);
+    }
+}
+
+unsigned int LevelStreamer::getCellCount() const
+{
+    return (unsigned int)_cells.size();
+}
+
+unsigned int LevelStreamer::getLoadedCellCount() const
+{
+    unsigned int loaded = 0;
+    for (const Cell& cell : _cells)
+        if (cell.state == CellState::LOADED)
+            loaded++;
+    return loaded;
+}
+
+size_t LevelStreamer::getResidentBytes() const
+{
+    return _residentBytes;
+}
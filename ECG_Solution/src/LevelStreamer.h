@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Transform.h"
+#include "MeshCache.h"
+#include "Material.h"
+#include "bullet/BulletBody.h"
+
+//streaming parameters, read from the [streaming] section of settings.ini
+struct LevelStreamingSettings {
+    float cellSize = 32.0f;         //edge length of a cell in world units
+    float loadRadius = 48.0f;       //cells closer than this to the player (or the prefetch path) are loaded
+    float evictRadius = 96.0f;      //loaded cells farther than this are evicted
+    float prefetchSeconds = 1.5f;   //how far ahead along the player's velocity cells are requested
+    size_t memoryBudget = 256 * 1024 * 1024;   //upper bound of mesh memory (gpu + cpu copies) in bytes
+    double uploadBudgetMs = 2.0;    //time per frame spent creating meshes and bodies
+    unsigned int maxLoadingCells = 2;   //cells read from disk at the same time
+};
+
+//streams a level in spatial cells around the player
+//the model is cooked into a cell-split mesh cache once, which is then mapped and read per cell
+class LevelStreamer {
+
+public:
+
+    //creates the collision body of a mesh, returns nullptr for meshes without collision
+    typedef std::function<BulletBody*(const CollisionMesh& collision)> BodyFactory;
+
+private:
+
+    enum class CellState { UNLOADED, LOADING, LOADED };
+
+    struct Cell {
+        glm::vec3 boundsMin, boundsMax;     //world space bounds of all meshes in the cell
+        std::vector<unsigned int> records;  //meshes of the cell in the cell cache
+        size_t bytes;                       //estimated memory when loaded
+
+        CellState state = CellState::UNLOADED;
+        std::future<std::vector<MeshCacheView>> pending;
+        std::vector<Mesh> meshes;
+        std::vector<BulletBody*> bodies;
+        CullingSet culling;                 //world space bounds of the loaded meshes
+
+        float distance = 0.0f;      //to the player, updated every frame
+        bool wanted = false;
+    };
+
+    struct CellKeyHash {
+        size_t operator()(const glm::ivec3& key) const
+        {
+            return (size_t(key.x) * 73856093u) ^ (size_t(key.y) * 19349663u) ^ (size_t(key.z) * 83492791u);
+        }
+    };
+
+    LevelStreamingSettings _settings;
+    Transform _transform;
+    std::shared_ptr<Material> _material;
+    btDiscreteDynamicsWorld* _world;
+    BodyFactory _createBody;
+    string directory;
+
+    //mapped cell cache, read by the worker threads
+    MeshCache _cache;
+
+    std::vector<Cell> _cells;
+    std::unordered_map<glm::ivec3, unsigned int, CellKeyHash> _cellIndex;
+
+    //estimated memory of all loading and loaded cells
+    size_t _residentBytes;
+
+    //meshes of the visible cells in the current pass
+    std::vector<unsigned int> _visible;
+    bool _budgetWarningShown;
+
+    //path of the cell split cache of a model
+    string cellCachePath(const string& path) const;
+
+    //splits the mesh cache of the model into cells and writes the cell cache
+    bool cookCells(const string& path, const string& cellPath);
+
+    //reads the cell cache and groups its meshes into cells
+    void buildCells();
+
+    //marks the cells around the player and along the prefetch path as wanted
+    void updateWanted(glm::vec3 position, glm::vec3 velocity);
+
+    //starts reading wanted cells on the worker threads, nearest first
+    void requestCells();
+
+    //creates meshes and bodies of read cells within the upload budget
+    void uploadCells(bool all);
+
+    //creates meshes and bodies of one read cell
+    void uploadCell(Cell& cell);
+
+    //evicts far cells and cells beyond the memory budget
+    void evictCells();
+
+    void evictCell(Cell& cell);
+
+    //evicts unwanted cells, farthest first, until the bytes fit into the budget
+    bool makeRoom(size_t bytes);
+
+    //draws the visible meshes of the loaded cells, only the colour pass requests texture residency
+    void drawCells(Shader* shader, const Frustum& frustum, bool requestTextures);
+
+public:
+
+    //opens or cooks the cell cache of the model, no cell is loaded yet
+    LevelStreamer(const string& path, glm::mat4 modelMatrix, std::shared_ptr<Material> material, btDiscreteDynamicsWorld* world, const LevelStreamingSettings& settings, BodyFactory createBody);
+
+    //evicts all cells
+    ~LevelStreamer();
+
+    LevelStreamer(const LevelStreamer&) = delete;
+    LevelStreamer& operator=(const LevelStreamer&) = delete;
+
+    //loads and evicts cells for the current player position and velocity, call once per frame
+    void update(glm::vec3 position, glm::vec3 velocity);
+
+    //loads the cells around a position and waits for them, e.g. before spawning the player
+    void loadAround(glm::vec3 position);
+
+    //draws the loaded meshes inside the frustum
+    void Draw(const Frustum& frustum = Frustum());
+
+    void DrawShader(Shader* shader, const Frustum& frustum = Frustum());
+
+    unsigned int getCellCount() const;
+
+    unsigned int getLoadedCellCount() const;
+
+    size_t getResidentBytes() const;
+};
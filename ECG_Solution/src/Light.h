@@ -7,6 +7,8 @@
 
 
 #include <glm\glm.hpp>
+#include <cfloat>
+#include <cmath>
 
 /*!
  * Directional light, a light that gets emitted in a specific direction
@@ -83,6 +85,23 @@ struct PointLight {
 		: _color(color), _position(position), _attenuation(attenuation), _enabled(enabled)
 	{}
 
+	/*!
+	 * Distance at which the attenuated light falls below a fraction of full intensity
+	 * @param threshold: intensity that counts as no light, 5/256 is below one step of an 8 bit channel after tone mapping
+	 * @return the radius, FLT_MAX if the light never falls off that far
+	 */
+	float getRadius(float threshold = 5.0f / 256.0f) const {
+		float intensity = glm::max(_color.r, glm::max(_color.g, _color.b));
+		// solve constant + linear * d + quadratic * d^2 = intensity / threshold
+		float c = _attenuation.x - intensity / threshold;
+		if (c >= 0.0f) return 0.0f;
+		if (_attenuation.z > 0.0f)
+			return (-_attenuation.y + std::sqrt(_attenuation.y * _attenuation.y - 4.0f * _attenuation.z * c)) / (2.0f * _attenuation.z);
+		if (_attenuation.y > 0.0f)
+			return -c / _attenuation.y;
+		return FLT_MAX;
+	}
+
 	/*!
 	 * If the light is enabled
 	 */
@@ -0,0 +1,99 @@
+#include "LodChain.h"
+
+#include <algorithm>
+#include <cfloat>
+
+bool LodChain::_enabled = true;
+float LodChain::_pixelError = 1.0f;
+float LodChain::_hysteresis = 0.25f;
+glm::vec3 LodChain::_cameraPosition = glm::vec3(0.0f);
+float LodChain::_projectionScale = 0.0f;
+
+LodChain::LodChain()
+	: _center(0.0f), _radius(0.0f), _current(0)
+{
+}
+
+void LodChain::build(std::vector<unsigned int>& indices, const std::vector<LodIndices>& lods, const glm::vec3* positions, size_t count, size_t stride)
+{
+	unsigned int indexCount = (unsigned int)indices.size();
+	std::vector<LodRange> ranges;
+	for (const LodIndices& lod : lods) {
+		ranges.push_back({ (unsigned int)indices.size(), (unsigned int)lod.indices.size(), lod.error });
+		indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+	}
+	build(indexCount, ranges, positions, count, stride);
+}
+
+void LodChain::build(unsigned int indexCount, const std::vector<LodRange>& lods, const glm::vec3* positions, size_t count, size_t stride)
+{
+	_ranges.clear();
+	_ranges.push_back({ 0, indexCount, 0.0f });
+	_ranges.insert(_ranges.end(), lods.begin(), lods.end());
+	_current = 0;
+
+	// sphere around the center of the bounding box, good enough for choosing levels
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3& position = *(const glm::vec3*)((const unsigned char*)positions + i * stride);
+		boundsMin = i == 0 ? position : glm::min(boundsMin, position);
+		boundsMax = i == 0 ? position : glm::max(boundsMax, position);
+	}
+	_center = (boundsMin + boundsMax) * 0.5f;
+	_radius = glm::length(boundsMax - boundsMin) * 0.5f;
+}
+
+const LodRange& LodChain::select(const glm::mat4& modelMatrix)
+{
+	if (!_enabled || _ranges.size() < 2 || _projectionScale <= 0.0f) {
+		_current = 0;
+		return _ranges[0];
+	}
+
+	// the camera is inside the bounds
+	float pixelsPerUnit = getPixelsPerUnit(modelMatrix);
+	if (pixelsPerUnit == FLT_MAX) {
+		_current = 0;
+		return _ranges[0];
+	}
+
+	// coarsest level that stays below the pixel error, errors grow with the level
+	unsigned int level = 0;
+	for (unsigned int i = 1; i < _ranges.size(); i++) {
+		if (_ranges[i].error * pixelsPerUnit > _pixelError) break;
+		level = i;
+	}
+
+	// finer levels are taken at once, coarser ones only once they are clearly below the threshold
+	while (level > _current && _ranges[level].error * pixelsPerUnit > _pixelError * (1.0f - _hysteresis))
+		level--;
+
+	_current = level;
+	return _ranges[_current];
+}
+
+float LodChain::getPixelsPerUnit(const glm::mat4& modelMatrix) const
+{
+	if (_projectionScale <= 0.0f) return FLT_MAX;
+
+	// errors are in object space, the largest axis scale converts them to world space
+	float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+	glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(_center, 1.0f));
+	float distance = glm::length(center - _cameraPosition) - _radius * scale;
+	if (distance <= 0.0f) return FLT_MAX;
+
+	return scale * _projectionScale / distance;
+}
+
+void LodChain::setView(glm::vec3 cameraPosition, const glm::mat4& projection, float viewportHeight)
+{
+	_cameraPosition = cameraPosition;
+	_projectionScale = projection[1][1] * viewportHeight * 0.5f;
+}
+
+void LodChain::setSettings(bool enabled, float pixelError, float hysteresis)
+{
+	_enabled = enabled;
+	_pixelError = pixelError;
+	_hysteresis = glm::clamp(hysteresis, 0.0f, 0.9f);
+}
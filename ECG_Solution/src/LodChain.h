@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*!
+ * Index list of one simplified level of detail
+ * The level shares the vertices of the full detail mesh, only the triangles differ.
+ */
+struct LodIndices {
+	std::vector<unsigned int> indices;
+	/*!
+	 * Geometric deviation from the full detail mesh in object space units
+	 */
+	float error;
+};
+
+/*!
+ * Range of one level in the index buffer of an object
+ */
+struct LodRange {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error;
+};
+
+/*!
+ * Levels of detail of one object and the level it is currently drawn with
+ * A level is allowed while its error, projected onto the screen, stays below the pixel error
+ * of the settings. Switching to a coarser level needs the error to be below the threshold by
+ * the hysteresis fraction, so objects near a threshold don't alternate between two levels.
+ */
+class LodChain
+{
+protected:
+	/*!
+	 * Index ranges of all levels, finest first, level 0 is the full detail mesh
+	 */
+	std::vector<LodRange> _ranges;
+	/*!
+	 * Bounding sphere in object space
+	 */
+	glm::vec3 _center;
+	float _radius;
+	/*!
+	 * Level chosen by the last select()
+	 */
+	unsigned int _current;
+
+	static bool _enabled;
+	static float _pixelError;
+	static float _hysteresis;
+	static glm::vec3 _cameraPosition;
+	/*!
+	 * Pixels covered by one world unit at distance 1 from the camera
+	 */
+	static float _projectionScale;
+
+public:
+	LodChain();
+
+	/*!
+	 * Appends the levels to the full detail indices and records their ranges
+	 * @param indices: full detail indices, the indices of the levels are appended
+	 * @param lods: simplified levels, finest first
+	 * @param positions: vertex positions for the bounding sphere
+	 * @param count: number of vertices
+	 * @param stride: distance between two positions in bytes
+	 */
+	void build(std::vector<unsigned int>& indices, const std::vector<LodIndices>& lods, const glm::vec3* positions, size_t count, size_t stride);
+
+	/*!
+	 * Records the ranges of levels that already follow the full detail indices, e.g. in a mesh cache
+	 * @param indexCount: number of full detail indices
+	 * @param lods: index ranges of the simplified levels, finest first
+	 */
+	void build(unsigned int indexCount, const std::vector<LodRange>& lods, const glm::vec3* positions, size_t count, size_t stride);
+
+	/*!
+	 * Chooses the level for the current view
+	 * @param modelMatrix: model matrix the object is drawn with
+	 * @return index range of the chosen level
+	 */
+	const LodRange& select(const glm::mat4& modelMatrix);
+
+	/*!
+	 * @return the range of a level, level 0 is the full detail mesh
+	 */
+	const LodRange& getRange(unsigned int level) const { return _ranges[level]; }
+
+	unsigned int getLevelCount() const { return (unsigned int)_ranges.size(); }
+
+	unsigned int getCurrentLevel() const { return _current; }
+
+	/*!
+	 * On screen size of one object space unit at the nearest point of the bounding sphere
+	 * @param modelMatrix: model matrix the object is drawn with
+	 * @return pixels per unit, FLT_MAX if the camera is inside the bounds or no view is set
+	 */
+	float getPixelsPerUnit(const glm::mat4& modelMatrix) const;
+
+	/*!
+	 * Sets the view all levels are chosen for, call once per frame
+	 * @param cameraPosition: position of the camera in world space
+	 * @param projection: projection matrix of the camera
+	 * @param viewportHeight: height of the viewport in pixels
+	 */
+	static void setView(glm::vec3 cameraPosition, const glm::mat4& projection, float viewportHeight);
+
+	/*!
+	 * @param enabled: if false, every object is drawn at full detail
+	 * @param pixelError: largest allowed error on screen in pixels
+	 * @param hysteresis: fraction of the pixel error a coarser level has to stay below before it is chosen
+	 */
+	static void setSettings(bool enabled, float pixelError, float hysteresis);
+};
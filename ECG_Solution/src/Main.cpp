@@ -7,16 +7,30 @@
 
 #include "Utils.h"
 #include <sstream>
+#include <algorithm>
 #include "Camera.h"
 #include "CameraPlayer.h"
 #include "Shader.h"
 #include "Geometry.h"
+#include "InstancedGeometry.h"
+#include "VertexFormat.h"
 #include "Material.h"
 #include "Light.h"
 #include "textures/Texture.h"
 #include "textures/ShadowMapTexture.h"
+#include "textures/TextureRegistry.h"
+#include "textures/TextureStreamer.h"
+#include "textures/TextureCooker.h"
+#include "textures/MipGenerator.h"
+#include "textures/TextureResidency.h"
 #include "UserInterface.h"
 #include "ModelLoader.h"
+#include "StaticBatch.h"
+#include "LevelStreamer.h"
+#include "Culling.h"
+#include "Bvh.h"
+#include "RenderQueue.h"
+#include "FrameUniforms.h"
 #include "bullet/BulletWorld.h"
 #include "bullet/BulletBody.h"
 #include "PostProcessing.h"
@@ -36,11 +50,8 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void poll_keys(GLFWwindow* window, double dt);
 
-void setPerFrameUniformsTexture(Shader* shader,std::vector<DirectionalLight> dirLights, std::vector<std::shared_ptr<PointLight>> pointLights);
-void setPerFrameUniformsDepth(Shader* depthShader, std::vector<DirectionalLight> dirLights);
-void setPerFrameUniformsLight(Shader* shader, std::shared_ptr<PointLight> pointL);
-
 glm::mat4 lookAtView(glm::vec3 eye, glm::vec3 at, glm::vec3 up);
+bool isSphereVisible(const Frustum& frustum, glm::vec3 center, float radius);
 
 /* --------------------------------------------- */
 // Global variables
@@ -66,6 +77,16 @@ int window_width, window_height, _refresh_rate;
 GLFWmonitor* monitor;
 bool fullscreen;
 float _brightness;
+double _textureUploadBudget;
+bool _splitLargeMeshes;
+bool _keepCpuMeshData;
+bool _streamingEnabled;
+bool _printVideoUploads;
+bool _printCullStats;
+int _ballCount;
+bool _atlasEnabled;
+int _atlasPageSize;
+LevelStreamingSettings _streamingSettings;
 float exposure = 1.0f;
 
 std::vector<DirectionalLight> dirLights;
@@ -92,9 +113,62 @@ int main(int argc, char** argv)
 	float fov = float(reader.GetReal("camera", "fov", 60.0f));
 	float nearZ = float(reader.GetReal("camera", "near", 0.1f));
 	float farZ = float(reader.GetReal("camera", "far", 1000.0f));
+	_textureUploadBudget = reader.GetReal("textures", "upload_budget_ms", 2.0);
+	TextureRegistry::instance().setPreferCompressed(reader.GetBoolean("textures", "prefer_compressed", true));
+	MipGenerator::setFilter(MipGenerator::parseFilter(reader.Get("textures", "mip_filter", "box")));
+	MipGenerator::setCutoutNames(reader.Get("textures", "cutout_textures", "smiley.png"));
+	_atlasEnabled = reader.GetBoolean("textures", "atlas", false);
+	_atlasPageSize = reader.GetInteger("textures", "atlas_page_size", 1024);
+	VertexFormat::getDefault() = VertexFormat::parse(
+		reader.Get("mesh", "position_format", "float"),
+		reader.Get("mesh", "normal_format", "float"),
+		reader.Get("mesh", "uv_format", "float"));
+	_splitLargeMeshes = reader.GetBoolean("mesh", "split_large_meshes", true);
+	_keepCpuMeshData = reader.GetBoolean("mesh", "keep_cpu_data", false);
+	_streamingEnabled = reader.GetBoolean("streaming", "enabled", false);
+	_streamingSettings.cellSize = float(reader.GetReal("streaming", "cell_size", 32.0));
+	_streamingSettings.loadRadius = float(reader.GetReal("streaming", "load_radius", 48.0));
+	_streamingSettings.evictRadius = float(reader.GetReal("streaming", "evict_radius", 96.0));
+	_streamingSettings.prefetchSeconds = float(reader.GetReal("streaming", "prefetch_seconds", 1.5));
+	_streamingSettings.memoryBudget = size_t(reader.GetInteger("streaming", "memory_budget_mb", 256)) * 1024 * 1024;
+	_streamingSettings.uploadBudgetMs = reader.GetReal("streaming", "upload_budget_ms", 2.0);
+	_printVideoUploads = reader.GetBoolean("video", "print_upload_stats", false);
+	CullingSet::setSettings(reader.GetBoolean("culling", "enabled", true));
+	_printCullStats = reader.GetBoolean("culling", "print_stats", false);
+	_ballCount = std::max((int)reader.GetInteger("instancing", "ball_count", 5), 0);
+	VideoSource::setSettings(unsigned(reader.GetInteger("video", "buffer_frames", 8)),
+		size_t(reader.GetInteger("video", "buffer_mb", 16)) * 1024 * 1024);
+	VideoArray::setSettings(size_t(reader.GetInteger("video", "array_budget_mb", 64)) * 1024 * 1024,
+		reader.GetBoolean("video", "array_compressed", true));
+	LodChain::setSettings(reader.GetBoolean("lod", "enabled", true),
+		float(reader.GetReal("lod", "pixel_error", 1.0)),
+		float(reader.GetReal("lod", "hysteresis", 0.25)));
+	TextureResidency::setSettings(reader.GetBoolean("residency", "enabled", true),
+		size_t(reader.GetInteger("residency", "budget_mb", 256)) * 1024 * 1024,
+		float(reader.GetReal("residency", "bias", 0.0)),
+		int(reader.GetInteger("residency", "min_size", 64)),
+		unsigned(reader.GetInteger("residency", "loads_per_frame", 2)));
 	string _fontpath = "assets/fonts/Roboto-Regular.ttf";
-	BulletBody winPlatform;
-	BulletBody movingPlatform;
+
+	/* --------------------------------------------- */
+	// Asset cooking (command line only, no window)
+	/* --------------------------------------------- */
+
+	// "--cook-textures [fast|normal|high]" writes ktx files next to the images, "--texture-benchmark" compares the encoder settings
+	if (argc > 1 && (std::string(argv[1]) == "--cook-textures" || std::string(argv[1]) == "--texture-benchmark")) {
+		std::vector<std::string> images = TextureCooker::listImages("assets/textures");
+		std::vector<std::string> objectImages = TextureCooker::listImages("assets/objects/textures");
+		images.insert(images.end(), objectImages.begin(), objectImages.end());
+
+		if (std::string(argv[1]) == "--texture-benchmark") {
+			TextureCooker::benchmark(images);
+		}
+		else {
+			std::string quality = argc > 2 ? argv[2] : reader.Get("textures", "cook_quality", "normal");
+			TextureCooker::cook(images, TextureCooker::parseQuality(quality));
+		}
+		return EXIT_SUCCESS;
+	}
 
 	_player.setProjectionMatrix(fov, farZ, nearZ, (float)window_width / (float)window_height);
 	std::shared_ptr<UserInterface> _ui;
@@ -172,7 +246,8 @@ int main(int argc, char** argv)
 	glClearColor(1, 1, 1, 1);
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
-	glEnable(GL_BLEND);
+	// the scene is opaque, blending is enabled for transparent draws and the user interface only
+	glDisable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 
@@ -183,6 +258,10 @@ int main(int argc, char** argv)
 
 		// Load shader(s)
 		std::shared_ptr<Shader> textureShader = std::make_shared<Shader>("texture.vert", "texture.frag");
+		// the array sampler needs its own unit, two sampler types on unit 0 fail to draw
+		textureShader->use();
+		textureShader->setUniform("videoTexture", (int)Texture::VIDEO_ARRAY_UNIT);
+		textureShader->setUniform("atlasTexture", (int)Texture::ATLAS_UNIT);
 		// for shadow mapping
 		std::shared_ptr<Shader> depthShader = std::make_shared<Shader>("depth.vert", "depth.frag");
 
@@ -194,6 +273,9 @@ int main(int argc, char** argv)
 				
 		std::shared_ptr<Shader> lightShader = std::make_shared<Shader>("texture.vert", "lightbox.frag");
 
+		// camera and lights of the frame, shared by all shaders above through their uniform blocks
+		FrameUniforms frameUniforms;
+
 		// Initialize bullet world
 		BulletWorld bulletWorld = BulletWorld(btVector3(0, -10, 0));
 		_player.addToWorld(bulletWorld);
@@ -203,21 +285,35 @@ int main(int argc, char** argv)
 
 		std::shared_ptr<Texture> justDoItTexture = std::make_shared<Texture>("assets/textures/videotextures/justdoit/frame_191.jpg", shadowMapTexture->getHandle(), "video");
 		std::shared_ptr<Texture> goodGameTexture = std::make_shared<Texture>("assets/textures/videotextures/goodgame/frame_47.jpg", shadowMapTexture->getHandle(), "video");
-		std::shared_ptr<Texture> imageTexture = std::make_shared<Texture>("assets/textures/smiley.png", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> furTexture = std::make_shared<Texture>("assets/textures/fur.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> furNormalTexture = std::make_shared<Texture>("assets/textures/fur_normal.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> abstractTexture = std::make_shared<Texture>("assets/textures/abstract.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> abstractNormalTexture = std::make_shared<Texture>("assets/textures/abstract_normal.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> brickTexture = std::make_shared<Texture>("assets/textures/brick.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> brickNormalTexture = std::make_shared<Texture>("assets/textures/brick_normal.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> woodTexture = std::make_shared<Texture>("assets/textures/wood.jpg", shadowMapTexture->getHandle(), "image");
-		std::shared_ptr<Texture> woodNormalTexture = std::make_shared<Texture>("assets/textures/wood_normal.jpg", shadowMapTexture->getHandle(), "image");
+
+		// the material images share one texture array, all materials draw with the same binding
+		std::shared_ptr<TextureAtlas> materialAtlas;
+		if (_atlasEnabled) {
+			materialAtlas = std::make_shared<TextureAtlas>(_atlasPageSize);
+			for (const char* file : { "assets/textures/smiley.png", "assets/textures/fur.jpg", "assets/textures/fur_normal.jpg",
+				"assets/textures/abstract.jpg", "assets/textures/abstract_normal.jpg", "assets/textures/brick.jpg", "assets/textures/brick_normal.jpg",
+				"assets/textures/wood.jpg", "assets/textures/wood_normal.jpg" }) {
+				materialAtlas->add(file);
+			}
+			materialAtlas->build();
+			std::cout << "material atlas: " << materialAtlas->getLayerCount() << " layers, " << materialAtlas->getBytes() / (1024 * 1024) << " MB" << std::endl;
+		}
+
+		std::shared_ptr<Texture> imageTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/smiley.png", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> furTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/fur.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> furNormalTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/fur_normal.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> abstractTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/abstract.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> abstractNormalTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/abstract_normal.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> brickTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/brick.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> brickNormalTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/brick_normal.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> woodTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/wood.jpg", shadowMapTexture->getHandle());
+		std::shared_ptr<Texture> woodNormalTexture = std::make_shared<Texture>(materialAtlas, "assets/textures/wood_normal.jpg", shadowMapTexture->getHandle());
 
 		// set normal map 
-		brickTexture->setNormalMap(brickNormalTexture->getHandle());
-		woodTexture->setNormalMap(woodNormalTexture->getHandle());
-		furTexture->setNormalMap(furNormalTexture->getHandle());
-		abstractTexture->setNormalMap(abstractNormalTexture->getHandle());
+		brickTexture->setNormalMap(*brickNormalTexture);
+		woodTexture->setNormalMap(*woodNormalTexture);
+		furTexture->setNormalMap(*furNormalTexture);
+		abstractTexture->setNormalMap(*abstractNormalTexture);
 
 		// Create materials
 		std::shared_ptr<Material> woodTextureMaterial = std::make_shared<TextureMaterial>(textureShader, glm::vec3(0.1f, 0.5f, 0.1f), 2.0f, woodTexture);
@@ -230,51 +326,82 @@ int main(int argc, char** argv)
 
 		std::shared_ptr<Material> sceneMaterial = std::make_shared<TextureMaterial>(textureShader);
 		std::shared_ptr<Material> depthMaterial = std::make_shared<TextureMaterial>(depthShader);
-		std::shared_ptr<Material> lightMaterial = std::make_shared<TextureMaterial>(lightShader);
 
 		// Create geometry
-		Geometry goodGameScreen(glm::translate(glm::mat4(1.0f), glm::vec3(-40.0f, 41.0f, 27.0f)), Geometry::createCubeGeometry(0.01f, 5.0f, 5.0f), goodGameTextureMaterial);
-		Geometry goodGameWall(glm::translate(glm::mat4(1.0f), glm::vec3(-40.25f, 41.0f, 27.0f)), Geometry::createCubeGeometry(0.5f, 5.0f, 5.0f), woodTextureMaterial);
-		Geometry justDoItScreen(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, -4.0f)), Geometry::createCubeGeometry(5.0f, 3.0f, 0.01f), justDoItTextureMaterial);
-		Geometry justDoItWall(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, -4.25f)), Geometry::createCubeGeometry(5.0f, 3.0f, 0.5f), woodTextureMaterial);
+		// non-moving objects are merged into one static batch
+		StaticBatch staticBatch;
+		staticBatch.add(Geometry::createCubeGeometry(0.01f, 5.0f, 5.0f), glm::translate(glm::mat4(1.0f), glm::vec3(-40.0f, 41.0f, 27.0f)), goodGameTextureMaterial);
+		staticBatch.add(Geometry::createCubeGeometry(0.5f, 5.0f, 5.0f), glm::translate(glm::mat4(1.0f), glm::vec3(-40.25f, 41.0f, 27.0f)), woodTextureMaterial, true);
+		staticBatch.add(Geometry::createCubeGeometry(5.0f, 3.0f, 0.01f), glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, -4.0f)), justDoItTextureMaterial);
+		staticBatch.add(Geometry::createCubeGeometry(5.0f, 3.0f, 0.5f), glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, -4.25f)), woodTextureMaterial, true);
 		std::shared_ptr<BulletBody> btWall = std::make_shared<BulletBody>(btObject, Geometry::createCubeGeometry(5.0f, 3.0f, 0.5f), 0.0f, true, glm::vec3(0.0f, 2.5f, -4.25f), bulletWorld._world);
 
-		Geometry box1(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 3.0f, 5.0f)), Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), abstractTextureMaterial);
+		// the boxes share one mesh, every instance picks its material
+		InstancedGeometry boxes(Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), { abstractTextureMaterial, furTextureMaterial, brickTextureMaterial });
+		boxes.setNormalMapped(true);
+		boxes.addInstance(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 3.0f, 5.0f)), 0);
 		BulletBody btBox1(btObject, Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), 1.0f, true, glm::vec3(1.0f, 3.0f, 5.0f), bulletWorld._world);
-		Geometry box2(glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 5.0f)), Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), furTextureMaterial);
+		boxes.addInstance(glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 5.0f)), 1);
 		BulletBody btBox2(btObject, Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), 1.0f, true, glm::vec3(3.0f, 3.0f, 5.0f), bulletWorld._world);
-		Geometry box3(glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 5.0f)), Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), brickTextureMaterial);
+		boxes.addInstance(glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 5.0f)), 2);
 		BulletBody btBox3(btObject, Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), 1.0f, true, glm::vec3(3.0f, 3.0f, 5.0f), bulletWorld._world);
 
 		glm::mat4 sceneModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-		ModelLoader scene("assets/objects/scene.obj", sceneModel, sceneMaterial);
-		
-		for (const auto& mesh : scene.getMeshes()) {
-			string name(mesh._aiMesh->mName.C_Str());
-			
+
+		// collision bodies of the level meshes are chosen by mesh name
+		auto createSceneBody = [&bulletWorld](const CollisionMesh& collision) -> BulletBody* {
+			const string& name = collision.name;
+
 			if (!(name.compare("hull"))) {
-				BulletBody btScene(btObject, mesh._aiMesh, mesh._transformationMatrix, 0.0f, false, bulletWorld._world);
+				return new BulletBody(btObject, collision, 0.0f, false, bulletWorld._world);
 			}
 			else if (!(name.compare("win"))) {
 				std::cout << "winplatform found" << std::endl;
-				winPlatform = BulletBody(btWin, mesh._aiMesh, mesh._transformationMatrix, 0.0f, true, bulletWorld._world);
+				return new BulletBody(btWin, collision, 0.0f, true, bulletWorld._world);
 			}
 			else if (!(name.compare("move"))) {
-				movingPlatform = BulletBody(btWin, mesh._aiMesh, mesh._transformationMatrix, 0.0f, true, bulletWorld._world);
+				return new BulletBody(btWin, collision, 0.0f, true, bulletWorld._world);
 			}
 			else if (name.find("Cube") != string::npos) {
-				BulletBody btScene(btPlatform, mesh._aiMesh, mesh._transformationMatrix, 0.0f, true, bulletWorld._world);
+				return new BulletBody(btPlatform, collision, 0.0f, true, bulletWorld._world);
+			}
+			return nullptr;
+		};
+
+		// the level is either streamed in cells around the player or loaded completely into the static batch
+		std::unique_ptr<ModelLoader> scene;
+		std::unique_ptr<LevelStreamer> levelStreamer;
+		std::vector<std::unique_ptr<BulletBody>> sceneBodies;
+
+		if (_streamingEnabled) {
+			levelStreamer.reset(new LevelStreamer("assets/objects/scene.obj", sceneModel, sceneMaterial, bulletWorld._world, _streamingSettings, createSceneBody));
+			levelStreamer->loadAround(_player.getPosition());
+		}
+		else {
+			scene.reset(new ModelLoader("assets/objects/scene.obj", sceneModel, sceneMaterial, _splitLargeMeshes));
+			for (const CollisionMesh& collision : scene->getCollisionMeshes()) {
+				sceneBodies.push_back(std::unique_ptr<BulletBody>(createSceneBody(collision)));
+			}
+			scene->addToBatch(staticBatch);
+
+			// the batch and the bodies have their own copies now
+			if (!_keepCpuMeshData) {
+				size_t released = scene->releaseCpuData();
+				std::cout << "released " << released / 1024 << " KB of cpu mesh data" << std::endl;
 			}
-			
 		}
 
-		std::vector<std::shared_ptr<Geometry>> balls;
+		staticBatch.build();
+		std::cout << "static batch: " << staticBatch.getObjectCount() << " objects in " << staticBatch.getDrawCallCount() << " draw calls" << std::endl;
+
+		// all balls are instances of one sphere, stacked so that their bodies don't start inside each other
+		InstancedGeometry balls(Geometry::createSphereGeometry(15.0f, 15.0f, 0.5f), { imageTextureMaterial });
 		std::vector< std::shared_ptr<BulletBody>> bulletBalls;
 
-		for (int i = 0; i < 5; i++) {
-			std::shared_ptr<Geometry> ball = std::make_shared<Geometry>(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 3.0f, 1.0f)), Geometry::createSphereGeometry(15.0f, 15.0f, 0.5f), imageTextureMaterial);
-			std::shared_ptr<BulletBody> btBall = std::make_shared<BulletBody>(btObject, Geometry::createSphereGeometry(5.0f, 5.0f, 0.5f), 1.0f, true, glm::vec3(1.0f, 3.0f, 1.0f), bulletWorld._world);
-			balls.push_back(ball);
+		for (int i = 0; i < _ballCount; i++) {
+			glm::vec3 position(1.0f, 3.0f + 1.0f * i, 1.0f);
+			balls.addInstance(glm::translate(glm::mat4(1.0f), position), 0);
+			std::shared_ptr<BulletBody> btBall = std::make_shared<BulletBody>(btObject, Geometry::createSphereGeometry(5.0f, 5.0f, 0.5f), 1.0f, true, position, bulletWorld._world);
 			bulletBalls.push_back(btBall);
 		}
 		
@@ -289,7 +416,7 @@ int main(int argc, char** argv)
 		_ui = std::make_shared<UserInterface>("userinterface.vert", "userinterface.frag", window_width, window_height, _brightness, _fontpath);
 
 		// Initialize lights and put them into vector
-		// NOTE: to set up number of lights "#define NR_DIR_LIGHTS" and "#define NR_POINT_LIGHTS" in "texture.frag" has to be updated!
+		// NOTE: at most FrameUniforms::MAX_DIR_LIGHTS and MAX_POINT_LIGHTS are used, the array sizes in the shaders have to match them
 		#pragma region directional lights
 
 		//white
@@ -330,8 +457,8 @@ int main(int argc, char** argv)
 		pointLights.push_back(pointL6);
 
 
-		// light cubes
-		std::vector< std::shared_ptr<Geometry>> lightCubes;
+		// light cubes, instances of a unit cube scaled to their size; the material index is the light the cube shows
+		InstancedGeometry lightCubes(Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), {});
 
 		for (int i = 0; i < pointLights.size(); i++) {
 			std::shared_ptr<PointLight> pointL = pointLights[i];
@@ -339,12 +466,47 @@ int main(int argc, char** argv)
 			glm::mat4 trans = glm::mat4(1.0f);
 			trans = glm::translate(trans, pointL->_position);
 			trans = glm::rotate(trans, glm::radians(1.0f * i), glm::vec3(1.0, 1.0, 1.0));
-			std::shared_ptr<Geometry> lightbox = std::make_shared<Geometry>(trans, Geometry::createCubeGeometry(1.0f * i + 0.5f, 1.0f * i + 0.5f, 1.0f * i + 0.5f), lightMaterial);
+			trans = glm::scale(trans, glm::vec3(1.0f * i + 0.5f));
+			lightCubes.addInstance(trans, i);
 
 			BulletBody btLight(btObject, Geometry::createCubeGeometry(1.0f * i + 0.5f, 1.0f * i + 0.5f, 1.0f * i + 0.5f), 0.0f, true, pointL->_position, bulletWorld._world);
-			lightCubes.push_back(lightbox);
 		}
 
+		// the static objects only enable the point lights in range
+		staticBatch.assignPointLights(pointLights);
+
+		// hierarchy over the moving objects, refit every frame; the box instances come first, the balls after them
+		const unsigned int boxCount = boxes.getInstanceCount();
+		auto getDynamicBounds = [&](unsigned int i) {
+			return i < boxCount ? boxes.getBounds(i) : balls.getBounds(i - boxCount);
+		};
+		std::vector<Bounds> dynamicBounds;
+		for (unsigned int i = 0; i < boxCount + balls.getInstanceCount(); i++)
+			dynamicBounds.push_back(getDynamicBounds(i));
+		Bvh dynamicBvh;
+		dynamicBvh.build(dynamicBounds);
+
+		// draws of the moving objects, sorted again every pass
+		RenderQueue renderQueue;
+		std::vector<unsigned int> visibleBoxes, visibleBalls;
+		auto submitDynamic = [&](const std::vector<unsigned int>& visible, unsigned int pass, const glm::mat4& viewProjection, Shader* shader) {
+			visibleBoxes.clear();
+			visibleBalls.clear();
+			for (unsigned int i : visible) {
+				if (i < boxCount) visibleBoxes.push_back(i);
+				else visibleBalls.push_back(i - boxCount);
+			}
+			boxes.submit(renderQueue, pass, viewProjection, visibleBoxes, shader);
+			balls.submit(renderQueue, pass, viewProjection, visibleBalls, shader);
+		};
+
+		CullingSet lightCubeCulling;
+		for (unsigned int i = 0; i < lightCubes.getInstanceCount(); i++)
+			lightCubeCulling.add(lightCubes.getBounds(i));
+		std::vector<unsigned int> visible;
+		std::vector<int> pointLightMasks;
+		CullStats shadowStats, mainStats;
+
 		#pragma endregion
 
 		// Render loop
@@ -360,6 +522,9 @@ int main(int argc, char** argv)
 		double last_mouse_x, last_mouse_y;
 		glfwGetCursorPos(window, &last_mouse_x, &last_mouse_y);
 
+		// texture statistics are printed once, when the textures of the initial load are uploaded
+		bool texturesReported = false;
+
 		// shader configuration
 		quadShader->use();
 		quadShader->setUniform("screenTexture", 0);
@@ -378,6 +543,13 @@ int main(int argc, char** argv)
 			// Poll events
 			glfwPollEvents();
 
+			// upload textures decoded in the background, placeholders are bound until then
+			if (TextureStreamer::instance().update(_textureUploadBudget) > 0 && TextureStreamer::instance().getPendingCount() == 0 && !texturesReported) {
+				std::cout << "textures: " << TextureRegistry::instance().getTextureCount() << " resident, "
+					<< TextureRegistry::instance().getResidentBytes() / (1024 * 1024) << " MB" << std::endl;
+				texturesReported = true;
+			}
+
 			// Update camera
 			poll_keys(window, dt);
 			glfwGetCursorPos(window, &mouse_x, &mouse_y);
@@ -386,68 +558,112 @@ int main(int argc, char** argv)
 			last_mouse_x = mouse_x;
 			last_mouse_y = mouse_y;
 
+			// levels of detail of this frame are chosen for the player's view
+			LodChain::setView(_player.getPosition(), _player.getProjectionMatrix(), float(window_height));
+
+			// load level cells around the player and ahead of it, evict far ones
+			if (levelStreamer) {
+				levelStreamer->update(_player.getPosition(), _player.getVelocity());
+			}
+
+			// move the physics objects, both passes and the culling use the same positions
+			for (unsigned int i = 0; i < balls.getInstanceCount(); i++) {
+				balls.setModelMatrix(i, glm::translate(glm::mat4(1.0f), bulletBalls.at(i)->getPosition()));
+			}
+			boxes.setModelMatrix(0, glm::translate(glm::mat4(1.0f), btBox1.getPosition()));
+			boxes.setModelMatrix(1, glm::translate(glm::mat4(1.0f), btBox2.getPosition()));
+			boxes.setModelMatrix(2, glm::translate(glm::mat4(1.0f), btBox3.getPosition()));
+			for (unsigned int i = 0; i < dynamicBounds.size(); i++) {
+				dynamicBounds[i] = getDynamicBounds(i);
+			}
+			dynamicBvh.refit(dynamicBounds);
+
+			// point lights in range of the moving objects
+			pointLightMasks.assign(dynamicBounds.size(), 0);
+			for (unsigned int light = 0; light < pointLights.size(); light++) {
+				dynamicBvh.querySphere(pointLights[light]->_position, pointLights[light]->getRadius(), visible);
+				for (unsigned int i : visible) {
+					pointLightMasks[i] |= 1 << light;
+				}
+			}
+			for (unsigned int i = 0; i < dynamicBounds.size(); i++) {
+				if (i < boxCount) boxes.setPointLightMask(i, pointLightMasks[i]);
+				else balls.setPointLightMask(i - boxCount, pointLightMasks[i]);
+			}
+
+			// camera and lights for both passes, one buffer write
+			frameUniforms.update(_player.getProjectionViewMatrix(), _player.getPosition(), dirLights.back()._lightSpaceMatrix, _brightness, _lightsOn, dirLights, pointLights);
+
 			// shadowmapping (render depth of scene to texture - is done in dirLight constructor)
-			setPerFrameUniformsDepth(depthShader.get(), dirLights);
+			// only objects inside the view volume of the shadow map can cast into it
+			Frustum shadowFrustum(dirLights.back()._lightSpaceMatrix);
+			CullingSet::resetStats();
 			shadowMapTexture->bind();
 
-			box1.drawShader(depthShader.get());
-			box2.drawShader(depthShader.get());
-			box3.drawShader(depthShader.get());
-			goodGameWall.drawShader(depthShader.get());
-			goodGameScreen.drawShader(depthShader.get());
-			justDoItScreen.drawShader(depthShader.get());
-			justDoItWall.drawShader(depthShader.get());
-			scene.DrawShader(depthShader.get());
-			for (int i = 0; i < balls.size(); i++) {
-				balls.at(i)->drawShader(depthShader.get());
+			renderQueue.clear();
+			dynamicBvh.queryFrustum(shadowFrustum, visible);
+			submitDynamic(visible, RenderQueue::SHADOW_PASS, dirLights.back()._lightSpaceMatrix, depthShader.get());
+			renderQueue.sort();
+			RenderState shadowState(depthShader.get());
+			renderQueue.execute(shadowState);
+			staticBatch.drawShader(depthShader.get(), shadowFrustum);
+			if (levelStreamer) {
+				levelStreamer->DrawShader(depthShader.get(), shadowFrustum);
 			}
 
 			shadowMapTexture->resetViewPort();
+			shadowStats = CullingSet::getStats();
 
 			// shadowmapping (render scene as normal using the generated depth/shadow map)
 			// bloom (start initial framebuffer )
 			blurProcessor.bindInitalFrameBuffer();
 
-			setPerFrameUniformsTexture(textureShader.get(), dirLights, pointLights);
-
-			// render
-			for (int i = 0; i < balls.size(); i++) {
-				balls.at(i)->draw();
-				balls.at(i)->setModelMatrix(glm::translate(glm::mat4(1.0f), bulletBalls.at(i)->getPosition()));
+			Frustum cameraFrustum(_player.getProjectionViewMatrix());
+			CullingSet::resetStats();
+
+			// render, the boxes use their normal maps if enabled
+			renderQueue.clear();
+			dynamicBvh.queryFrustum(cameraFrustum, visible);
+			submitDynamic(visible, RenderQueue::MAIN_PASS, _player.getProjectionViewMatrix(), nullptr);
+			renderQueue.sort();
+			RenderState mainState(nullptr, _normalToggle);
+			renderQueue.execute(mainState);
+
+			// all static objects, the walls use their normal maps if enabled
+			staticBatch.draw(_normalToggle, cameraFrustum);
+			if (levelStreamer) {
+				levelStreamer->Draw(cameraFrustum);
 			}
 
-			// render all objects with normal maps here
-			if (_normalToggle) {
-				textureShader->use();
-				textureShader->setUniform("ifNormal", true);
-			}
-			goodGameWall.draw();	
-			justDoItWall.draw();
-			box1.draw();
-			box1.setModelMatrix(glm::translate(glm::mat4(1.0f), btBox1.getPosition()));
-			box2.draw();
-			box2.setModelMatrix(glm::translate(glm::mat4(1.0f), btBox2.getPosition()));
-			box3.draw();
-			box3.setModelMatrix(glm::translate(glm::mat4(1.0f), btBox3.getPosition()));
-			textureShader->use();
-			textureShader->setUniform("ifNormal", false);
-
-			// all others
-			justDoItScreen.draw();
-			goodGameScreen.draw();
-			scene.Draw();
-
-			// light cubes
-			for (int i = 0; i < pointLights.size(); i++) {
-				setPerFrameUniformsLight(lightShader.get(), pointLights[i]);	
-				lightCubes[i] -> drawShader(lightShader.get());
-			}
+			// light cubes in one draw, their color comes from the light buffer
+			lightCubeCulling.cull(cameraFrustum, visible);
+			renderQueue.clear();
+			lightCubes.submit(renderQueue, RenderQueue::MAIN_PASS, _player.getProjectionViewMatrix(), visible, lightShader.get());
+			renderQueue.sort();
+			RenderState lightState(lightShader.get());
+			renderQueue.execute(lightState);
+			mainStats = CullingSet::getStats();
 
 			double t = glfwGetTime();
 			double dt = t - lastT;
 			if ((int)floor(lastT) != (int)floor(t)) {
 				fps = fpsCounter;
 				fpsCounter = 0;
+
+				if (_printCullStats) {
+					std::cout << "culling: shadow pass " << shadowStats.submitted << " drawn, " << shadowStats.culled << " culled; main pass "
+						<< mainStats.submitted << " drawn, " << mainStats.culled << " culled" << std::endl;
+				}
+
+				if (_printVideoUploads) {
+					for (const std::shared_ptr<Texture>& video : { goodGameTexture, justDoItTexture }) {
+						const PixelUploadStats* stats = video->getUploadStats();
+						if (!stats || stats->uploads == 0) continue;
+						std::cout << "video uploads: " << stats->uploads << ", busy " << stats->busy
+							<< ", copy " << stats->copyMs / stats->uploads << " ms, submit " << stats->submitMs / stats->uploads
+							<< " ms, max " << stats->maxMs << " ms" << std::endl;
+					}
+				}
 			}
 			fpsCounter++;
 
@@ -462,16 +678,23 @@ int main(int argc, char** argv)
 
 			// draw user interface
 			if (_hud) {
+				glEnable(GL_BLEND);
 				_ui->updateUI(fps, _gameLost, _gameWon, _timer - (t - _start), glm::vec3(0, 0, 0));
+				glDisable(GL_BLEND);
 			}
 
 			// bloom (fragments and render to quad) - has to be after all draw calls!
 			blurProcessor.blurFragments(blurShader.get(), bloomResultShader.get());
 
-			// update video texture
+			// update video texture, the frames of a screen are only decoded while it is in view
+			goodGameTexture->setVisible(isSphereVisible(cameraFrustum, glm::vec3(-40.0f, 41.0f, 27.0f), 3.6f));
+			justDoItTexture->setVisible(isSphereVisible(cameraFrustum, glm::vec3(0.0f, 2.5f, -4.0f), 3.0f));
 			goodGameTexture->updateVideo(dt);
 			justDoItTexture->updateVideo(dt);
 
+			// mip levels of mesh textures for the distances of this frame, within the memory budget
+			TextureResidency::instance().update();
+
 			// bullet
 			bulletWorld.stepSimulation(
 				dt, // btScalar timeStep: seconds, not milliseconds, passed since the last call 
@@ -506,54 +729,15 @@ int main(int argc, char** argv)
 	return EXIT_SUCCESS;
 }
 
-void setPerFrameUniformsDepth(Shader* depthShader, std::vector<DirectionalLight> dirLights) {
-
-	depthShader->use();
-	
-	for (int i = 0; i < dirLights.size(); i++) {
-		DirectionalLight& dirL = dirLights[i];
-		depthShader->setUniform("lightSpaceMatrix", dirL._lightSpaceMatrix);
-	}
-}
-
-
-void setPerFrameUniformsLight(Shader* shader, std::shared_ptr<PointLight> pointL)
-{
-	shader->use();
-
-	shader->setUniform("viewProjMatrix", _player.getProjectionViewMatrix());
-	shader->setUniform("camera_world", _player.getPosition());
-	shader->setUniform("brightness", _brightness);
-	shader->setUniform("lightColor", pointL->_color);
-
-}
-
-
-void setPerFrameUniformsTexture(Shader* shader, std::vector<DirectionalLight> dirLights, std::vector<std::shared_ptr<PointLight>> pointLights)
+bool isSphereVisible(const Frustum& frustum, glm::vec3 center, float radius)
 {
-	shader->use();
-	shader->setUniform("viewProjMatrix", _player.getProjectionViewMatrix());
-	shader->setUniform("camera_world", _player.getPosition());
-	shader->setUniform("brightness", _brightness);
-	shader->setUniform("lightsOn", _lightsOn);
-
-	for (int i = 0; i < dirLights.size(); i++) {
-		DirectionalLight& dirL = dirLights[i];
-		shader->setUniform("dirLights[" + std::to_string(i) + "].color", dirL._color);
-		shader->setUniform("dirLights[" + std::to_string(i) + "].direction", dirL._direction);
-		shader->setUniform("lightSpaceMatrix", dirL._lightSpaceMatrix);
-	}
-
-	for (int i = 0; i < pointLights.size(); i++) {
-		std::shared_ptr<PointLight> pointL = pointLights[i];
-		shader->setUniform("pointLights[" + std::to_string(i) + "].color", pointL->_color);
-		shader->setUniform("pointLights[" + std::to_string(i) + "].position", pointL->_position);
-		shader->setUniform("pointLights[" + std::to_string(i) + "].attenuation", pointL->_attenuation);
-	}
-	
+	Bounds bounds;
+	bounds.center = center;
+	bounds.extents = glm::vec3(radius);
+	bounds.radius = radius;
+	return frustum.isVisible(bounds);
 }
 
-
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
 	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
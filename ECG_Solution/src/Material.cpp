@@ -10,12 +10,12 @@
 /* --------------------------------------------- */
 
 Material::Material(std::shared_ptr<Shader> shader, glm::vec3 materialCoefficients, float alpha)
-	: _shader(shader), _materialCoefficients(materialCoefficients), _alpha(alpha)
+	: _shader(shader), _materialCoefficients(materialCoefficients), _alpha(alpha), _transparent(false)
 {
 }
 
 Material::Material(std::shared_ptr<Shader> shader)
-	: _shader(shader)
+	: _shader(shader), _transparent(false)
 {
 }
 
@@ -43,6 +43,16 @@ void Material::bindTexture(GLuint depthMap)
 {
 }
 
+GLuint Material::getTextureHandle() const
+{
+	return 0;
+}
+
+void Material::setTransparent(bool transparent)
+{
+	_transparent = transparent;
+}
+
 /* --------------------------------------------- */
 // Texture material
 /* --------------------------------------------- */
@@ -61,6 +71,11 @@ TextureMaterial::~TextureMaterial()
 {
 }
 
+GLuint TextureMaterial::getTextureHandle() const
+{
+	return _diffuseTexture ? _diffuseTexture->getHandle() : 0;
+}
+
 void TextureMaterial::setUniforms()
 {
 	Material::setUniforms();
@@ -68,6 +83,8 @@ void TextureMaterial::setUniforms()
 	_diffuseTexture->bind(0);
 	_shader->setUniform("diffuseTexture", 0);
 	_shader->setUniform("shadowTexture", 1);
+	_shader->setUniform("videoLayer", _diffuseTexture->getVideoLayer());
+	setAtlasUniforms();
 
 }
 
@@ -79,5 +96,21 @@ void TextureMaterial::setNormalUniforms()
 	_shader->setUniform("diffuseTexture", 0);
 	_shader->setUniform("shadowTexture", 1);
 	_shader->setUniform("normalTexture", 2);
+	_shader->setUniform("videoLayer", _diffuseTexture->getVideoLayer());
+	setAtlasUniforms();
+}
+
+void TextureMaterial::setAtlasUniforms()
+{
+	// the normal map region is set too, it is only read while ifNormal is on
+	const AtlasRegion& region = _diffuseTexture->getAtlasRegion();
+	_shader->setUniform("atlasLayer", region.layer);
+	_shader->setUniform("atlasRect", region.rect);
+	_shader->setUniform("atlasMaxLod", region.maxLod);
+
+	const AtlasRegion& normalRegion = _diffuseTexture->getAtlasNormalRegion();
+	_shader->setUniform("atlasNormalLayer", normalRegion.layer);
+	_shader->setUniform("atlasNormalRect", normalRegion.rect);
+	_shader->setUniform("atlasNormalMaxLod", normalRegion.maxLod);
 
 }
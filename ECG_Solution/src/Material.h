@@ -32,6 +32,11 @@ protected:
 	 */
 	float _alpha;
 
+	/*!
+	 * If the material is blended with what is behind it
+	 */
+	bool _transparent;
+
 public:
 	/*!
 	 * Base material constructor
@@ -58,6 +63,18 @@ public:
 	virtual void bindTexture(GLuint depthMap);
 
 	void setShader(std::shared_ptr<Shader> shader);
+
+	/*!
+	 * @return handle of the main texture, for sorting draws; 0 if there is none
+	 */
+	virtual GLuint getTextureHandle() const;
+
+	/*!
+	 * @param transparent: if the material is drawn blended, after all opaque draws
+	 */
+	void setTransparent(bool transparent);
+
+	bool isTransparent() const { return _transparent; }
 };
 
 
@@ -77,6 +94,11 @@ protected:
 	 */
 	std::shared_ptr<Texture> _shadowTexture;
 
+	/*!
+	 * Sets layer and rect of the diffuse and normal map if they are packed into an atlas
+	 */
+	void setAtlasUniforms();
+
 public:
 	/*!
 	 * Texture material constructor
@@ -97,4 +119,6 @@ public:
 	virtual void setUniforms();
 
 	virtual void setNormalUniforms();
+
+	virtual GLuint getTextureHandle() const;
 };
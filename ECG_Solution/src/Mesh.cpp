@@ -1,20 +1,76 @@
 
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "textures/TextureRegistry.h"
+#include "textures/TextureResidency.h"
 
 
 
 //constructor
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshTexture> textures, aiMatrix4x4 transformationMatrix, aiMesh* aiMesh)
-    : _vertices(vertices), _indices(indices), _textures(textures), _transformationMatrix(transformationMatrix), _aiMesh(aiMesh)
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshTexture> textures, aiMatrix4x4 transformationMatrix, string name, std::vector<LodIndices> lods)
+    : _vertices(vertices), _indices(indices), _textures(textures), _transformationMatrix(transformationMatrix), _name(name), _lods(lods)
 {
     //set vertex buffers and attribute pointers with setupMesh()
     setupMesh();
 }
 
-Mesh::Mesh(){}
+//uploads a cooked mesh straight from the mapped cache file
+Mesh::Mesh(const MeshCacheView& view, std::vector<MeshTexture> textures, bool keepCpuData)
+    : _textures(textures), _transformationMatrix(view.transformationMatrix), _name(view.name)
+{
+    //the levels follow the full detail indices in the file, so their ranges are relative to the mesh
+    std::vector<LodRange> lods;
+    size_t indexCount = view.indexCount;
+    for (const MeshCacheLodView& lod : view.lods)
+    {
+        lods.push_back({ (unsigned int)(lod.indices - view.indices), lod.indexCount, lod.error });
+        indexCount += lod.indexCount;
+    }
+
+    _bounds = Bounds::compute(&view.vertices[0].Position, view.vertexCount, sizeof(Vertex));
+    _uvDensity = TextureResidency::computeUvDensity(&view.vertices[0].Position, sizeof(Vertex), &view.vertices[0].TexCoords, sizeof(Vertex), view.indices, view.indexCount);
+    _lodChain.build(view.indexCount, lods, &view.vertices[0].Position, view.vertexCount, sizeof(Vertex));
+    upload(view.vertices, view.vertexCount, view.indices, indexCount);
+
+    if (keepCpuData)
+    {
+        _vertices.assign(view.vertices, view.vertices + view.vertexCount);
+        _indices.assign(view.indices, view.indices + view.indexCount);
+        for (const MeshCacheLodView& lodView : view.lods)
+        {
+            LodIndices lod;
+            lod.indices.assign(lodView.indices, lodView.indices + lodView.indexCount);
+            lod.error = lodView.error;
+            _lods.push_back(lod);
+        }
+    }
+}
+
+Mesh::Mesh() : _uvDensity(0.0f) {}
 
 //render mesh
 void Mesh::Draw(Shader* shader)
+{
+    drawRange(shader, _lodChain.getRange(0));
+}
+
+//render mesh with the level of detail for its size on screen
+void Mesh::Draw(Shader* shader, const glm::mat4& modelMatrix, bool requestTextures)
+{
+    const LodRange& range = _lodChain.select(modelMatrix);
+
+    if (requestTextures)
+    {
+        float pixelsPerUnit = _lodChain.getPixelsPerUnit(modelMatrix);
+        for (const MeshTexture& texture : _textures)
+            TextureResidency::instance().request(texture.id, pixelsPerUnit, _uvDensity);
+    }
+
+    drawRange(shader, range);
+}
+
+//binds the textures and draws one level
+void Mesh::drawRange(Shader* shader, const LodRange& range)
 {
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
@@ -30,21 +86,87 @@ void Mesh::Draw(Shader* shader)
             number = std::to_string(specularNr++);
         //shader.setUniform
         shader->setUniform(("material." + name + number).c_str(), i);
-        glBindTexture(GL_TEXTURE_2D, _textures[i].id);
+        glBindTexture(GL_TEXTURE_2D, TextureRegistry::instance().resolve(_textures[i].id));
     }
     glActiveTexture(GL_TEXTURE0);
+    _packedVertices.setUniforms(shader);
 
     // draw mesh
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, 0);
+    unsigned int indexSize = _indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    glDrawElements(GL_TRIANGLES, range.indexCount, _indexType, (void*)(size_t(range.firstIndex) * indexSize));
     glBindVertexArray(0);
 
 }
 
 
+//frees the cpu copies, the gpu buffers stay
+size_t Mesh::releaseCpuData()
+{
+    size_t bytes = _vertices.capacity() * sizeof(Vertex) + _indices.capacity() * sizeof(unsigned int);
+    for (const LodIndices& lod : _lods)
+        bytes += lod.indices.capacity() * sizeof(unsigned int);
+
+    std::vector<Vertex>().swap(_vertices);
+    std::vector<unsigned int>().swap(_indices);
+    std::vector<LodIndices>().swap(_lods);
+    return bytes;
+}
+
+CollisionMesh CollisionMesh::create(const MeshData& data)
+{
+    CollisionMesh collision;
+    collision.name = data.name;
+    collision.transformationMatrix = data.transformationMatrix;
+    collision.indices = data.indices;
+    collision.positions.reserve(data.vertices.size());
+    for (const Vertex& vertex : data.vertices)
+        collision.positions.push_back(vertex.Position);
+    return collision;
+}
+
+CollisionMesh CollisionMesh::create(const MeshCacheView& view)
+{
+    CollisionMesh collision;
+    collision.name = view.name;
+    collision.transformationMatrix = view.transformationMatrix;
+    collision.indices.assign(view.indices, view.indices + view.indexCount);
+    collision.positions.reserve(view.vertexCount);
+    for (uint32_t i = 0; i < view.vertexCount; i++)
+        collision.positions.push_back(view.vertices[i].Position);
+    return collision;
+}
+
+size_t CollisionMesh::getBytes() const
+{
+    return positions.capacity() * sizeof(glm::vec3) + indices.capacity() * sizeof(unsigned int) + name.capacity();
+}
+
+//deletes the gpu buffers
+void Mesh::releaseBuffers()
+{
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+    VBO = EBO = VAO = 0;
+}
+
+
 //set vertex buffers and attribute pointers
 void Mesh::setupMesh() {
 
+    //the levels of detail follow the full detail indices in the same buffer
+    std::vector<unsigned int> indices = _indices;
+    _bounds = Bounds::compute(&_vertices[0].Position, _vertices.size(), sizeof(Vertex));
+    _uvDensity = TextureResidency::computeUvDensity(&_vertices[0].Position, sizeof(Vertex), &_vertices[0].TexCoords, sizeof(Vertex), _indices);
+    _lodChain.build(indices, _lods, &_vertices[0].Position, _vertices.size(), sizeof(Vertex));
+
+    upload(&_vertices[0], _vertices.size(), indices.data(), indices.size());
+}
+
+//creates the buffers, data that already has the gpu layout is passed to glBufferData as it is
+void Mesh::upload(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
     //initialise buffers and array
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -54,21 +176,42 @@ void Mesh::setupMesh() {
     // load data into vertex buffers
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), &_vertices[0], GL_STATIC_DRAW);
+    const VertexFormat& format = VertexFormat::getDefault();
+    if (format.isFloat())
+    {
+        //float vertices have the layout of Vertex
+        _packedVertices = QuantizedVertices();
+        _packedVertices.format = format;
+        _packedVertices.stride = sizeof(Vertex);
+        _packedVertices.count = (unsigned int)vertexCount;
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+    }
+    else
+    {
+        //quantize the vertices into the configured layout
+        _packedVertices = QuantizedVertices::pack(format, vertexCount,
+            &vertices[0].Position, sizeof(Vertex),
+            &vertices[0].Normal, sizeof(Vertex),
+            &vertices[0].TexCoords, sizeof(Vertex));
+        glBufferData(GL_ARRAY_BUFFER, _packedVertices.data.size(), _packedVertices.data.data(), GL_STATIC_DRAW);
+        std::vector<unsigned char>().swap(_packedVertices.data);
+    }
 
+    //16-bit indices whenever the vertex count allows it, 32-bit indices are uploaded as they are
+    _indexType = PackedIndices::chooseType(vertexCount);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(unsigned int), &_indices[0], GL_STATIC_DRAW);
+    if (_indexType == GL_UNSIGNED_INT)
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+    }
+    else
+    {
+        PackedIndices packedIndices = PackedIndices::pack(indices, indexCount, vertexCount);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIndices.data.size(), packedIndices.data.data(), GL_STATIC_DRAW);
+    }
 
     // set the vertex attribute pointers
-    // vertex Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    _packedVertices.setAttributes();
 
     glBindVertexArray(0);
 }
@@ -7,8 +7,13 @@
 #include <assimp/scene.h>
 
 #include "Shader.h"
+#include "VertexFormat.h"
+#include "LodChain.h"
+#include "Culling.h"
 
 
+struct MeshCacheView;
+
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
@@ -21,26 +26,94 @@ struct MeshTexture {
     string path;
 };
 
+//texture reference of a mesh before the texture is loaded
+struct MeshTextureRef {
+    string type;
+    string path;
+};
+
+//cpu-side mesh data, filled either by assimp or from the mesh cache
+struct MeshData {
+    string name;
+    aiMatrix4x4 transformationMatrix;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<MeshTextureRef> textures;
+    //simplified levels of detail, indexing the same vertices
+    std::vector<LodIndices> lods;
+};
+
+//owned collision source of a mesh, kept only until the physics bodies are built
+//positions only, so it is less than half the size of the vertices
+struct CollisionMesh {
+    string name;
+    aiMatrix4x4 transformationMatrix;
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+
+    //copies the positions and the full detail triangles of mesh data
+    static CollisionMesh create(const MeshData& data);
+
+    //same for a cooked mesh in a mapped cache file
+    static CollisionMesh create(const MeshCacheView& view);
+
+    //cpu memory of the record in bytes
+    size_t getBytes() const;
+};
+
 class Mesh {
 
 public:
 
-    //mesh data
+    //mesh data, the cpu copies are empty after releaseCpuData()
     std::vector<Vertex> _vertices;
     std::vector<unsigned int> _indices;
     std::vector<MeshTexture> _textures;
     unsigned int VAO;
     aiMatrix4x4 _transformationMatrix;
-    aiMesh* _aiMesh;
+    string _name;
+
+    //layout and decode constants of the vertex buffer, the packed data is freed after the upload
+    QuantizedVertices _packedVertices;
+
+    //GL_UNSIGNED_SHORT for meshes with up to 65536 vertices, GL_UNSIGNED_INT otherwise
+    GLenum _indexType;
+
+    //simplified levels, their indices follow _indices in the element buffer
+    std::vector<LodIndices> _lods;
+    LodChain _lodChain;
+
+    //uv units per object space unit, decides which mip levels of the textures stay resident
+    float _uvDensity;
+
+    //bounds of the vertices in object space, kept after the cpu copies are released
+    Bounds _bounds;
 
     //constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshTexture> textures, aiMatrix4x4 transformationMatrix, aiMesh* aiMesh);
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshTexture> textures, aiMatrix4x4 transformationMatrix, string name, std::vector<LodIndices> lods = std::vector<LodIndices>());
+
+    //uploads a cooked mesh straight from the mapped cache file
+    //the cpu copies are only filled with keepCpuData, e.g. for adding the mesh to a batch
+    Mesh(const MeshCacheView& view, std::vector<MeshTexture> textures, bool keepCpuData);
 
     Mesh();
 
-    //render mesh
+    //render mesh at full detail
     void Draw(Shader* shader);
 
+    //render mesh with the level of detail chosen for the model matrix
+    //and report the mip levels its textures need to the texture residency if requestTextures is set,
+    //depth only passes leave it off so geometry seen only by shadows does not keep its textures resident
+    void Draw(Shader* shader, const glm::mat4& modelMatrix, bool requestTextures);
+
+    //deletes the gpu buffers, e.g. after the mesh was merged into a static batch
+    void releaseBuffers();
+
+    //frees the cpu copies of vertices, indices and levels once they are uploaded and batched
+    //drawing is not affected, the mesh just can't be added to a batch afterwards
+    //@return freed bytes
+    size_t releaseCpuData();
+
 private:
 
     //vertex and element buffer
@@ -49,4 +122,10 @@ private:
     //set vertex buffers and attribute pointers
     void setupMesh();
 
+    //creates the buffers from the vertices and the indices of all levels back to back
+    void upload(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+
+    //binds the textures and draws one level
+    void drawRange(Shader* shader, const LodRange& range);
+
 };
\ No newline at end of file
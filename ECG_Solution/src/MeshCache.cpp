@@ -0,0 +1,380 @@
+#include "MeshCache.h"
+
+#include <fstream>
+#include <sys/stat.h>
+
+static_assert(sizeof(Vertex) == 32, "cooked mesh layout expects a tightly packed Vertex");
+
+//pads the stream position to the next 16 byte boundary
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + 15) & ~uint64_t(15);
+}
+
+//modification time of a file, 0 if it does not exist
+static long long fileTime(const string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return 0;
+    return (long long)info.st_mtime;
+}
+
+MeshCache::MeshCache()
+    : _file(INVALID_HANDLE_VALUE), _mapping(NULL), _data(nullptr), _size(0)
+{
+}
+
+MeshCache::~MeshCache()
+{
+    close();
+}
+
+string MeshCache::cachePath(const string& sourcePath)
+{
+    return sourcePath + ".mesh";
+}
+
+bool MeshCache::isUpToDate(const string& sourcePath)
+{
+    return isUpToDate(sourcePath, cachePath(sourcePath));
+}
+
+bool MeshCache::isUpToDate(const string& sourcePath, const string& cachePath)
+{
+    long long cacheTime = fileTime(cachePath);
+    return cacheTime != 0 && cacheTime >= fileTime(sourcePath);
+}
+
+bool MeshCache::write(const string& cachePath, const std::vector<MeshData>& meshes, uint32_t flags)
+{
+    std::vector<MeshCacheRecord> records;
+    std::vector<MeshCacheTextureRecord> textureRecords;
+    std::vector<MeshCacheLodRecord> lodRecords;
+    string strings;
+    uint32_t vertexCount = 0, indexCount = 0;
+
+    //collect tables, all ranges are relative to the data blocks
+    for (const MeshData& mesh : meshes)
+    {
+        MeshCacheRecord record;
+        for (unsigned int row = 0; row < 4; row++)
+            for (unsigned int col = 0; col < 4; col++)
+                record.transformationMatrix[row * 4 + col] = mesh.transformationMatrix[row][col];
+
+        record.nameOffset = (uint32_t)strings.size();
+        record.nameLength = (uint32_t)mesh.name.size();
+        strings += mesh.name;
+
+        record.firstVertex = vertexCount;
+        record.vertexCount = (uint32_t)mesh.vertices.size();
+        record.firstIndex = indexCount;
+        record.indexCount = (uint32_t)mesh.indices.size();
+        record.firstTexture = (uint32_t)textureRecords.size();
+        record.textureCount = (uint32_t)mesh.textures.size();
+
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        if (!mesh.vertices.empty())
+            boundsMin = boundsMax = mesh.vertices[0].Position;
+        for (const Vertex& vertex : mesh.vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+        for (unsigned int axis = 0; axis < 3; axis++)
+        {
+            record.boundsMin[axis] = boundsMin[axis];
+            record.boundsMax[axis] = boundsMax[axis];
+        }
+
+        for (const MeshTextureRef& texture : mesh.textures)
+        {
+            MeshCacheTextureRecord textureRecord;
+            textureRecord.typeOffset = (uint32_t)strings.size();
+            textureRecord.typeLength = (uint32_t)texture.type.size();
+            strings += texture.type;
+            textureRecord.pathOffset = (uint32_t)strings.size();
+            textureRecord.pathLength = (uint32_t)texture.path.size();
+            strings += texture.path;
+            textureRecords.push_back(textureRecord);
+        }
+
+        vertexCount += record.vertexCount;
+        indexCount += record.indexCount;
+
+        //the levels of detail follow the full detail indices, so the whole element buffer is one range
+        record.firstLod = (uint32_t)lodRecords.size();
+        record.lodCount = (uint32_t)mesh.lods.size();
+        for (const LodIndices& lod : mesh.lods)
+        {
+            MeshCacheLodRecord lodRecord = {};
+            lodRecord.firstIndex = indexCount;
+            lodRecord.indexCount = (uint32_t)lod.indices.size();
+            lodRecord.error = lod.error;
+            lodRecords.push_back(lodRecord);
+            indexCount += lodRecord.indexCount;
+        }
+
+        records.push_back(record);
+    }
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = (uint32_t)records.size();
+    header.textureCount = (uint32_t)textureRecords.size();
+    header.lodCount = (uint32_t)lodRecords.size();
+    header.flags = flags;
+    header.meshTableOffset = sizeof(MeshCacheHeader);
+    header.textureTableOffset = header.meshTableOffset + records.size() * sizeof(MeshCacheRecord);
+    header.lodTableOffset = header.textureTableOffset + textureRecords.size() * sizeof(MeshCacheTextureRecord);
+    header.stringTableOffset = header.lodTableOffset + lodRecords.size() * sizeof(MeshCacheLodRecord);
+    header.vertexDataOffset = alignOffset(header.stringTableOffset + strings.size());
+    header.indexDataOffset = alignOffset(header.vertexDataOffset + uint64_t(vertexCount) * sizeof(Vertex));
+    header.fileSize = header.indexDataOffset + uint64_t(indexCount) * sizeof(unsigned int);
+
+    //write to a temporary file first, so a crash never leaves a half written cache behind
+    string tempPath = cachePath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    const char padding[16] = {};
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)records.data(), records.size() * sizeof(MeshCacheRecord));
+    file.write((const char*)textureRecords.data(), textureRecords.size() * sizeof(MeshCacheTextureRecord));
+    file.write((const char*)lodRecords.data(), lodRecords.size() * sizeof(MeshCacheLodRecord));
+    file.write(strings.data(), strings.size());
+    file.write(padding, header.vertexDataOffset - (header.stringTableOffset + strings.size()));
+    for (const MeshData& mesh : meshes)
+        file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    file.write(padding, header.indexDataOffset - (header.vertexDataOffset + uint64_t(vertexCount) * sizeof(Vertex)));
+    for (const MeshData& mesh : meshes)
+    {
+        file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        for (const LodIndices& lod : mesh.lods)
+            file.write((const char*)lod.indices.data(), lod.indices.size() * sizeof(unsigned int));
+    }
+    file.close();
+
+    if (!file)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(cachePath.c_str());
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+bool MeshCache::open(const string& cachePath)
+{
+    close();
+
+    _file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart < (LONGLONG)sizeof(MeshCacheHeader))
+    {
+        close();
+        return false;
+    }
+    _size = (uint64_t)size.QuadPart;
+
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping == NULL)
+    {
+        close();
+        return false;
+    }
+
+    _data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (_data == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    //reject files written by another version or truncated files
+    const MeshCacheHeader* h = header();
+    if (h->magic != MESH_CACHE_MAGIC || h->version != MESH_CACHE_VERSION || h->vertexSize != sizeof(Vertex) || h->fileSize != _size || !validate())
+    {
+        std::cout << "ERROR::MESHCACHE::invalid cache file " << cachePath << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+//true if [offset, offset + count * size) lies inside a block of the given size
+static bool inRange(uint64_t offset, uint64_t count, uint64_t size, uint64_t blockSize)
+{
+    return offset <= blockSize && count <= (blockSize - offset) / size;
+}
+
+bool MeshCache::validate() const
+{
+    const MeshCacheHeader* h = header();
+
+    //the blocks are in file order, the data blocks are aligned for reading them in place
+    if (h->meshTableOffset < sizeof(MeshCacheHeader) || h->textureTableOffset < h->meshTableOffset || h->lodTableOffset < h->textureTableOffset
+        || h->stringTableOffset < h->lodTableOffset || h->vertexDataOffset < h->stringTableOffset || h->indexDataOffset < h->vertexDataOffset
+        || h->indexDataOffset > _size || h->meshTableOffset % 4 != 0 || h->vertexDataOffset % 16 != 0 || h->indexDataOffset % 16 != 0)
+        return false;
+
+    if (!inRange(h->meshTableOffset, h->meshCount, sizeof(MeshCacheRecord), h->textureTableOffset)
+        || !inRange(h->textureTableOffset, h->textureCount, sizeof(MeshCacheTextureRecord), h->lodTableOffset)
+        || !inRange(h->lodTableOffset, h->lodCount, sizeof(MeshCacheLodRecord), h->stringTableOffset))
+        return false;
+
+    uint64_t stringBytes = h->vertexDataOffset - h->stringTableOffset;
+    uint64_t vertexCount = (h->indexDataOffset - h->vertexDataOffset) / sizeof(Vertex);
+    uint64_t indexCount = (_size - h->indexDataOffset) / sizeof(unsigned int);
+
+    const MeshCacheRecord* records = (const MeshCacheRecord*)(_data + h->meshTableOffset);
+    const MeshCacheTextureRecord* textureRecords = (const MeshCacheTextureRecord*)(_data + h->textureTableOffset);
+    const MeshCacheLodRecord* lodRecords = (const MeshCacheLodRecord*)(_data + h->lodTableOffset);
+
+    for (uint32_t i = 0; i < h->meshCount; i++)
+    {
+        const MeshCacheRecord& record = records[i];
+        if (!inRange(record.nameOffset, record.nameLength, 1, stringBytes)
+            || !inRange(record.firstVertex, record.vertexCount, 1, vertexCount)
+            || !inRange(record.firstIndex, record.indexCount, 1, indexCount)
+            || !inRange(record.firstTexture, record.textureCount, 1, h->textureCount)
+            || !inRange(record.firstLod, record.lodCount, 1, h->lodCount))
+            return false;
+
+        for (uint32_t t = 0; t < record.textureCount; t++)
+        {
+            const MeshCacheTextureRecord& texture = textureRecords[record.firstTexture + t];
+            if (!inRange(texture.typeOffset, texture.typeLength, 1, stringBytes) || !inRange(texture.pathOffset, texture.pathLength, 1, stringBytes))
+                return false;
+        }
+
+        //every level starts where the previous one ends, the mesh is uploaded as one range
+        uint64_t end = uint64_t(record.firstIndex) + record.indexCount;
+        for (uint32_t l = 0; l < record.lodCount; l++)
+        {
+            const MeshCacheLodRecord& lod = lodRecords[record.firstLod + l];
+            if (lod.firstIndex != end || !inRange(lod.firstIndex, lod.indexCount, 1, indexCount))
+                return false;
+            end += lod.indexCount;
+        }
+
+        //the indices of the mesh and of all its levels are local to the mesh and must stay inside its vertices,
+        //the collision shape, the uv density and the draws read the vertices through them
+        const unsigned int* indices = (const unsigned int*)(_data + h->indexDataOffset);
+        for (uint64_t j = record.firstIndex; j < end; j++)
+            if (indices[j] >= record.vertexCount)
+                return false;
+    }
+
+    return true;
+}
+
+void MeshCache::close()
+{
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+    if (_mapping != NULL)
+        CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+
+    _data = nullptr;
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+    _size = 0;
+}
+
+bool MeshCache::isOpen() const
+{
+    return _data != nullptr;
+}
+
+const MeshCacheHeader* MeshCache::header() const
+{
+    return (const MeshCacheHeader*)_data;
+}
+
+string MeshCache::readString(uint32_t offset, uint32_t length) const
+{
+    return string((const char*)_data + header()->stringTableOffset + offset, length);
+}
+
+unsigned int MeshCache::getMeshCount() const
+{
+    return isOpen() ? header()->meshCount : 0;
+}
+
+uint32_t MeshCache::getFlags() const
+{
+    return isOpen() ? header()->flags : 0;
+}
+
+MeshCacheView MeshCache::getMesh(unsigned int index) const
+{
+    const MeshCacheHeader* h = header();
+    const MeshCacheRecord& record = ((const MeshCacheRecord*)(_data + h->meshTableOffset))[index];
+    const MeshCacheTextureRecord* textureRecords = (const MeshCacheTextureRecord*)(_data + h->textureTableOffset);
+    const MeshCacheLodRecord* lodRecords = (const MeshCacheLodRecord*)(_data + h->lodTableOffset);
+
+    MeshCacheView view;
+    view.name = readString(record.nameOffset, record.nameLength);
+    for (unsigned int row = 0; row < 4; row++)
+        for (unsigned int col = 0; col < 4; col++)
+            view.transformationMatrix[row][col] = record.transformationMatrix[row * 4 + col];
+
+    view.vertices = (const Vertex*)(_data + h->vertexDataOffset) + record.firstVertex;
+    view.vertexCount = record.vertexCount;
+    view.indices = (const unsigned int*)(_data + h->indexDataOffset) + record.firstIndex;
+    view.indexCount = record.indexCount;
+    view.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+    view.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+
+    for (unsigned int i = 0; i < record.textureCount; i++)
+    {
+        const MeshCacheTextureRecord& textureRecord = textureRecords[record.firstTexture + i];
+        MeshTextureRef texture;
+        texture.type = readString(textureRecord.typeOffset, textureRecord.typeLength);
+        texture.path = readString(textureRecord.pathOffset, textureRecord.pathLength);
+        view.textures.push_back(texture);
+    }
+
+    for (unsigned int i = 0; i < record.lodCount; i++)
+    {
+        const MeshCacheLodRecord& lodRecord = lodRecords[record.firstLod + i];
+        MeshCacheLodView lod;
+        lod.indices = (const unsigned int*)(_data + h->indexDataOffset) + lodRecord.firstIndex;
+        lod.indexCount = lodRecord.indexCount;
+        lod.error = lodRecord.error;
+        view.lods.push_back(lod);
+    }
+
+    return view;
+}
+
+MeshData MeshCache::getMeshData(unsigned int index) const
+{
+    MeshCacheView view = getMesh(index);
+
+    MeshData data;
+    data.name = view.name;
+    data.transformationMatrix = view.transformationMatrix;
+    data.vertices.assign(view.vertices, view.vertices + view.vertexCount);
+    data.indices.assign(view.indices, view.indices + view.indexCount);
+    data.textures = view.textures;
+    for (const MeshCacheLodView& lodView : view.lods)
+    {
+        LodIndices lod;
+        lod.indices.assign(lodView.indices, lodView.indices + lodView.indexCount);
+        lod.error = lodView.error;
+        data.lods.push_back(lod);
+    }
+    return data;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Mesh.h"
+#include "Utils.h"
+
+/*
+ * Cooked binary mesh format
+ *
+ * [MeshCacheHeader]
+ * [MeshCacheRecord x meshCount]
+ * [MeshCacheTextureRecord x textureCount]
+ * [MeshCacheLodRecord x lodCount]
+ * [string table]
+ * [vertex data, interleaved Vertex, 16 byte aligned]
+ * [index data, unsigned int, 16 byte aligned, per mesh the full detail indices directly followed by its levels of detail]
+ *
+ * All offsets are absolute file offsets, so a mapped file can be read in place
+ * and the vertex/index ranges can be passed to glBufferData directly.
+ * open() checks every table and range against the file size, so a damaged file is
+ * rejected and reimported instead of being read out of bounds.
+ */
+
+#define MESH_CACHE_MAGIC   0x4D41494C // "LIAM"
+#define MESH_CACHE_VERSION 6
+
+//header flags
+#define MESH_CACHE_SPLIT   0x1 // meshes with more than 65536 vertices were split for 16-bit indices
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t lodCount;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t meshTableOffset;
+    uint64_t textureTableOffset;
+    uint64_t lodTableOffset;
+    uint64_t stringTableOffset;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    uint64_t fileSize;
+};
+
+struct MeshCacheRecord {
+    float transformationMatrix[16]; // row major, same as aiMatrix4x4
+    uint32_t nameOffset, nameLength;
+    uint32_t firstVertex, vertexCount;
+    uint32_t firstIndex, indexCount;
+    uint32_t firstTexture, textureCount;
+    uint32_t firstLod, lodCount;
+    float boundsMin[3], boundsMax[3]; // vertex bounds in mesh space
+};
+
+struct MeshCacheTextureRecord {
+    uint32_t typeOffset, typeLength;
+    uint32_t pathOffset, pathLength;
+};
+
+struct MeshCacheLodRecord {
+    uint32_t firstIndex, indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+//one level of detail of a cooked mesh, points into the mapped file
+struct MeshCacheLodView {
+    const unsigned int* indices;
+    uint32_t indexCount;
+    float error;
+};
+
+//read-only view on one cooked mesh, points into the mapped file
+struct MeshCacheView {
+    string name;
+    aiMatrix4x4 transformationMatrix;
+    const Vertex* vertices;
+    uint32_t vertexCount;
+    const unsigned int* indices;
+    uint32_t indexCount;
+    std::vector<MeshTextureRef> textures;
+    std::vector<MeshCacheLodView> lods;
+    glm::vec3 boundsMin, boundsMax;
+};
+
+class MeshCache {
+
+private:
+
+    //mapping of the cache file
+    HANDLE _file;
+    HANDLE _mapping;
+    const unsigned char* _data;
+    uint64_t _size;
+
+    const MeshCacheHeader* header() const;
+
+    string readString(uint32_t offset, uint32_t length) const;
+
+    //true if all tables and the ranges of all records lie inside the mapped file
+    bool validate() const;
+
+public:
+
+    MeshCache();
+    ~MeshCache();
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    //path of the cooked file belonging to a source model
+    static string cachePath(const string& sourcePath);
+
+    //true if a cooked file exists and is at least as new as the source model
+    static bool isUpToDate(const string& sourcePath);
+
+    //true if the cooked file exists and is at least as new as the source file
+    static bool isUpToDate(const string& sourcePath, const string& cachePath);
+
+    //writes all meshes into a cooked file, returns false on io errors
+    static bool write(const string& cachePath, const std::vector<MeshData>& meshes, uint32_t flags = 0);
+
+    //maps a cooked file and validates its header and all record ranges
+    bool open(const string& cachePath);
+
+    void close();
+
+    bool isOpen() const;
+
+    unsigned int getMeshCount() const;
+
+    //MESH_CACHE_* flags the file was written with
+    uint32_t getFlags() const;
+
+    MeshCacheView getMesh(unsigned int index) const;
+
+    //copies a cooked mesh into owned cpu-side data, for processing it further on the cpu
+    //meshes that are only drawn are uploaded from the view, see Mesh(const MeshCacheView&, ...)
+    MeshData getMeshData(unsigned int index) const;
+};
@@ -0,0 +1,843 @@
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+
+//parameters of Forsyth's scoring function
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float FORSYTH_CACHE_DECAY = 1.5f;
+static const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+static const float FORSYTH_VALENCE_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_POWER = 0.5f;
+
+//symmetric 4x4 error quadric, sum of the squared distances to a set of weighted planes
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    //plane dot(normal, p) + distance = 0
+    void addPlane(const glm::dvec3& normal, double distance, double planeWeight)
+    {
+        a00 += planeWeight * normal.x * normal.x;
+        a01 += planeWeight * normal.x * normal.y;
+        a02 += planeWeight * normal.x * normal.z;
+        a11 += planeWeight * normal.y * normal.y;
+        a12 += planeWeight * normal.y * normal.z;
+        a22 += planeWeight * normal.z * normal.z;
+        b0 += planeWeight * normal.x * distance;
+        b1 += planeWeight * normal.y * distance;
+        b2 += planeWeight * normal.z * distance;
+        c += planeWeight * distance * distance;
+        weight += planeWeight;
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02;
+        a11 += other.a11; a12 += other.a12; a22 += other.a22;
+        b0 += other.b0; b1 += other.b1; b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+        return *this;
+    }
+
+    //weighted mean of the squared distances of a point to the planes
+    double evaluate(const glm::dvec3& p) const
+    {
+        double error = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+            + 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+            + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+    }
+};
+
+//edge collapse candidate, the vertex "from" moves onto the vertex "to"
+struct EdgeCollapse {
+    unsigned int from, to;
+    double cost;
+};
+
+//a collapse flips a triangle if its normal turns by more than this (cosine)
+static const double SIMPLIFY_MIN_NORMAL_DOT = 0.25;
+
+//simplification gives up after this many passes over the edges
+static const unsigned int SIMPLIFY_MAX_PASSES = 100;
+
+//meshes are not simplified below this many triangles
+static const size_t LOD_MIN_TRIANGLES = 8;
+
+//hash and equality on the raw bytes of a vertex, for welding
+struct VertexBytesHash {
+    size_t operator()(const Vertex& vertex) const
+    {
+        const unsigned char* bytes = (const unsigned char*)&vertex;
+        size_t hash = 2166136261u;
+        for (size_t i = 0; i < sizeof(Vertex); i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+};
+
+struct VertexBytesEqual {
+    bool operator()(const Vertex& a, const Vertex& b) const
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+static float forsythVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    //no triangles left, the vertex does not matter anymore
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        //the last triangle's vertices get a fixed score so the order within a triangle does not matter
+        if (cachePosition < 3)
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        else
+            score = std::pow(1.0f - float(cachePosition - 3) / float(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY);
+    }
+
+    //boost vertices with few triangles left, so they are finished and do not become isolated
+    score += FORSYTH_VALENCE_SCALE * std::pow(float(remainingTriangles), -FORSYTH_VALENCE_POWER);
+    return score;
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other)
+{
+    triangles += other.triangles;
+    vertices += other.vertices;
+    transformed += other.transformed;
+    return *this;
+}
+
+MeshOptimizerReport& MeshOptimizerReport::operator+=(const MeshOptimizerReport& other)
+{
+    before += other.before;
+    after += other.after;
+    return *this;
+}
+
+void MeshOptimizer::weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::unordered_map<Vertex, unsigned int, VertexBytesHash, VertexBytesEqual> unique;
+    unique.reserve(vertices.size());
+
+    std::vector<Vertex> welded;
+    std::vector<unsigned int> remap(vertices.size());
+    welded.reserve(vertices.size());
+
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = unique.insert(std::make_pair(vertices[i], (unsigned int)welded.size()));
+        if (inserted.second)
+            welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+    unsigned int triangleCount = (unsigned int)indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    //triangle adjacency of every vertex, stored as one array with per-vertex offsets
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (unsigned int t = 0; t < triangleCount; t++)
+        for (unsigned int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (unsigned int t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    unsigned int bestTriangle = (unsigned int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    unsigned int searchCursor = 0;
+
+    for (unsigned int step = 0; step < triangleCount; step++)
+    {
+        //dead end, continue with the next triangle that is not emitted yet
+        if (bestTriangle == ~0u)
+        {
+            while (emitted[searchCursor])
+                searchCursor++;
+            bestTriangle = searchCursor;
+        }
+
+        const unsigned int* triangle = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        //remove the triangle from the adjacency of its vertices
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            unsigned int* begin = &adjacency[adjacencyOffset[v]];
+            unsigned int* end = begin + remaining[v];
+            unsigned int* found = std::find(begin, end, bestTriangle);
+            std::swap(*found, *(end - 1));
+            remaining[v]--;
+        }
+
+        //move the triangle's vertices to the front of the lru cache
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache.push_back(v);
+
+        for (unsigned int i = 0; i < newCache.size(); i++)
+            cachePosition[newCache[i]] = i < FORSYTH_CACHE_SIZE ? int(i) : -1;
+
+        //rescore all vertices that are in the cache or just dropped out of it
+        for (unsigned int v : newCache)
+            vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+
+        if (newCache.size() > FORSYTH_CACHE_SIZE)
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(newCache);
+
+        //the next triangle is the best one around the cached vertices
+        bestTriangle = ~0u;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache)
+        {
+            for (unsigned int a = 0; a < remaining[v]; a++)
+            {
+                unsigned int t = adjacency[adjacencyOffset[v] + a];
+                float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                triangleScore[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, float threshold)
+{
+    unsigned int triangleCount = (unsigned int)indices.size() / 3;
+    unsigned int vertexCount = (unsigned int)positions.size();
+    if (triangleCount < 2)
+        return;
+
+    //split the cache optimized order where a triangle misses with all three vertices,
+    //the cache is cold there anyway, so reordering whole clusters costs almost nothing
+    std::vector<unsigned int> clusterStart;
+    std::vector<unsigned int> fifo;
+    std::vector<bool> cached(vertexCount, false);
+    for (unsigned int t = 0; t < triangleCount; t++)
+    {
+        unsigned int misses = 0;
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (cached[v])
+                continue;
+            misses++;
+            fifo.push_back(v);
+            cached[v] = true;
+            if (fifo.size() > ANALYZE_CACHE_SIZE)
+            {
+                cached[fifo.front()] = false;
+                fifo.erase(fifo.begin());
+            }
+        }
+        if (t == 0 || misses == 3)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+
+    unsigned int clusterCount = (unsigned int)clusterStart.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    //area weighted centroid and normal of every cluster and of the whole mesh
+    std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (unsigned int c = 0; c < clusterCount; c++)
+    {
+        float clusterArea = 0.0f;
+        for (unsigned int t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            const glm::vec3& p0 = positions[indices[t * 3]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+
+            clusterCentroid[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormal[c] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f)
+            clusterCentroid[c] /= clusterArea;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    //clusters facing away from the center are likely to occlude the others, draw them first
+    std::vector<float> sortKey(clusterCount);
+    std::vector<unsigned int> order(clusterCount);
+    for (unsigned int c = 0; c < clusterCount; c++)
+    {
+        float normalLength = glm::length(clusterNormal[c]);
+        glm::vec3 normal = normalLength > 0.0f ? clusterNormal[c] / normalLength : glm::vec3(0.0f);
+        sortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, normal);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (unsigned int c : order)
+        result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+
+    //keep the cache optimized order if the new one is noticeably worse for the vertex cache
+    float acmrBefore = analyzeVertexCache(indices, vertexCount).acmr();
+    float acmrAfter = analyzeVertexCache(result, vertexCount).acmr();
+    if (acmrAfter <= acmrBefore * threshold)
+        indices.swap(result);
+}
+
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+    std::vector<unsigned int> remap(vertexCount, ~0u);
+    unsigned int next = 0;
+
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == ~0u)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    return remap;
+}
+
+std::vector<MeshData> MeshOptimizer::splitMesh(const MeshData& data, size_t maxVertices)
+{
+    std::vector<MeshData> parts;
+    if (data.vertices.size() <= maxVertices)
+    {
+        parts.push_back(data);
+        return parts;
+    }
+
+    //vertex index in the current part, ~0u if the vertex is not part of it yet
+    std::vector<unsigned int> remap(data.vertices.size(), ~0u);
+    std::vector<unsigned int> partVertices;
+
+    MeshData part;
+    auto flush = [&]() {
+        for (unsigned int v : partVertices)
+            remap[v] = ~0u;
+        partVertices.clear();
+
+        part.name = data.name;
+        part.transformationMatrix = data.transformationMatrix;
+        part.textures = data.textures;
+        parts.push_back(std::move(part));
+        part = MeshData();
+    };
+
+    for (size_t t = 0; t + 2 < data.indices.size(); t += 3)
+    {
+        const unsigned int* triangle = &data.indices[t];
+        unsigned int newVertices = 0;
+        for (unsigned int k = 0; k < 3; k++)
+            if (remap[triangle[k]] == ~0u && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]))
+                newVertices++;
+
+        if (part.vertices.size() + newVertices > maxVertices)
+            flush();
+
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            if (remap[v] == ~0u)
+            {
+                remap[v] = (unsigned int)part.vertices.size();
+                part.vertices.push_back(data.vertices[v]);
+                partVertices.push_back(v);
+            }
+            part.indices.push_back(remap[v]);
+        }
+    }
+    if (!part.indices.empty())
+        flush();
+
+    return parts;
+}
+
+std::vector<MeshData> MeshOptimizer::splitByGrid(const MeshData& data, float cellSize)
+{
+    //triangles of every cell, ordered by cell so the result is deterministic
+    std::map<std::tuple<int, int, int>, std::vector<unsigned int>> cellTriangles;
+    for (unsigned int t = 0; t + 2 < data.indices.size(); t += 3)
+    {
+        glm::vec3 centroid = (data.vertices[data.indices[t]].Position + data.vertices[data.indices[t + 1]].Position + data.vertices[data.indices[t + 2]].Position) / 3.0f;
+        glm::ivec3 cell = glm::ivec3(glm::floor(centroid / cellSize));
+        cellTriangles[std::make_tuple(cell.x, cell.y, cell.z)].push_back(t);
+    }
+
+    std::vector<MeshData> parts;
+    if (cellTriangles.size() <= 1)
+    {
+        parts.push_back(data);
+        return parts;
+    }
+
+    std::vector<unsigned int> remap(data.vertices.size(), ~0u);
+    for (auto& cell : cellTriangles)
+    {
+        MeshData part;
+        part.name = data.name;
+        part.transformationMatrix = data.transformationMatrix;
+        part.textures = data.textures;
+
+        //the triangles keep their optimized order, vertices are renumbered by first use
+        for (unsigned int t : cell.second)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int v = data.indices[t + k];
+                if (remap[v] == ~0u)
+                {
+                    remap[v] = (unsigned int)part.vertices.size();
+                    part.vertices.push_back(data.vertices[v]);
+                }
+                part.indices.push_back(remap[v]);
+            }
+        }
+
+        for (unsigned int t : cell.second)
+            for (unsigned int k = 0; k < 3; k++)
+                remap[data.indices[t + k]] = ~0u;
+
+        parts.push_back(std::move(part));
+    }
+    return parts;
+}
+
+std::vector<unsigned int> MeshOptimizer::simplify(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, size_t targetIndexCount, float maxError, float* resultError)
+{
+    unsigned int vertexCount = (unsigned int)positions.size();
+    std::vector<unsigned int> result = indices;
+    if (resultError)
+        *resultError = 0.0f;
+
+    //vertices at the same position (uv/normal seams) are one corner, represented by the lowest index
+    //the copies of a corner are linked in a circular list
+    std::vector<unsigned int> corner(vertexCount), nextCopy(vertexCount);
+    {
+        std::vector<unsigned int> order(vertexCount);
+        for (unsigned int v = 0; v < vertexCount; v++)
+            order[v] = v;
+        std::sort(order.begin(), order.end(), [&positions](unsigned int a, unsigned int b) {
+            const glm::vec3& pa = positions[a];
+            const glm::vec3& pb = positions[b];
+            return std::tie(pa.x, pa.y, pa.z, a) < std::tie(pb.x, pb.y, pb.z, b);
+        });
+
+        for (unsigned int i = 0; i < vertexCount; )
+        {
+            unsigned int end = i + 1;
+            while (end < vertexCount && positions[order[end]] == positions[order[i]])
+                end++;
+            for (unsigned int k = i; k < end; k++)
+            {
+                corner[order[k]] = order[i];
+                nextCopy[order[k]] = order[k + 1 < end ? k + 1 : i];
+            }
+            i = end;
+        }
+    }
+
+    //area weighted plane quadrics of the triangles around every corner
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t + 2 < result.size(); t += 3)
+    {
+        glm::dvec3 p0(positions[result[t]]), p1(positions[result[t + 1]]), p2(positions[result[t + 2]]);
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(normal);
+        if (length <= 0.0)
+            continue;
+        normal /= length;
+        for (unsigned int k = 0; k < 3; k++)
+            quadrics[corner[result[t + k]]].addPlane(normal, -glm::dot(normal, p0), length * 0.5);
+    }
+
+    //corners on border or non-manifold edges never move, so open meshes and split cells keep their outline
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::unordered_map<uint64_t, unsigned int> edgeUses;
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int a = corner[result[t + k]], b = corner[result[t + (k + 1) % 3]];
+                if (a != b)
+                    edgeUses[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+            }
+        }
+        for (const auto& edge : edgeUses)
+        {
+            if (edge.second == 2)
+                continue;
+            locked[(unsigned int)(edge.first >> 32)] = true;
+            locked[(unsigned int)(edge.first & 0xFFFFFFFFu)] = true;
+        }
+    }
+
+    double maxErrorSquared = double(maxError) * double(maxError);
+    double largestError = 0.0;
+
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<unsigned int> touchedInPass(vertexCount, 0);
+    std::vector<unsigned int> triangleOffsets(vertexCount + 1), triangleList;
+    std::vector<EdgeCollapse> collapses;
+    std::vector<std::pair<unsigned int, unsigned int>> copyMatches;
+    std::vector<unsigned int> fromNeighbours, toNeighbours;
+
+    for (unsigned int pass = 1; result.size() > targetIndexCount && pass <= SIMPLIFY_MAX_PASSES; pass++)
+    {
+        //triangles around every corner
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (unsigned int index : result)
+            triangleOffsets[corner[index] + 1]++;
+        for (unsigned int v = 0; v < vertexCount; v++)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        triangleList.resize(result.size());
+        {
+            std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (unsigned int i = 0; i < result.size(); i++)
+                triangleList[fill[corner[result[i]]]++] = i / 3 * 3;
+        }
+
+        //cheaper direction of every manifold edge, each edge is seen once with a < b
+        collapses.clear();
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int a = corner[result[t + k]], b = corner[result[t + (k + 1) % 3]];
+                if (a > b || (locked[a] && locked[b]))
+                    continue;
+
+                Quadric quadric = quadrics[a];
+                quadric += quadrics[b];
+                double costAB = locked[a] ? DBL_MAX : quadric.evaluate(glm::dvec3(positions[b]));
+                double costBA = locked[b] ? DBL_MAX : quadric.evaluate(glm::dvec3(positions[a]));
+                if (costAB <= costBA)
+                    collapses.push_back({ a, b, costAB });
+                else
+                    collapses.push_back({ b, a, costBA });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& a, const EdgeCollapse& b) { return a.cost < b.cost; });
+
+        for (unsigned int v = 0; v < vertexCount; v++)
+            remap[v] = v;
+
+        size_t triangles = result.size() / 3;
+        size_t targetTriangles = targetIndexCount / 3;
+        unsigned int collapsed = 0;
+
+        for (const EdgeCollapse& collapse : collapses)
+        {
+            if (triangles <= targetTriangles || collapse.cost > maxErrorSquared)
+                break;
+
+            //neighbourhoods changed in this pass are handled in the next one
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touchedInPass[from] == pass || touchedInPass[to] == pass)
+                continue;
+
+            const unsigned int* fromBegin = triangleList.data() + triangleOffsets[from];
+            const unsigned int* fromEnd = triangleList.data() + triangleOffsets[from + 1];
+
+            //every copy of "from" has to meet a copy of "to" in its own triangles, otherwise the collapse would cross a seam
+            bool valid = true;
+            copyMatches.clear();
+            fromNeighbours.clear();
+            unsigned int sharedTriangles = 0;
+            for (const unsigned int* t = fromBegin; t != fromEnd && valid; t++)
+            {
+                unsigned int fromCopy = ~0u, toCopy = ~0u;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int v = result[*t + k];
+                    if (corner[v] == from)
+                        fromCopy = v;
+                    else if (corner[v] == to)
+                        toCopy = v;
+                    else
+                        fromNeighbours.push_back(corner[v]);
+                }
+
+                auto match = std::find_if(copyMatches.begin(), copyMatches.end(), [fromCopy](const std::pair<unsigned int, unsigned int>& m) { return m.first == fromCopy; });
+                if (toCopy != ~0u)
+                {
+                    sharedTriangles++;
+                    if (match == copyMatches.end())
+                        copyMatches.push_back(std::make_pair(fromCopy, toCopy));
+                    else if (match->second == ~0u)
+                        match->second = toCopy;
+                    else if (match->second != toCopy)
+                        valid = false;
+                }
+                else if (match == copyMatches.end())
+                {
+                    copyMatches.push_back(std::make_pair(fromCopy, ~0u));
+                }
+            }
+            for (const auto& match : copyMatches)
+                if (match.second == ~0u)
+                    valid = false;
+            if (!valid)
+                continue;
+
+            //only the opposite corners of the triangles on the edge may be neighbours of both, otherwise the surface folds
+            std::sort(fromNeighbours.begin(), fromNeighbours.end());
+            fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+            toNeighbours.clear();
+            for (unsigned int i = triangleOffsets[to]; i < triangleOffsets[to + 1]; i++)
+                for (unsigned int k = 0; k < 3; k++)
+                    toNeighbours.push_back(corner[result[triangleList[i] + k]]);
+            std::sort(toNeighbours.begin(), toNeighbours.end());
+            toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+
+            unsigned int commonNeighbours = 0;
+            for (unsigned int v : fromNeighbours)
+                if (std::binary_search(toNeighbours.begin(), toNeighbours.end(), v))
+                    commonNeighbours++;
+            if (commonNeighbours > sharedTriangles)
+                continue;
+
+            //the remaining triangles around "from" must not flip when it moves
+            for (const unsigned int* t = fromBegin; t != fromEnd && valid; t++)
+            {
+                glm::dvec3 before[3], after[3];
+                bool shared = false;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int v = corner[result[*t + k]];
+                    shared = shared || v == to;
+                    before[k] = glm::dvec3(positions[v]);
+                    after[k] = glm::dvec3(positions[v == from ? to : v]);
+                }
+                if (shared)
+                    continue;
+
+                glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                valid = glm::dot(normalBefore, normalAfter) > SIMPLIFY_MIN_NORMAL_DOT * glm::length(normalBefore) * glm::length(normalAfter);
+            }
+            if (!valid)
+                continue;
+
+            for (const auto& match : copyMatches)
+                remap[match.first] = match.second;
+            quadrics[to] += quadrics[from];
+
+            for (const unsigned int* t = fromBegin; t != fromEnd; t++)
+                for (unsigned int k = 0; k < 3; k++)
+                    touchedInPass[corner[result[*t + k]]] = pass;
+
+            triangles -= sharedTriangles;
+            largestError = std::max(largestError, collapse.cost);
+            collapsed++;
+        }
+
+        if (collapsed == 0)
+            break;
+
+        //the triangles on the collapsed edges become degenerate and are dropped
+        size_t write = 0;
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (corner[a] == corner[b] || corner[b] == corner[c] || corner[a] == corner[c])
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError)
+        *resultError = float(std::sqrt(largestError));
+    return result;
+}
+
+std::vector<LodIndices> MeshOptimizer::generateLods(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, unsigned int maxLevels)
+{
+    std::vector<LodIndices> lods;
+    if (positions.empty())
+        return lods;
+
+    glm::vec3 boundsMin = positions[0], boundsMax = positions[0];
+    for (const glm::vec3& position : positions)
+    {
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+    float maxError = glm::length(boundsMax - boundsMin) * 0.5f * LOD_MAX_RELATIVE_ERROR;
+
+    //every level is simplified from the previous one, so the errors add up
+    float error = 0.0f;
+    while (lods.size() < maxLevels && error < maxError)
+    {
+        const std::vector<unsigned int>& previous = lods.empty() ? indices : lods.back().indices;
+        size_t targetIndexCount = previous.size() / 6 * 3;
+        if (targetIndexCount < LOD_MIN_TRIANGLES * 3)
+            break;
+
+        float levelError = 0.0f;
+        std::vector<unsigned int> simplified = simplify(previous, positions, targetIndexCount, maxError - error, &levelError);
+
+        //a level that removes less than a fifth of the triangles is not worth its indices
+        if (simplified.size() * 5 > previous.size() * 4)
+            break;
+
+        optimizeVertexCache(simplified, (unsigned int)positions.size());
+
+        LodIndices lod;
+        lod.indices.swap(simplified);
+        lod.error = error + levelError;
+        error = lod.error;
+        lods.push_back(std::move(lod));
+    }
+    return lods;
+}
+
+void MeshOptimizer::generateLods(MeshData& data)
+{
+    std::vector<glm::vec3> positions(data.vertices.size());
+    for (size_t i = 0; i < data.vertices.size(); i++)
+        positions[i] = data.vertices[i].Position;
+    data.lods = generateLods(data.indices, positions);
+}
+
+void MeshOptimizer::generateLods(GeometryData& data)
+{
+    data.lods = generateLods(data.indices, data.positions);
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats;
+    stats.triangles = (unsigned int)indices.size() / 3;
+
+    //timestamp of the moment a vertex entered the fifo, it is cached while it is younger than the cache size
+    std::vector<unsigned int> enteredAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    unsigned int time = cacheSize + 1;
+
+    for (unsigned int index : indices)
+    {
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            stats.vertices++;
+        }
+        if (time - enteredAt[index] > cacheSize)
+        {
+            enteredAt[index] = time++;
+            stats.transformed++;
+        }
+    }
+    return stats;
+}
+
+MeshOptimizerReport MeshOptimizer::optimize(MeshData& data)
+{
+    MeshOptimizerReport report;
+    report.before = analyzeVertexCache(data.indices, (unsigned int)data.vertices.size());
+
+    weldVertices(data.vertices, data.indices);
+    optimizeVertexCache(data.indices, (unsigned int)data.vertices.size());
+
+    std::vector<glm::vec3> positions(data.vertices.size());
+    for (size_t i = 0; i < data.vertices.size(); i++)
+        positions[i] = data.vertices[i].Position;
+    optimizeOverdraw(data.indices, positions);
+
+    std::vector<unsigned int> remap = optimizeVertexFetch(data.indices, (unsigned int)data.vertices.size());
+    unsigned int used = 0;
+    for (unsigned int r : remap)
+        if (r != ~0u) used++;
+    remapVertices(data.vertices, remap, used);
+
+    report.after = analyzeVertexCache(data.indices, (unsigned int)data.vertices.size());
+    return report;
+}
+
+MeshOptimizerReport MeshOptimizer::optimize(GeometryData& data)
+{
+    MeshOptimizerReport report;
+    unsigned int vertexCount = (unsigned int)data.positions.size();
+    report.before = analyzeVertexCache(data.indices, vertexCount);
+
+    optimizeVertexCache(data.indices, vertexCount);
+    optimizeOverdraw(data.indices, data.positions);
+
+    std::vector<unsigned int> remap = optimizeVertexFetch(data.indices, vertexCount);
+    unsigned int used = 0;
+    for (unsigned int r : remap)
+        if (r != ~0u) used++;
+    remapVertices(data.positions, remap, used);
+    remapVertices(data.normals, remap, used);
+    remapVertices(data.uvs, remap, used);
+
+    report.after = analyzeVertexCache(data.indices, used);
+    return report;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Geometry.h"
+
+//result of a post-transform vertex cache simulation
+struct VertexCacheStats {
+    unsigned int triangles = 0;
+    unsigned int vertices = 0;     //referenced vertices
+    unsigned int transformed = 0;  //vertex shader invocations (cache misses)
+
+    //average cache miss ratio, transformed vertices per triangle (0.5 is optimal, 3 is worst)
+    float acmr() const { return triangles ? float(transformed) / float(triangles) : 0.0f; }
+
+    //average transform to vertex ratio (1 is optimal)
+    float atvr() const { return vertices ? float(transformed) / float(vertices) : 0.0f; }
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+struct MeshOptimizerReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+
+    MeshOptimizerReport& operator+=(const MeshOptimizerReport& other);
+};
+
+//import/cook time optimizations of indexed triangle lists
+class MeshOptimizer {
+
+public:
+
+    //size of the simulated fifo cache used for the statistics
+    static const unsigned int ANALYZE_CACHE_SIZE = 16;
+
+    //overdraw ordering is rejected if it raises the acmr by more than this factor
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    //levels of detail per mesh, without the full detail level
+    static const unsigned int LOD_MAX_LEVELS = 4;
+
+    //simplification stops once the error reaches this fraction of the mesh bounds radius
+    static constexpr float LOD_MAX_RELATIVE_ERROR = 0.1f;
+
+    //merges bitwise identical vertices and rewrites the indices
+    static void weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+    //reorders triangles for post-transform vertex cache locality (Forsyth's linear-speed algorithm)
+    static void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+    //reorders clusters of the cache optimized triangle order so outward facing clusters are drawn first
+    //the clusters are kept intact, so the cache efficiency stays within the threshold
+    static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, float threshold = OVERDRAW_THRESHOLD);
+
+    //renumbers vertices in order of first use, rewrites the indices
+    //@return remap table, old vertex index -> new vertex index (~0u for unused vertices)
+    static std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+    //applies a remap table from optimizeVertexFetch to a vertex attribute array
+    template<class T>
+    static void remapVertices(std::vector<T>& attribute, const std::vector<unsigned int>& remap, unsigned int newVertexCount)
+    {
+        if (attribute.empty())
+            return;
+
+        std::vector<T> result(newVertexCount);
+        for (size_t i = 0; i < attribute.size() && i < remap.size(); i++)
+            if (remap[i] != ~0u)
+                result[remap[i]] = attribute[i];
+        attribute.swap(result);
+    }
+
+    //splits a mesh into parts with at most maxVertices vertices each, keeping the triangle order
+    //parts share the name, transformation and textures of the mesh
+    static std::vector<MeshData> splitMesh(const MeshData& data, size_t maxVertices = PackedIndices::MAX_16BIT_VERTICES);
+
+    //splits a mesh along a grid, every triangle goes to the cell containing its centroid
+    //parts share the name, transformation and textures of the mesh
+    static std::vector<MeshData> splitByGrid(const MeshData& data, float cellSize);
+
+    //simplifies a triangle list by quadric error edge collapses until it has at most targetIndexCount indices
+    //vertices are only removed from the triangles, the result indexes the same vertices
+    //borders and uv/normal seams stay in place, collapses with an error above maxError are not done
+    //@param resultError: set to the largest collapse error, in the units of the positions
+    static std::vector<unsigned int> simplify(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, size_t targetIndexCount, float maxError, float* resultError = nullptr);
+
+    //builds up to maxLevels simplified levels, each with about half the triangles of the previous one
+    //the levels are cache optimized, their errors are relative to the full detail mesh
+    static std::vector<LodIndices> generateLods(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, unsigned int maxLevels = LOD_MAX_LEVELS);
+
+    //fills the level of detail chain of imported mesh data
+    static void generateLods(MeshData& data);
+
+    //fills the level of detail chain of procedural geometry data
+    static void generateLods(GeometryData& data);
+
+    //simulates a fifo post-transform cache
+    static VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = ANALYZE_CACHE_SIZE);
+
+    //runs all steps on imported mesh data (weld, cache, overdraw, fetch)
+    static MeshOptimizerReport optimize(MeshData& data);
+
+    //runs all steps on procedural geometry data (cache, overdraw, fetch)
+    static MeshOptimizerReport optimize(GeometryData& data);
+};
@@ -1,12 +1,56 @@
 
 #include "ModelLoader.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "StaticBatch.h"
+#include "ThreadPool.h"
+#include "textures/TextureRegistry.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-static Assimp::Importer import;
 
-//loads model via assimp and stores meshes in meshes vector
+//loads model from the mesh cache if it is up to date, otherwise via assimp
 void ModelLoader::loadModel(string path)
 {
+    //directory of the filepath
+    directory = path.substr(0, path.find_last_of('/'));
+
+    if (MeshCache::isUpToDate(path) && loadCachedModel(MeshCache::cachePath(path)))
+        return;
+
+    std::vector<MeshData> meshData;
+    if (!importModel(path, meshData, _splitLargeMeshes))
+        return;
+
+    //gpu buffers and textures are created on the context thread
+    for (unsigned int i = 0; i < meshData.size(); i++)
+        addMesh(meshData[i]);
+
+    //cook the processed meshes so the next start can skip assimp
+    if (!MeshCache::write(MeshCache::cachePath(path), meshData, _splitLargeMeshes ? MESH_CACHE_SPLIT : 0))
+        std::cout << "ERROR::MESHCACHE::could not write " << MeshCache::cachePath(path) << std::endl;
+}
+
+//cooks the mesh cache without creating gpu meshes
+bool ModelLoader::cookModel(const string& path, bool splitLargeMeshes)
+{
+    std::vector<MeshData> meshData;
+    if (!importModel(path, meshData, splitLargeMeshes))
+        return false;
+
+    if (!MeshCache::write(MeshCache::cachePath(path), meshData, splitLargeMeshes ? MESH_CACHE_SPLIT : 0))
+    {
+        std::cout << "ERROR::MESHCACHE::could not write " << MeshCache::cachePath(path) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//imports a model with assimp, meshes are converted and optimized on the worker threads
+bool ModelLoader::importModel(const string& path, std::vector<MeshData>& meshData, bool splitLargeMeshes)
+{
+    //the importer owns the aiScene, it is destroyed with all assimp memory when the import returns
+    //everything needed later is copied into the mesh data before that
+    Assimp::Importer import;
 
     //aiProcess_Triangulate transforms all primitive shapes to triangbles
     const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -15,18 +59,74 @@ void ModelLoader::loadModel(string path)
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
         std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
-        return;
+        return false;
     }
 
-    //directory of the filepath
-    directory = path.substr(0, path.find_last_of('/'));
+    //collect meshes of all nodes recursively, in the same order as the node tree
+    std::vector<std::pair<aiMesh*, aiMatrix4x4>> nodeMeshes;
+    processNode(scene->mRootNode, scene, aiMatrix4x4(), nodeMeshes);
+
+    //convert, optimize and split meshes on the worker threads, results keep the node order
+    //the levels of detail are built for the parts, so they are cooked with them and never rebuilt at load time
+    std::vector<std::vector<MeshData>> nodeParts(nodeMeshes.size());
+    std::vector<MeshOptimizerReport> reports(nodeMeshes.size());
+    ThreadPool::shared().parallelFor((unsigned int)nodeMeshes.size(), [&](unsigned int i) {
+        MeshData data = processMesh(nodeMeshes[i].first, scene, nodeMeshes[i].second);
+        reports[i] = MeshOptimizer::optimize(data);
+        if (splitLargeMeshes && data.vertices.size() > PackedIndices::MAX_16BIT_VERTICES)
+            nodeParts[i] = MeshOptimizer::splitMesh(data);
+        else
+            nodeParts[i].push_back(std::move(data));
+        for (MeshData& part : nodeParts[i])
+            MeshOptimizer::generateLods(part);
+    });
+
+    meshData.clear();
+    for (std::vector<MeshData>& parts : nodeParts)
+        for (MeshData& part : parts)
+            meshData.push_back(std::move(part));
+
+    unsigned int lodCount = 0;
+    for (const MeshData& data : meshData)
+        lodCount += (unsigned int)data.lods.size();
+
+    MeshOptimizerReport total;
+    for (const MeshOptimizerReport& report : reports)
+        total += report;
+    std::cout << "Optimized " << path << ": " << total.after.triangles << " triangles, "
+        << total.before.vertices << " -> " << total.after.vertices << " vertices, "
+        << "ACMR " << total.before.acmr() << " -> " << total.after.acmr() << ", "
+        << "ATVR " << total.before.atvr() << " -> " << total.after.atvr() << ", "
+        << lodCount << " levels of detail" << std::endl;
+
+    return true;
+}
+
+//loads all meshes from a cooked mesh file
+bool ModelLoader::loadCachedModel(string cachePath)
+{
+    MeshCache cache;
+    if (!cache.open(cachePath))
+        return false;
 
-    //process nodes recursively 
-    processNode(scene->mRootNode, scene, aiMatrix4x4());
+    //meshes are split when they are cooked, a cache cooked with the other setting is imported again
+    if (((cache.getFlags() & MESH_CACHE_SPLIT) != 0) != _splitLargeMeshes)
+        return false;
+
+    for (unsigned int i = 0; i < cache.getMeshCount(); i++)
+    {
+        MeshCacheView view = cache.getMesh(i);
+
+        //uploaded straight from the mapped file
+        _collisionMeshes.push_back(CollisionMesh::create(view));
+        //the cpu copies are kept for addToBatch(), releaseCpuData() frees them
+        meshes.push_back(Mesh(view, loadMaterialTextures(view.textures), true));
+    }
+    return true;
 }
 
-//retrieves mesh data from nodes
-void ModelLoader::processNode(aiNode* node, const aiScene* scene, aiMatrix4x4 parentTransform)
+//retrieves meshes and their transformations from nodes
+void ModelLoader::processNode(aiNode* node, const aiScene* scene, aiMatrix4x4 parentTransform, std::vector<std::pair<aiMesh*, aiMatrix4x4>>& nodeMeshes)
 {
 
     aiMatrix4x4 matrixTransformation = node->mTransformation;
@@ -37,14 +137,13 @@ void ModelLoader::processNode(aiNode* node, const aiScene* scene, aiMatrix4x4 pa
     {
         //retrieve mesh 
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        //process mesh and then store it into the meshes vector
-        //processmesh returnt kopie und daten werden vlt freigegeben
-        meshes.push_back(processMesh(mesh, scene, transform));
+        //store it for processing, meshes are converted in parallel afterwards
+        nodeMeshes.push_back(std::make_pair(mesh, transform));
     }
     //recursively process the children nodes
      for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        processNode(node->mChildren[i], scene, transform);
+        processNode(node->mChildren[i], scene, transform, nodeMeshes);
     }
 
 }
@@ -66,12 +165,14 @@ void ModelLoader::setShader(std::shared_ptr <Shader> shader) {
     _material->setShader(shader);
 }
 
-Mesh ModelLoader::processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 matrixTransformation) {
+MeshData ModelLoader::processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 matrixTransformation) {
 
     //data for processing meshes
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<MeshTexture> textures;
+    MeshData data;
+    data.name = mesh->mName.C_Str();
+    data.transformationMatrix = matrixTransformation;
+    data.vertices.reserve(mesh->mNumVertices);
+    data.indices.reserve(mesh->mNumFaces * 3);
 
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
@@ -91,6 +192,8 @@ Mesh ModelLoader::processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 ma
             vector.z = mesh->mNormals[i].z;
             vertex.Normal = vector;
         }
+        else
+            vertex.Normal = glm::vec3(0.0f, 0.0f, 0.0f);
 
         if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
         {
@@ -102,7 +205,7 @@ Mesh ModelLoader::processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 ma
         else
             vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
-        vertices.push_back(vertex);
+        data.vertices.push_back(vertex);
     }
 
 
@@ -110,57 +213,71 @@ Mesh ModelLoader::processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 ma
     {
         aiFace face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++)
-            indices.push_back(face.mIndices[j]);
+            data.indices.push_back(face.mIndices[j]);
     }
 
 
     if (mesh->mMaterialIndex >= 0)
     {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        std::vector<MeshTexture> diffuseMaps = loadMaterialTextures(material,
+        std::vector<MeshTextureRef> diffuseMaps = collectMaterialTextures(material,
             aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        std::vector<MeshTexture> specularMaps = loadMaterialTextures(material,
+        data.textures.insert(data.textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        std::vector<MeshTextureRef> specularMaps = collectMaterialTextures(material,
             aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        data.textures.insert(data.textures.end(), specularMaps.begin(), specularMaps.end());
     }
 
-    return Mesh(vertices, indices, textures, matrixTransformation, mesh);
+    return data;
 }
 
+//loads the textures of the mesh data and creates the gpu mesh
+Mesh ModelLoader::createMesh(MeshData& data)
+{
+    std::vector<MeshTexture> textures = loadMaterialTextures(data.textures);
+    return Mesh(data.vertices, data.indices, textures, data.transformationMatrix, data.name, data.lods);
+}
 
-
-//retrieve the texture's file location and load and generate the texture 
-//stores data in a Vertex struct
-std::vector<MeshTexture> ModelLoader::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+//creates the gpu mesh and its collision record, large meshes were already split at import
+void ModelLoader::addMesh(MeshData& data)
 {
+    _collisionMeshes.push_back(CollisionMesh::create(data));
+    meshes.push_back(createMesh(data));
+}
 
-    std::vector<MeshTexture> textures;
+//retrieve the texture's file locations of a material
+std::vector<MeshTextureRef> ModelLoader::collectMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+{
+    std::vector<MeshTextureRef> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         //retrieve texture location and store result in aiString str
         mat->GetTexture(type, i, &str);
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++)
-        {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if (!skip)
-        {   // if texture hasn't been loaded already, load it
-            MeshTexture texture;
-            //loads texture and returns its id
-            texture.id = TextureFromFile(str.C_Str(), directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture); // add to loaded textures
-        }
+
+        MeshTextureRef texture;
+        texture.type = typeName;
+        texture.path = str.C_Str();
+        textures.push_back(texture);
+    }
+    return textures;
+}
+
+//load the textures through the texture registry
+//stores data in a MeshTexture struct
+std::vector<MeshTexture> ModelLoader::loadMaterialTextures(const std::vector<MeshTextureRef>& refs)
+{
+
+    std::vector<MeshTexture> textures;
+    for (const MeshTextureRef& ref : refs)
+    {
+        MeshTexture texture;
+        //loads texture or reuses an already loaded one and returns its id
+        //diffuse maps are streamed in before the other maps
+        texture.id = TextureRegistry::instance().acquire(directory + '/' + ref.path, ref.type == "texture_diffuse" ? 1 : 0);
+        texture.type = ref.type;
+        texture.path = ref.path;
+        textures.push_back(texture);
     }
     return textures;
 }
@@ -171,74 +288,92 @@ unsigned int ModelLoader::TextureFromFile(const char* path, const string& direct
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename);
 }
 
 
 
-ModelLoader::ModelLoader(char* path, glm::mat4 modelMatrix, std::shared_ptr<Material> material)
-    : _modelMatrix(modelMatrix), _material(material)
+ModelLoader::ModelLoader(const char* path, glm::mat4 modelMatrix, std::shared_ptr<Material> material, bool splitLargeMeshes)
+    : _transform(modelMatrix), _material(material), _splitLargeMeshes(splitLargeMeshes)
 {
     loadModel(path);
+    updateBounds();
+}
+
+ModelLoader::~ModelLoader()
+{
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        for (unsigned int j = 0; j < meshes[i]._textures.size(); j++)
+            TextureRegistry::instance().release(meshes[i]._textures[j].id);
 }
 
-void ModelLoader::Draw()
+void ModelLoader::Draw(const Frustum& frustum)
 {
 
     Shader* shader = _material->getShader();
     shader->use();
 
-    shader->setUniform("modelMatrix", _modelMatrix);
+    shader->setUniform("modelMatrix", _transform.getModelMatrix());
+    shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+    //no per mesh light ranges, all point lights apply
+    shader->setUniform("pointLightMask", -1);
 
-    for (unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(shader);
+    _culling.cull(frustum, _visible);
+    for (unsigned int i : _visible)
+        meshes[i].Draw(shader, _transform.getModelMatrix(), true);
 }
 
-void ModelLoader::DrawShader(Shader* shader)
+void ModelLoader::DrawShader(Shader* shader, const Frustum& frustum)
 {
     shader->use();
 
-    shader->setUniform("modelMatrix", _modelMatrix);
+    shader->setUniform("modelMatrix", _transform.getModelMatrix());
+    shader->setUniform("normalMatrix", _transform.getNormalMatrix());
+
+    //depth only pass, the textures are not sampled
+    _culling.cull(frustum, _visible);
+    for (unsigned int i : _visible)
+        meshes[i].Draw(shader, _transform.getModelMatrix(), false);
+}
+
+void ModelLoader::updateBounds()
+{
+    _culling.clear();
+    for (const Mesh& mesh : meshes)
+        _culling.add(mesh._bounds.transform(_transform.getModelMatrix()));
+}
+
+const std::vector<CollisionMesh>& ModelLoader::getCollisionMeshes() const
+{
+    return _collisionMeshes;
+}
 
+size_t ModelLoader::releaseCpuData()
+{
+    size_t bytes = 0;
     for (unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(shader);
+        bytes += meshes[i].releaseCpuData();
+
+    for (const CollisionMesh& collision : _collisionMeshes)
+        bytes += collision.getBytes();
+    std::vector<CollisionMesh>().swap(_collisionMeshes);
+
+    return bytes;
+}
+
+void ModelLoader::addToBatch(StaticBatch& batch)
+{
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        batch.add(meshes[i], _transform.getModelMatrix(), _material);
+        meshes[i].releaseBuffers();
+    }
 }
 
 void ModelLoader::SetModelMatrix(glm::mat4 modelMatrix)
 {
-    _modelMatrix = modelMatrix;
+    _transform.set(modelMatrix);
+    updateBounds();
 }
 
 std::vector<Mesh>& ModelLoader::getMeshes()
@@ -13,6 +13,7 @@
 
 #include "Shader.h"
 #include "Mesh.h"
+#include "Transform.h"
 #include "Utils.h"
 #include <string>
 #include <fstream>
@@ -23,41 +24,96 @@
 
 //unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+class StaticBatch;
+
 class ModelLoader {
 
 private:
 
     // model data
     std::vector<Mesh> meshes;
+
+    //owned collision records of all meshes, the assimp scene is freed after the import
+    std::vector<CollisionMesh> _collisionMeshes;
     string directory;
-    std::vector<MeshTexture> textures_loaded;
-    glm::mat4 _modelMatrix;
+    //model matrix with its cached normal matrix
+    Transform _transform;
     std::shared_ptr<Material> _material;
 
-    //loads model via assimp and stores meshes in meshes vector
+    //split meshes that do not fit 16-bit indices
+    bool _splitLargeMeshes;
+
+    //world space bounds of the meshes and the meshes visible in the current pass
+    CullingSet _culling;
+    std::vector<unsigned int> _visible;
+
+    //recomputes the world space bounds for the model matrix
+    void updateBounds();
+
+    //loads model from the mesh cache or via assimp and stores meshes in meshes vector
     void loadModel(string path);
 
-    //retrieves mesh data from nodes
-    void processNode(aiNode* node, const aiScene* scene, aiMatrix4x4 parentTransform);
+    //loads all meshes from a cooked mesh file, returns false if the file is not usable
+    bool loadCachedModel(string cachePath);
+
+    //imports a model with assimp into optimized cpu-side mesh data with levels of detail
+    //large meshes are split into 16-bit indexable parts first if splitLargeMeshes is set
+    static bool importModel(const string& path, std::vector<MeshData>& meshData, bool splitLargeMeshes);
+
+    //retrieves meshes and their transformations from nodes
+    static void processNode(aiNode* node, const aiScene* scene, aiMatrix4x4 parentTransform, std::vector<std::pair<aiMesh*, aiMatrix4x4>>& nodeMeshes);
+
+    //converts an assimp mesh into cpu-side mesh data
+    //only reads the scene, so it is safe to run on worker threads
+    static MeshData processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 matrixTransformation);
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene, aiMatrix4x4 matrixTransformation);
+    //loads the textures and creates the gpu mesh
+    Mesh createMesh(MeshData& data);
 
-    //retrieve the texture's file location and load and generate the texture 
-    //stores data in a Vertex struct
-    std::vector<MeshTexture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+    //creates the gpu mesh and the collision record of the mesh data
+    void addMesh(MeshData& data);
+
+    //retrieve the texture's file locations of a material
+    static std::vector<MeshTextureRef> collectMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+
+    //load the textures through the texture registry
+    //stores data in a MeshTexture struct
+    std::vector<MeshTexture> loadMaterialTextures(const std::vector<MeshTextureRef>& refs);
 
     aiMatrix4x4 getPositionMatrix(aiNode* node, aiMatrix4x4 positionMatrix);
 
 public:
     std::vector<Mesh>& getMeshes();
 
+    //positions, triangles, name and node transformation of every mesh, for building physics bodies
+    const std::vector<CollisionMesh>& getCollisionMeshes() const;
+
+    //frees the cpu copies of the meshes and the collision records
+    //call once the meshes are uploaded or batched and the physics bodies are built
+    //@return freed bytes
+    size_t releaseCpuData();
+
+    //writes the mesh cache of a model without creating gpu meshes, returns false if the import failed
+    static bool cookModel(const string& path, bool splitLargeMeshes = true);
+
     unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
-    ModelLoader(char* path, glm::mat4 modelMatrix, std::shared_ptr<Material> material);
+    ModelLoader(const char* path, glm::mat4 modelMatrix, std::shared_ptr<Material> material, bool splitLargeMeshes = false);
+
+    //releases the textures of all meshes
+    ~ModelLoader();
+
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    //draws the meshes inside the frustum, all meshes by default
+    void Draw(const Frustum& frustum = Frustum());
 
-    void Draw();
+    void DrawShader(Shader* shader, const Frustum& frustum = Frustum());
 
-    void DrawShader(Shader* shader);
+    //adds all meshes to a static batch and frees their own gpu buffers
+    //the model is drawn through the batch afterwards, Draw() must not be used anymore
+    void addToBatch(StaticBatch& batch);
 
     /*!
      * Sets the model matrix to the parameter
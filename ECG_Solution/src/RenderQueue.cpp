@@ -0,0 +1,181 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+std::unordered_map<const void*, unsigned int> RenderQueue::_materialIds;
+
+// bits of the key fields, ids wider than their field wrap around and only sort less well
+static const unsigned int DEPTH_BITS = 24;
+static const unsigned int VAO_BITS = 8;
+static const unsigned int TEXTURE_BITS = 10;
+static const unsigned int MATERIAL_BITS = 10;
+static const unsigned int SHADER_BITS = 7;
+static const unsigned int TRANSPARENT_SHIFT = 59;
+static const unsigned int PASS_SHIFT = 60;
+
+/* --------------------------------------------- */
+// RenderState
+/* --------------------------------------------- */
+
+RenderState::RenderState(Shader* passShader, bool normalMaps)
+	: _passShader(passShader), _normalMaps(normalMaps), _shader(nullptr), _material(nullptr), _vao(0), _blend(false), _normalMap(false)
+{
+}
+
+void RenderState::use(Shader* shader)
+{
+	if (shader == _shader) return;
+
+	// ifNormal stays set in a program, reset it before leaving
+	setNormalMap(false);
+	shader->use();
+	_shader = shader;
+}
+
+bool RenderState::bindMaterial(const void* material)
+{
+	if (material == _material) return false;
+	_material = material;
+	return true;
+}
+
+void RenderState::bindVertexArray(GLuint vao)
+{
+	if (vao == _vao) return;
+	glBindVertexArray(vao);
+	_vao = vao;
+}
+
+void RenderState::setBlend(bool blend)
+{
+	if (blend == _blend) return;
+	if (blend) glEnable(GL_BLEND);
+	else glDisable(GL_BLEND);
+	_blend = blend;
+}
+
+void RenderState::setNormalMap(bool normalMap)
+{
+	if (normalMap == _normalMap || _shader == nullptr) return;
+	_shader->setUniform("ifNormal", normalMap);
+	_normalMap = normalMap;
+}
+
+void RenderState::finish()
+{
+	setNormalMap(false);
+	setBlend(false);
+	bindVertexArray(0);
+	_material = nullptr;
+}
+
+/* --------------------------------------------- */
+// RenderQueue
+/* --------------------------------------------- */
+
+RenderQueue::RenderQueue() : _sorted(true)
+{
+}
+
+uint64_t RenderQueue::makeKey(unsigned int pass, bool transparent, GLuint shader, unsigned int material, GLuint texture, GLuint vao, float depth)
+{
+	uint64_t depthBits = uint64_t(std::min(std::max(depth, 0.0f), 1.0f) * float((1 << DEPTH_BITS) - 1));
+	uint64_t state = (uint64_t(shader & ((1 << SHADER_BITS) - 1)) << (MATERIAL_BITS + TEXTURE_BITS + VAO_BITS))
+		| (uint64_t(material & ((1 << MATERIAL_BITS) - 1)) << (TEXTURE_BITS + VAO_BITS))
+		| (uint64_t(texture & ((1 << TEXTURE_BITS) - 1)) << VAO_BITS)
+		| uint64_t(vao & ((1 << VAO_BITS) - 1));
+
+	uint64_t key = uint64_t(pass & 0xf) << PASS_SHIFT;
+	if (transparent) {
+		// blending needs the far draws first, the state only orders draws at the same depth
+		uint64_t inverted = ((1 << DEPTH_BITS) - 1) - depthBits;
+		key |= (uint64_t(1) << TRANSPARENT_SHIFT) | (inverted << (TRANSPARENT_SHIFT - DEPTH_BITS)) | state;
+	}
+	else {
+		key |= (state << DEPTH_BITS) | depthBits;
+	}
+	return key;
+}
+
+unsigned int RenderQueue::getMaterialId(const void* material)
+{
+	if (material == nullptr) return 0;
+	auto it = _materialIds.find(material);
+	if (it != _materialIds.end()) return it->second;
+
+	unsigned int id = (unsigned int)_materialIds.size() + 1;
+	_materialIds[material] = id;
+	return id;
+}
+
+float RenderQueue::getDepth(const glm::mat4& viewProjection, glm::vec3 position)
+{
+	glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+	if (clip.w <= 0.0f) return 0.0f;
+	return clip.z / clip.w * 0.5f + 0.5f;
+}
+
+void RenderQueue::radixSort(std::vector<Item>& items, std::vector<Item>& scratch)
+{
+	size_t count = items.size();
+	if (count < 2) return;
+	scratch.resize(count);
+
+	// all eight histograms in one pass over the keys
+	size_t histograms[8][256] = {};
+	for (const Item& item : items) {
+		for (unsigned int byte = 0; byte < 8; byte++)
+			histograms[byte][(item.key >> (byte * 8)) & 0xff]++;
+	}
+
+	Item* source = items.data();
+	Item* target = scratch.data();
+	for (unsigned int byte = 0; byte < 8; byte++) {
+		size_t* histogram = histograms[byte];
+		unsigned int shift = byte * 8;
+		if (histogram[(source[0].key >> shift) & 0xff] == count) continue;
+
+		size_t offset = 0;
+		for (unsigned int bucket = 0; bucket < 256; bucket++) {
+			size_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (size_t i = 0; i < count; i++)
+			target[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+		std::swap(source, target);
+	}
+
+	if (source != items.data())
+		std::copy(source, source + count, items.data());
+}
+
+void RenderQueue::submit(uint64_t key, Renderable* renderable, unsigned int part)
+{
+	Item item = { key, renderable, part };
+	_items.push_back(item);
+	_sorted = false;
+}
+
+void RenderQueue::clear()
+{
+	if (_items.empty()) return;
+	_items.clear();
+	_sorted = false;
+}
+
+void RenderQueue::sort()
+{
+	if (_sorted) return;
+	radixSort(_items, _scratch);
+	_sorted = true;
+}
+
+void RenderQueue::execute(RenderState& state)
+{
+	for (const Item& item : _items) {
+		state.setBlend(((item.key >> TRANSPARENT_SHIFT) & 1) != 0);
+		item.renderable->drawQueued(state, item.part);
+	}
+	state.finish();
+}
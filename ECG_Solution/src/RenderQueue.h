@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+/*!
+ * GL state of a pass, changed only when the next draw needs something else
+ * Everything drawn between two finish() calls has to go through it, other draws do not see the cached state.
+ */
+class RenderState
+{
+protected:
+	/*!
+	 * Shader replacing the materials, e.g. the depth shader of the shadow pass; nullptr to use the materials
+	 */
+	Shader* _passShader;
+	bool _normalMaps;
+
+	Shader* _shader;
+	const void* _material;
+	GLuint _vao;
+	bool _blend;
+	bool _normalMap;
+
+public:
+	/*!
+	 * Expects blending to be disabled
+	 * @param passShader: shader every draw of the pass uses instead of its material's
+	 * @param normalMaps: if normal mapped objects use their normal maps
+	 */
+	RenderState(Shader* passShader = nullptr, bool normalMaps = false);
+
+	Shader* getPassShader() const { return _passShader; }
+
+	bool useNormalMaps() const { return _normalMaps; }
+
+	/*!
+	 * Uses the shader if it isn't already
+	 */
+	void use(Shader* shader);
+
+	/*!
+	 * Remembers the material whose uniforms and textures are set
+	 * @param material: any object identifying the material and its textures
+	 * @return true if it changed, the caller then sets the uniforms
+	 */
+	bool bindMaterial(const void* material);
+
+	void bindVertexArray(GLuint vao);
+
+	void setBlend(bool blend);
+
+	/*!
+	 * Sets the ifNormal uniform of the current shader
+	 */
+	void setNormalMap(bool normalMap);
+
+	/*!
+	 * Restores the state the constructor expects and unbinds the vertex array
+	 */
+	void finish();
+};
+
+/*!
+ * Something the RenderQueue can draw, e.g. a geometry or one group of a static batch
+ */
+class Renderable
+{
+public:
+	virtual ~Renderable() {}
+
+	/*!
+	 * Draws with the given state, setting only what differs from it
+	 * @param part: the part given to RenderQueue::submit()
+	 */
+	virtual void drawQueued(RenderState& state, unsigned int part) = 0;
+};
+
+/*!
+ * Draws submitted with 64-bit sort keys, radix sorted so that draws sharing shader, material,
+ * texture and vertex array follow each other and state changes are minimal.
+ * Opaque keys: pass(4) | 0 | shader(7) | material(10) | texture(10) | vertex array(8) | depth(24)
+ * Transparent keys: pass(4) | 1 | inverted depth(24) | shader(7) | material(10) | texture(10) | vertex array(8)
+ * Opaque draws go front to back within a state, transparent draws back to front after all opaque ones.
+ * The queue only sorts again after its content changed, so queues of static content sort once.
+ */
+class RenderQueue
+{
+public:
+	enum Pass {
+		SHADOW_PASS = 0,
+		MAIN_PASS = 1
+	};
+
+	struct Item {
+		uint64_t key;
+		Renderable* renderable;
+		unsigned int part;
+	};
+
+protected:
+	std::vector<Item> _items;
+	std::vector<Item> _scratch;
+	bool _sorted;
+
+	/*!
+	 * Small ids for materials, their addresses would not fit into the key
+	 */
+	static std::unordered_map<const void*, unsigned int> _materialIds;
+
+public:
+	RenderQueue();
+
+	/*!
+	 * @param pass: pass the draw belongs to, passes are drawn in ascending order
+	 * @param transparent: if the draw is blended
+	 * @param shader: program handle
+	 * @param material: id from getMaterialId(), 0 for none
+	 * @param texture: handle of the main texture, 0 for none
+	 * @param vao: vertex array handle
+	 * @param depth: 0 at the near plane, 1 at the far plane
+	 */
+	static uint64_t makeKey(unsigned int pass, bool transparent, GLuint shader, unsigned int material, GLuint texture, GLuint vao, float depth);
+
+	/*!
+	 * @return id of the material, ids start at 1 and are never reused
+	 */
+	static unsigned int getMaterialId(const void* material);
+
+	/*!
+	 * @return depth of a point in the view volume, from 0 at the near plane to 1 at the far plane
+	 */
+	static float getDepth(const glm::mat4& viewProjection, glm::vec3 position);
+
+	/*!
+	 * Sorts items by their keys, least significant byte first, bytes all keys share are skipped
+	 * @param items: the items to sort
+	 * @param scratch: buffer of the same size, contents are undefined afterwards
+	 */
+	static void radixSort(std::vector<Item>& items, std::vector<Item>& scratch);
+
+	void submit(uint64_t key, Renderable* renderable, unsigned int part = 0);
+
+	void clear();
+
+	/*!
+	 * Sorts the items if anything was submitted or cleared since the last sort
+	 */
+	void sort();
+
+	/*!
+	 * Draws all items in key order, blending only the transparent ones, and finishes the state
+	 */
+	void execute(RenderState& state);
+
+	size_t size() const { return _items.size(); }
+};
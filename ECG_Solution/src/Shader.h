@@ -92,6 +92,11 @@ public:
 	 */
 	void unuse() const;
 
+	/*!
+	 * @return the program handle
+	 */
+	GLuint getHandle() const { return _handle; }
+
 	/*!
 	 * Sets an integer uniform in the shader
 	 * @param uniform: the name of the uniform
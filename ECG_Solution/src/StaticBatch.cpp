@@ -0,0 +1,320 @@
+#include "StaticBatch.h"
+#include "textures/TextureRegistry.h"
+#include "textures/TextureResidency.h"
+
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+StaticBatch::StaticBatch(VertexFormat format)
+	: _vao(0), _vboVertices(0), _vboIndices(0), _indexType(GL_UNSIGNED_INT), _format(format)
+{
+}
+
+StaticBatch::~StaticBatch()
+{
+	if (_vao == 0) return;
+
+	glDeleteBuffers(1, &_vboVertices);
+	glDeleteBuffers(1, &_vboIndices);
+	glDeleteVertexArrays(1, &_vao);
+}
+
+unsigned int StaticBatch::findGroup(std::shared_ptr<Material> material, const std::vector<MeshTexture>& textures, bool normalMapped)
+{
+	for (unsigned int i = 0; i < _groups.size(); i++) {
+		const Group& group = _groups[i];
+		if (group.material != material || group.normalMapped != normalMapped || group.textures.size() != textures.size())
+			continue;
+
+		bool sameTextures = true;
+		for (size_t t = 0; t < textures.size() && sameTextures; t++)
+			sameTextures = group.textures[t].id == textures[t].id && group.textures[t].type == textures[t].type;
+		if (sameTextures) return i;
+	}
+
+	Group group;
+	group.material = material;
+	group.textures = textures;
+	group.normalMapped = normalMapped;
+	group.pointLightMask = -1;
+	_groups.push_back(group);
+	return (unsigned int)_groups.size() - 1;
+}
+
+// errors of the levels are in object space, the vertices of the batch in world space
+static std::vector<LodIndices> scaleLodErrors(const std::vector<LodIndices>& lods, const glm::mat4& modelMatrix)
+{
+	float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+	std::vector<LodIndices> result = lods;
+	for (LodIndices& lod : result)
+		lod.error *= scale;
+	return result;
+}
+
+void StaticBatch::add(const GeometryData& data, glm::mat4 modelMatrix, std::shared_ptr<Material> material, bool normalMapped)
+{
+	glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(modelMatrix)));
+
+	Entry entry;
+	entry.group = findGroup(material, std::vector<MeshTexture>(), normalMapped);
+	entry.indices = data.indices;
+	entry.lods = scaleLodErrors(data.lods, modelMatrix);
+	entry.uvs = data.uvs;
+	entry.uvs.resize(data.positions.size(), glm::vec2(0.0f));
+
+	// objects never move, so the model matrix is applied once here
+	entry.positions.reserve(data.positions.size());
+	for (const glm::vec3& position : data.positions)
+		entry.positions.push_back(glm::vec3(modelMatrix * glm::vec4(position, 1.0f)));
+
+	entry.normals.reserve(data.positions.size());
+	for (size_t i = 0; i < data.positions.size(); i++)
+		entry.normals.push_back(i < data.normals.size() ? glm::normalize(normalMatrix * data.normals[i]) : glm::vec3(0.0f));
+
+	_entries.push_back(std::move(entry));
+}
+
+void StaticBatch::add(const Mesh& mesh, glm::mat4 modelMatrix, std::shared_ptr<Material> material)
+{
+	glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(modelMatrix)));
+
+	Entry entry;
+	entry.group = findGroup(material, mesh._textures, false);
+	entry.indices = mesh._indices;
+	entry.lods = scaleLodErrors(mesh._lods, modelMatrix);
+
+	entry.positions.reserve(mesh._vertices.size());
+	entry.normals.reserve(mesh._vertices.size());
+	entry.uvs.reserve(mesh._vertices.size());
+	for (const Vertex& vertex : mesh._vertices) {
+		entry.positions.push_back(glm::vec3(modelMatrix * glm::vec4(vertex.Position, 1.0f)));
+		entry.normals.push_back(vertex.Normal == glm::vec3(0.0f) ? vertex.Normal : glm::normalize(normalMatrix * vertex.Normal));
+		entry.uvs.push_back(vertex.TexCoords);
+	}
+
+	_entries.push_back(std::move(entry));
+}
+
+void StaticBatch::build()
+{
+	// 16-bit indices if every object fits them, the base vertex makes them relative to the object
+	_indexType = GL_UNSIGNED_SHORT;
+	size_t vertexCount = 0, indexCount = 0;
+	for (const Entry& entry : _entries) {
+		if (PackedIndices::chooseType(entry.positions.size()) == GL_UNSIGNED_INT)
+			_indexType = GL_UNSIGNED_INT;
+		vertexCount += entry.positions.size();
+		indexCount += entry.indices.size();
+		for (const LodIndices& lod : entry.lods)
+			indexCount += lod.indices.size();
+	}
+
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<unsigned int> indices;
+	positions.reserve(vertexCount);
+	normals.reserve(vertexCount);
+	uvs.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	// objects of the same group are stored next to each other
+	unsigned int indexSize = _indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	std::vector<Bounds> bounds;
+	bounds.reserve(_entries.size());
+	for (unsigned int g = 0; g < _groups.size(); g++) {
+		for (Entry& entry : _entries) {
+			if (entry.group != g) continue;
+
+			// the levels of detail follow the full detail indices of the object
+			Object object;
+			object.lodChain.build(entry.indices, entry.lods, entry.positions.data(), entry.positions.size(), sizeof(glm::vec3));
+			object.firstIndex = (unsigned int)indices.size();
+			object.baseVertex = (GLint)positions.size();
+			object.group = g;
+			object.pointLightMask = -1;
+			object.uvDensity = _groups[g].textures.empty() ? 0.0f : TextureResidency::computeUvDensity(entry.positions.data(), sizeof(glm::vec3), entry.uvs.data(), sizeof(glm::vec2), entry.indices);
+			_objects.push_back(object);
+			bounds.push_back(Bounds::compute(entry.positions.data(), entry.positions.size(), sizeof(glm::vec3)));
+
+			positions.insert(positions.end(), entry.positions.begin(), entry.positions.end());
+			normals.insert(normals.end(), entry.normals.begin(), entry.normals.end());
+			uvs.insert(uvs.end(), entry.uvs.begin(), entry.uvs.end());
+			indices.insert(indices.end(), entry.indices.begin(), entry.indices.end());
+		}
+	}
+	std::vector<Entry>().swap(_entries);
+
+	// static objects, the tree is never refit
+	_bvh.build(bounds);
+
+	if (positions.empty()) return;
+
+	_packedVertices = QuantizedVertices::pack(_format, positions.size(),
+		positions.data(), sizeof(glm::vec3),
+		normals.data(), sizeof(glm::vec3),
+		uvs.data(), sizeof(glm::vec2));
+
+	// the indices are packed with the largest object's vertex count, they stay relative to their object
+	std::vector<unsigned char> indexData(indices.size() * indexSize);
+	if (_indexType == GL_UNSIGNED_SHORT) {
+		for (size_t i = 0; i < indices.size(); i++)
+			((uint16_t*)indexData.data())[i] = (uint16_t)indices[i];
+	}
+	else {
+		memcpy(indexData.data(), indices.data(), indexData.size());
+	}
+
+	glGenVertexArrays(1, &_vao);
+	glBindVertexArray(_vao);
+
+	glGenBuffers(1, &_vboVertices);
+	glBindBuffer(GL_ARRAY_BUFFER, _vboVertices);
+	glBufferData(GL_ARRAY_BUFFER, _packedVertices.data.size(), _packedVertices.data.data(), GL_STATIC_DRAW);
+	std::vector<unsigned char>().swap(_packedVertices.data);
+	_packedVertices.setAttributes();
+
+	glGenBuffers(1, &_vboIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vboIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// groups of imported meshes share the material and sort by their first texture
+	for (unsigned int g = 0; g < _groups.size(); g++) {
+		const Group& group = _groups[g];
+		GLuint texture = group.textures.empty() ? group.material->getTextureHandle() : group.textures[0].id;
+		_queue.submit(RenderQueue::makeKey(RenderQueue::MAIN_PASS, group.material->isTransparent(), group.material->getShader()->getHandle(),
+			RenderQueue::getMaterialId(group.material.get()), texture, _vao, 0.0f), this, g);
+	}
+	_queue.sort();
+}
+
+void StaticBatch::selectLods(const Frustum& frustum, bool requestTextures)
+{
+	unsigned int indexSize = _indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+
+	for (Group& group : _groups) {
+		group.counts.clear();
+		group.offsets.clear();
+		group.baseVertices.clear();
+		group.pointLightMask = 0;
+	}
+	_allCounts.clear();
+	_allOffsets.clear();
+	_allBaseVertices.clear();
+
+	// objects are stored by group, in index order the visible ones of a group stay next to each other
+	_bvh.queryFrustum(frustum, _visible);
+	std::sort(_visible.begin(), _visible.end());
+	for (unsigned int i : _visible) {
+		Object& object = _objects[i];
+
+		// vertices are already in world space
+		const LodRange& range = object.lodChain.select(glm::mat4(1.0f));
+		void* offset = (void*)(size_t(object.firstIndex + range.firstIndex) * indexSize);
+
+		Group& group = _groups[object.group];
+		group.counts.push_back((GLsizei)range.indexCount);
+		group.offsets.push_back(offset);
+		group.baseVertices.push_back(object.baseVertex);
+		group.pointLightMask |= object.pointLightMask;
+		_allCounts.push_back((GLsizei)range.indexCount);
+		_allOffsets.push_back(offset);
+		_allBaseVertices.push_back(object.baseVertex);
+
+		if (requestTextures && !group.textures.empty()) {
+			float pixelsPerUnit = object.lodChain.getPixelsPerUnit(glm::mat4(1.0f));
+			for (const MeshTexture& texture : group.textures)
+				TextureResidency::instance().request(texture.id, pixelsPerUnit, object.uvDensity);
+		}
+	}
+}
+
+void StaticBatch::assignPointLights(const std::vector<std::shared_ptr<PointLight>>& pointLights)
+{
+	for (Object& object : _objects)
+		object.pointLightMask = 0;
+
+	std::vector<unsigned int> inRange;
+	for (unsigned int i = 0; i < pointLights.size() && i < 32; i++) {
+		_bvh.querySphere(pointLights[i]->_position, pointLights[i]->getRadius(), inRange);
+		for (unsigned int object : inRange)
+			_objects[object].pointLightMask |= 1 << i;
+	}
+}
+
+void StaticBatch::draw(bool normalMaps, const Frustum& frustum)
+{
+	if (_vao == 0) return;
+
+	selectLods(frustum, true);
+
+	RenderState state(nullptr, normalMaps);
+	_queue.execute(state);
+}
+
+void StaticBatch::drawQueued(RenderState& state, unsigned int part)
+{
+	Group& group = _groups[part];
+	if (group.counts.empty()) return;
+
+	Shader* shader = group.material->getShader();
+	state.use(shader);
+
+	// vertices are already in world space
+	shader->setUniform("modelMatrix", glm::mat4(1.0f));
+	shader->setUniform("normalMatrix", glm::mat3(1.0f));
+	_packedVertices.setUniforms(shader);
+
+	shader->setUniform("pointLightMask", group.pointLightMask);
+	state.setNormalMap(state.useNormalMaps() && group.normalMapped);
+
+	// mesh groups share their material, their textures tell them apart
+	if (group.textures.empty()) {
+		if (state.bindMaterial(group.material.get())) group.material->setUniforms();
+	}
+	else if (state.bindMaterial(&group)) {
+		// same texture binding as Mesh::Draw, video and atlas layers of the materials drawn before do not apply
+		shader->setUniform("videoLayer", -1);
+		shader->setUniform("atlasLayer", -1);
+		shader->setUniform("atlasNormalLayer", -1);
+		unsigned int diffuseNr = 1;
+		unsigned int specularNr = 1;
+		for (unsigned int i = 0; i < group.textures.size(); i++) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			std::string number;
+			std::string name = group.textures[i].type;
+			if (name == "texture_diffuse")
+				number = std::to_string(diffuseNr++);
+			else if (name == "texture_specular")
+				number = std::to_string(specularNr++);
+			shader->setUniform(("material." + name + number).c_str(), i);
+			glBindTexture(GL_TEXTURE_2D, TextureRegistry::instance().resolve(group.textures[i].id));
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	state.bindVertexArray(_vao);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, group.counts.data(), _indexType, group.offsets.data(), (GLsizei)group.counts.size(), group.baseVertices.data());
+}
+
+void StaticBatch::drawShader(Shader* shader, const Frustum& frustum)
+{
+	if (_vao == 0) return;
+
+	selectLods(frustum, false);
+	if (_allCounts.empty()) return;
+
+	shader->use();
+	shader->setUniform("modelMatrix", glm::mat4(1.0f));
+	shader->setUniform("normalMatrix", glm::mat3(1.0f));
+	_packedVertices.setUniforms(shader);
+
+	glBindVertexArray(_vao);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, _allCounts.data(), _indexType, _allOffsets.data(), (GLsizei)_allCounts.size(), _allBaseVertices.data());
+	glBindVertexArray(0);
+}
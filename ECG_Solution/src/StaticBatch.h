@@ -0,0 +1,192 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Geometry.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Shader.h"
+#include "VertexFormat.h"
+#include "Light.h"
+#include "Bvh.h"
+#include "RenderQueue.h"
+
+/*!
+ * Merges non-moving meshes and geometry into one vertex and one index buffer
+ * Objects are pre-transformed into world space and grouped by material, every
+ * group is drawn with a single glMultiDrawElementsBaseVertex call.
+ * The groups are sorted by their state once in build(), draw() keeps that order.
+ */
+class StaticBatch : public Renderable
+{
+protected:
+	/*!
+	 * Objects drawn with the same material and textures
+	 */
+	struct Group {
+		std::shared_ptr<Material> material;
+		/*!
+		 * Textures of imported meshes, bound like Mesh::Draw does; empty for geometry, which uses the material's textures
+		 */
+		std::vector<MeshTexture> textures;
+		bool normalMapped;
+
+		/*!
+		 * Draw arrays of the objects visible in the current pass
+		 */
+		std::vector<GLsizei> counts;
+		std::vector<void*> offsets;
+		std::vector<GLint> baseVertices;
+		/*!
+		 * Point lights reaching any of the visible objects
+		 */
+		int pointLightMask;
+	};
+
+	/*!
+	 * An object waiting for build()
+	 */
+	struct Entry {
+		unsigned int group;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> uvs;
+		std::vector<unsigned int> indices;
+		/*!
+		 * Levels of detail, errors in world space
+		 */
+		std::vector<LodIndices> lods;
+	};
+
+	/*!
+	 * An object after build(), its level of detail is chosen every frame
+	 */
+	struct Object {
+		LodChain lodChain;
+		/*!
+		 * First index and first vertex of the object in the buffers
+		 */
+		unsigned int firstIndex;
+		GLint baseVertex;
+		unsigned int group;
+		/*!
+		 * Bit i is set if point light i reaches the object
+		 */
+		int pointLightMask;
+		/*!
+		 * Uv units per world space unit, for the mip levels the group textures need
+		 */
+		float uvDensity;
+	};
+
+	GLuint _vao;
+	GLuint _vboVertices;
+	GLuint _vboIndices;
+	GLenum _indexType;
+
+	VertexFormat _format;
+	QuantizedVertices _packedVertices;
+
+	std::vector<Group> _groups;
+	std::vector<Entry> _entries;
+	std::vector<Object> _objects;
+
+	/*!
+	 * Hierarchy over the world space bounds of the objects, built once, and the objects visible in the current pass
+	 */
+	Bvh _bvh;
+	std::vector<unsigned int> _visible;
+
+	/*!
+	 * All visible ranges of all groups, for passes that ignore materials
+	 */
+	std::vector<GLsizei> _allCounts;
+	std::vector<void*> _allOffsets;
+	std::vector<GLint> _allBaseVertices;
+
+	/*!
+	 * One item per group, the content is static so it is only sorted once
+	 */
+	RenderQueue _queue;
+
+	unsigned int findGroup(std::shared_ptr<Material> material, const std::vector<MeshTexture>& textures, bool normalMapped);
+
+	/*!
+	 * Culls the objects and writes the index ranges of the chosen levels of detail of the visible ones into the draw arrays
+	 * Also reports the mip levels the textures of imported meshes need to the TextureResidency
+	 * @param frustum: view frustum of the pass
+	 * @param requestTextures: whether to report the mip levels, only the colour pass samples the textures
+	 */
+	void selectLods(const Frustum& frustum, bool requestTextures);
+
+public:
+	/*!
+	 * @param format: vertex format of the batch buffer
+	 */
+	StaticBatch(VertexFormat format = VertexFormat::getDefault());
+	~StaticBatch();
+
+	StaticBatch(const StaticBatch&) = delete;
+	StaticBatch& operator=(const StaticBatch&) = delete;
+
+	/*!
+	 * Adds procedural geometry
+	 * @param data: the geometry data in object space
+	 * @param modelMatrix: the fixed model matrix of the object
+	 * @param material: material used to draw the object
+	 * @param normalMapped: if the object is drawn with its normal map when normal mapping is on
+	 */
+	void add(const GeometryData& data, glm::mat4 modelMatrix, std::shared_ptr<Material> material, bool normalMapped = false);
+
+	/*!
+	 * Adds an imported mesh, drawn with the shader of the material and the textures of the mesh
+	 * @param mesh: the mesh, its cpu-side vertices and indices are used
+	 * @param modelMatrix: the fixed model matrix of the mesh
+	 * @param material: material providing the shader
+	 */
+	void add(const Mesh& mesh, glm::mat4 modelMatrix, std::shared_ptr<Material> material);
+
+	/*!
+	 * Uploads all added objects, nothing can be added afterwards
+	 */
+	void build();
+
+	/*!
+	 * Finds the objects in range of every point light, draw() only enables those lights for a group
+	 * Has to be called after build() and again whenever the lights change
+	 * @param pointLights: the point lights in shader order, at most 32
+	 */
+	void assignPointLights(const std::vector<std::shared_ptr<PointLight>>& pointLights);
+
+	/*!
+	 * Draws all groups with their materials, groups without visible objects are skipped
+	 * @param normalMaps: if normal mapped groups use their normal maps
+	 * @param frustum: only objects inside are drawn
+	 */
+	void draw(bool normalMaps, const Frustum& frustum = Frustum());
+
+	/*!
+	 * Draws all objects with one call, e.g. for the shadow map
+	 * @param shader: the shader to draw with
+	 * @param frustum: only objects inside are drawn
+	 */
+	void drawShader(Shader* shader, const Frustum& frustum = Frustum());
+
+	/*!
+	 * Draws the visible objects of one group for the queue of draw()
+	 * @param part: index of the group
+	 */
+	virtual void drawQueued(RenderState& state, unsigned int part);
+
+	/*!
+	 * @return number of objects in the batch
+	 */
+	unsigned int getObjectCount() const { return (unsigned int)_objects.size(); }
+
+	/*!
+	 * @return number of draw calls of draw()
+	 */
+	unsigned int getDrawCallCount() const { return (unsigned int)_groups.size(); }
+};
@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+	: _stop(false)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 2;
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+
+	for (std::thread& worker : _workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+unsigned int ThreadPool::getThreadCount() const
+{
+	return (unsigned int)_workers.size();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+
+			// drain the queue before stopping
+			if (_jobs.empty()) return;
+
+			job = std::move(_jobs.front());
+			_jobs.pop();
+		}
+		job();
+	}
+}
+
+void ThreadPool::parallelFor(unsigned int count, const std::function<void(unsigned int)>& job)
+{
+	if (count == 0) return;
+
+	// one task per worker, iterations are handed out through a shared counter
+	// so uneven job sizes (small and large meshes) are balanced automatically
+	std::shared_ptr<std::atomic<unsigned int>> next = std::make_shared<std::atomic<unsigned int>>(0);
+	unsigned int taskCount = count < getThreadCount() ? count : getThreadCount();
+
+	std::vector<std::future<void>> tasks;
+	for (unsigned int t = 0; t < taskCount; t++) {
+		tasks.push_back(submit([next, count, &job]() {
+			for (unsigned int i = (*next)++; i < count; i = (*next)++) {
+				job(i);
+			}
+		}));
+	}
+
+	// wait for all tasks before rethrowing, job is referenced by all of them
+	for (std::future<void>& task : tasks)
+		task.wait();
+	for (std::future<void>& task : tasks)
+		task.get();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/*!
+ * Fixed size pool of worker threads for cpu-only work (no GL calls!)
+ */
+class ThreadPool
+{
+protected:
+	/*!
+	 * Worker threads
+	 */
+	std::vector<std::thread> _workers;
+
+	/*!
+	 * Pending jobs
+	 */
+	std::queue<std::function<void()>> _jobs;
+
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stop;
+
+	void workerLoop();
+
+public:
+	/*!
+	 * Starts the worker threads
+	 * @param threadCount: number of workers, 0 uses one per hardware thread
+	 */
+	ThreadPool(unsigned int threadCount = 0);
+
+	/*!
+	 * Finishes all pending jobs and joins the workers
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/*!
+	 * @return the process-wide pool shared by the loaders
+	 */
+	static ThreadPool& shared();
+
+	/*!
+	 * @return number of worker threads
+	 */
+	unsigned int getThreadCount() const;
+
+	/*!
+	 * Queues a job
+	 * @param job: function to be run on a worker
+	 * @return future for the result of the job
+	 */
+	template<class F>
+	auto submit(F job) -> std::future<decltype(job())>
+	{
+		typedef decltype(job()) Result;
+		std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(job);
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.push([task]() { (*task)(); });
+		}
+		_condition.notify_one();
+		return result;
+	}
+
+	/*!
+	 * Runs job(i) for all i in [0, count) on the workers and waits until all are done
+	 * Exceptions of a job are rethrown on the calling thread
+	 * Must not be called from inside a job, the caller blocks a worker otherwise
+	 * @param count: number of iterations
+	 * @param job: function called with the iteration index
+	 */
+	void parallelFor(unsigned int count, const std::function<void(unsigned int)>& job);
+};
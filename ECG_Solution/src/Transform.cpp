@@ -0,0 +1,59 @@
+#include "Transform.h"
+
+#include <cmath>
+#include <glm/gtc/matrix_inverse.hpp>
+
+// relative tolerance of the similarity test, loose enough for matrices built from float rotations
+static const float SIMILARITY_EPSILON = 1e-4f;
+
+Transform::Transform(const glm::mat4& modelMatrix)
+	: _modelMatrix(modelMatrix), _normalMatrix(1.0f), _dirty(true), _version(0)
+{
+}
+
+void Transform::set(const glm::mat4& modelMatrix)
+{
+	_modelMatrix = modelMatrix;
+	_dirty = true;
+	_version++;
+}
+
+void Transform::apply(const glm::mat4& transformation)
+{
+	set(transformation * _modelMatrix);
+}
+
+const glm::mat3& Transform::getNormalMatrix()
+{
+	if (_dirty) update();
+	return _normalMatrix;
+}
+
+void Transform::update()
+{
+	glm::mat3 matrix(_modelMatrix);
+
+	// for M = sR the inverse transpose is R / s, which is M / s^2
+	if (isSimilarity(matrix)) {
+		float scale2 = glm::dot(matrix[0], matrix[0]);
+		_normalMatrix = scale2 > 0.0f ? matrix * (1.0f / scale2) : matrix;
+	}
+	else {
+		_normalMatrix = glm::inverseTranspose(matrix);
+	}
+	_dirty = false;
+}
+
+bool Transform::isSimilarity(const glm::mat3& matrix)
+{
+	float x2 = glm::dot(matrix[0], matrix[0]);
+	float y2 = glm::dot(matrix[1], matrix[1]);
+	float z2 = glm::dot(matrix[2], matrix[2]);
+	float tolerance = SIMILARITY_EPSILON * x2;
+
+	// equally long, pairwise orthogonal columns
+	return std::abs(x2 - y2) <= tolerance && std::abs(x2 - z2) <= tolerance
+		&& std::abs(glm::dot(matrix[0], matrix[1])) <= tolerance
+		&& std::abs(glm::dot(matrix[0], matrix[2])) <= tolerance
+		&& std::abs(glm::dot(matrix[1], matrix[2])) <= tolerance;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*!
+ * Model matrix of an object with the matrices derived from it
+ * The normal matrix is only recomputed after the model matrix changed, so drawing an object
+ * that doesn't move inverts nothing. Rotations, translations and uniform scales skip the
+ * inverse, their normal matrix is the rotation part divided by the squared scale.
+ */
+class Transform
+{
+protected:
+	glm::mat4 _modelMatrix;
+	glm::mat3 _normalMatrix;
+	/*!
+	 * If the normal matrix is out of date
+	 */
+	bool _dirty;
+	/*!
+	 * Incremented on every change, objects caching values of the transform compare it
+	 */
+	unsigned int _version;
+
+	void update();
+
+public:
+	Transform(const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+	/*!
+	 * Replaces the model matrix
+	 */
+	void set(const glm::mat4& modelMatrix);
+
+	/*!
+	 * Applies a transformation after the current one
+	 */
+	void apply(const glm::mat4& transformation);
+
+	const glm::mat4& getModelMatrix() const { return _modelMatrix; }
+
+	/*!
+	 * @return transpose of the inverse of the upper 3x3 model matrix
+	 */
+	const glm::mat3& getNormalMatrix();
+
+	unsigned int getVersion() const { return _version; }
+
+	/*!
+	 * @return true if the matrix only rotates and scales the same along every axis
+	 */
+	static bool isSimilarity(const glm::mat3& matrix);
+};
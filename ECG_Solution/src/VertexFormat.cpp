@@ -0,0 +1,220 @@
+#include "VertexFormat.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+VertexFormat& VertexFormat::getDefault()
+{
+	static VertexFormat format;
+	return format;
+}
+
+VertexFormat VertexFormat::parse(const std::string& position, const std::string& normal, const std::string& uv)
+{
+	VertexFormat format;
+
+	if (position == "unorm16") format.position = PositionFormat::UNORM16;
+
+	if (normal == "octahedral") format.normal = NormalFormat::OCTAHEDRAL;
+	else if (normal == "int_2_10_10_10") format.normal = NormalFormat::INT_2_10_10_10;
+
+	if (uv == "half") format.uv = UVFormat::HALF;
+	else if (uv == "unorm16") format.uv = UVFormat::UNORM16;
+
+	return format;
+}
+
+unsigned int VertexFormat::getNormalOffset() const
+{
+	// 16-bit positions are padded to keep the following attributes 4 byte aligned
+	return position == PositionFormat::FLOAT ? 12 : 8;
+}
+
+unsigned int VertexFormat::getUVOffset() const
+{
+	return getNormalOffset() + (normal == NormalFormat::FLOAT ? 12 : 4);
+}
+
+unsigned int VertexFormat::getStride() const
+{
+	return getUVOffset() + (uv == UVFormat::FLOAT ? 8 : 4);
+}
+
+bool VertexFormat::isFloat() const
+{
+	return position == PositionFormat::FLOAT && normal == NormalFormat::FLOAT && uv == UVFormat::FLOAT;
+}
+
+GLenum PackedIndices::chooseType(size_t vertexCount)
+{
+	return vertexCount <= MAX_16BIT_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+PackedIndices PackedIndices::pack(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	return pack(indices.data(), indices.size(), vertexCount);
+}
+
+PackedIndices PackedIndices::pack(const unsigned int* indices, size_t count, size_t vertexCount)
+{
+	PackedIndices result;
+	result.type = chooseType(vertexCount);
+	result.count = (unsigned int)count;
+	result.data.resize(count * result.getIndexSize());
+
+	if (result.type == GL_UNSIGNED_INT) {
+		if (count > 0) std::memcpy(result.data.data(), indices, result.data.size());
+	}
+	else {
+		uint16_t* shortIndices = (uint16_t*)result.data.data();
+		for (size_t i = 0; i < count; i++)
+			shortIndices[i] = (uint16_t)indices[i];
+	}
+	return result;
+}
+
+glm::vec2 encodeOctahedral(glm::vec3 normal)
+{
+	float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (length == 0.0f) return glm::vec2(0.0f);
+
+	normal /= length;
+	glm::vec2 encoded(normal.x, normal.y);
+
+	// fold the lower hemisphere over the diagonals
+	if (normal.z < 0.0f) {
+		encoded = glm::vec2(
+			(1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return encoded;
+}
+
+glm::vec3 decodeOctahedral(glm::vec2 encoded)
+{
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	float t = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -t : t;
+	normal.y += normal.y >= 0.0f ? -t : t;
+	return glm::normalize(normal);
+}
+
+QuantizedVertices QuantizedVertices::pack(const VertexFormat& format, size_t count,
+	const glm::vec3* positions, size_t positionStride,
+	const glm::vec3* normals, size_t normalStride,
+	const glm::vec2* uvs, size_t uvStride)
+{
+	QuantizedVertices result;
+	result.format = format;
+	result.stride = format.getStride();
+	result.count = (unsigned int)count;
+	result.data.resize(count * result.stride, 0);
+
+	auto position = [&](size_t i) -> const glm::vec3& { return *(const glm::vec3*)((const char*)positions + i * positionStride); };
+	auto normal = [&](size_t i) -> glm::vec3 { return normals ? *(const glm::vec3*)((const char*)normals + i * normalStride) : glm::vec3(0.0f); };
+	auto uv = [&](size_t i) -> glm::vec2 { return uvs ? *(const glm::vec2*)((const char*)uvs + i * uvStride) : glm::vec2(0.0f); };
+
+	// quantization ranges
+	glm::vec3 positionMin(0.0f), positionExtent(1.0f);
+	if (format.position == PositionFormat::UNORM16 && count > 0) {
+		glm::vec3 positionMax = positionMin = position(0);
+		for (size_t i = 1; i < count; i++) {
+			positionMin = glm::min(positionMin, position(i));
+			positionMax = glm::max(positionMax, position(i));
+		}
+		// flat meshes still need a valid scale
+		positionExtent = glm::max(positionMax - positionMin, glm::vec3(1e-6f));
+		result.positionDequant = glm::scale(glm::translate(glm::mat4(1.0f), positionMin), positionExtent);
+	}
+
+	glm::vec2 uvMin(0.0f), uvExtent(1.0f);
+	if (format.uv == UVFormat::UNORM16 && count > 0) {
+		glm::vec2 uvMax = uvMin = uv(0);
+		for (size_t i = 1; i < count; i++) {
+			uvMin = glm::min(uvMin, uv(i));
+			uvMax = glm::max(uvMax, uv(i));
+		}
+		uvExtent = glm::max(uvMax - uvMin, glm::vec2(1e-6f));
+		result.uvTransform = glm::vec4(uvExtent, uvMin);
+	}
+
+	unsigned int normalOffset = format.getNormalOffset();
+	unsigned int uvOffset = format.getUVOffset();
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned char* vertex = &result.data[i * result.stride];
+
+		if (format.position == PositionFormat::FLOAT) {
+			std::memcpy(vertex, &position(i), 12);
+		}
+		else {
+			glm::uint64 packed = glm::packUnorm4x16(glm::vec4((position(i) - positionMin) / positionExtent, 0.0f));
+			std::memcpy(vertex, &packed, 8);
+		}
+
+		glm::vec3 n = normal(i);
+		if (format.normal == NormalFormat::FLOAT) {
+			std::memcpy(vertex + normalOffset, &n, 12);
+		}
+		else {
+			glm::uint32 packed = format.normal == NormalFormat::OCTAHEDRAL
+				? glm::packSnorm2x16(encodeOctahedral(n))
+				: glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+			std::memcpy(vertex + normalOffset, &packed, 4);
+		}
+
+		glm::vec2 t = uv(i);
+		if (format.uv == UVFormat::FLOAT) {
+			std::memcpy(vertex + uvOffset, &t, 8);
+		}
+		else {
+			glm::uint32 packed = format.uv == UVFormat::HALF
+				? glm::packHalf2x16(t)
+				: glm::packUnorm2x16((t - uvMin) / uvExtent);
+			std::memcpy(vertex + uvOffset, &packed, 4);
+		}
+	}
+
+	return result;
+}
+
+void QuantizedVertices::setAttributes() const
+{
+	// vertex positions
+	glEnableVertexAttribArray(0);
+	if (format.position == PositionFormat::FLOAT)
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	else
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+
+	// vertex normals, octahedral normals only fill xy and are decoded in the shader
+	glEnableVertexAttribArray(1);
+	void* normalOffset = (void*)(size_t)format.getNormalOffset();
+	if (format.normal == NormalFormat::FLOAT)
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, normalOffset);
+	else if (format.normal == NormalFormat::OCTAHEDRAL)
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, normalOffset);
+	else
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, normalOffset);
+
+	// vertex texture coords
+	glEnableVertexAttribArray(2);
+	void* uvOffset = (void*)(size_t)format.getUVOffset();
+	if (format.uv == UVFormat::FLOAT)
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, uvOffset);
+	else if (format.uv == UVFormat::HALF)
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, uvOffset);
+	else
+		glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, uvOffset);
+}
+
+void QuantizedVertices::setUniforms(Shader* shader) const
+{
+	shader->setUniform("positionDequant", positionDequant);
+	shader->setUniform("uvTransform", uvTransform);
+	shader->setUniform("octahedralNormals", format.normal == NormalFormat::OCTAHEDRAL ? 1 : 0);
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+/*!
+ * Encoding of the vertex positions
+ */
+enum class PositionFormat {
+	FLOAT,		// 3 x float, 12 bytes
+	UNORM16		// 3 x unorm16 inside the mesh bounds, 8 bytes (padded)
+};
+
+/*!
+ * Encoding of the vertex normals
+ */
+enum class NormalFormat {
+	FLOAT,		// 3 x float, 12 bytes
+	OCTAHEDRAL,	// 2 x snorm16 octahedral projection, 4 bytes
+	INT_2_10_10_10	// 3 x snorm10 + 2 unused bits, 4 bytes
+};
+
+/*!
+ * Encoding of the vertex UV coordinates
+ */
+enum class UVFormat {
+	FLOAT,		// 2 x float, 8 bytes
+	HALF,		// 2 x half float, 4 bytes
+	UNORM16		// 2 x unorm16 inside the UV bounds, 4 bytes
+};
+
+/*!
+ * Layout of an interleaved vertex buffer
+ */
+struct VertexFormat {
+	PositionFormat position = PositionFormat::FLOAT;
+	NormalFormat normal = NormalFormat::FLOAT;
+	UVFormat uv = UVFormat::FLOAT;
+
+	/*!
+	 * Format used for new meshes and geometry, set from settings.ini
+	 */
+	static VertexFormat& getDefault();
+
+	/*!
+	 * Parses the format names of settings.ini, unknown names fall back to float
+	 * @param position: "float" or "unorm16"
+	 * @param normal: "float", "octahedral" or "int_2_10_10_10"
+	 * @param uv: "float", "half" or "unorm16"
+	 */
+	static VertexFormat parse(const std::string& position, const std::string& normal, const std::string& uv);
+
+	/*!
+	 * @return size of one vertex in bytes
+	 */
+	unsigned int getStride() const;
+
+	/*!
+	 * @return true if all attributes are floats, the layout of a Mesh Vertex
+	 */
+	bool isFloat() const;
+
+	unsigned int getNormalOffset() const;
+	unsigned int getUVOffset() const;
+};
+
+/*!
+ * Interleaved, quantized vertex data and the constants needed to decode it in the vertex shader
+ */
+struct QuantizedVertices {
+	VertexFormat format;
+	unsigned int stride = 0;
+	unsigned int count = 0;
+
+	/*!
+	 * Maps the stored position to the object space position (identity for float positions)
+	 */
+	glm::mat4 positionDequant = glm::mat4(1.0f);
+
+	/*!
+	 * Maps the stored UV to the real UV: uv * xy + zw (identity for float and half UVs)
+	 */
+	glm::vec4 uvTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+	/*!
+	 * Packed vertices, can be freed after the upload
+	 */
+	std::vector<unsigned char> data;
+
+	/*!
+	 * Quantizes the vertex attributes, normals and uvs may be null
+	 * @param format: the target format
+	 * @param count: number of vertices
+	 * @param positions, normals, uvs: first element of every attribute
+	 * @param positionStride, normalStride, uvStride: distance between two elements in bytes
+	 */
+	static QuantizedVertices pack(const VertexFormat& format, size_t count,
+		const glm::vec3* positions, size_t positionStride,
+		const glm::vec3* normals, size_t normalStride,
+		const glm::vec2* uvs, size_t uvStride);
+
+	/*!
+	 * Sets the vertex attribute pointers 0 (position), 1 (normal) and 2 (uv)
+	 * The vertex array and the array buffer holding the data have to be bound
+	 */
+	void setAttributes() const;
+
+	/*!
+	 * Sets the decode uniforms of texture.vert and depth.vert
+	 */
+	void setUniforms(Shader* shader) const;
+
+	/*!
+	 * @return bytes the same vertices take as 32 byte float vertices
+	 */
+	size_t getFloatBytes() const { return size_t(count) * 32; }
+};
+
+/*!
+ * Index buffer in the smallest index type the vertex count allows
+ */
+struct PackedIndices {
+	/*!
+	 * Meshes with up to this many vertices use 16-bit indices
+	 */
+	static const size_t MAX_16BIT_VERTICES = 65536;
+
+	/*!
+	 * GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	 */
+	GLenum type = GL_UNSIGNED_INT;
+	unsigned int count = 0;
+
+	/*!
+	 * Packed indices, can be freed after the upload
+	 */
+	std::vector<unsigned char> data;
+
+	/*!
+	 * @param vertexCount: number of vertices the indices refer to
+	 * @return the smallest index type for the vertex count
+	 */
+	static GLenum chooseType(size_t vertexCount);
+
+	/*!
+	 * Converts the indices to the smallest index type for the vertex count
+	 */
+	static PackedIndices pack(const std::vector<unsigned int>& indices, size_t vertexCount);
+
+	/*!
+	 * Same for indices that are not in a vector, e.g. in a mapped mesh cache
+	 */
+	static PackedIndices pack(const unsigned int* indices, size_t count, size_t vertexCount);
+
+	/*!
+	 * @return size of one index in bytes
+	 */
+	unsigned int getIndexSize() const { return type == GL_UNSIGNED_SHORT ? 2 : 4; }
+};
+
+/*!
+ * Octahedral encoding of a unit vector into [-1, 1]^2
+ */
+glm::vec2 encodeOctahedral(glm::vec3 normal);
+
+/*!
+ * Inverse of encodeOctahedral
+ */
+glm::vec3 decodeOctahedral(glm::vec2 encoded);
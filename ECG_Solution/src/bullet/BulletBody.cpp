@@ -1,10 +1,10 @@
 
 #include "BulletBody.h"
 
-BulletBody::BulletBody(int tag, aiMesh* data, aiMatrix4x4 transformationMatrix, float mass, boolean convex, btDiscreteDynamicsWorld* dynamics_world)
-	: _mass(mass), _convex(convex), _data(data), _tag(tag), _transformationMatrix(transformationMatrix), _dynamics_world(dynamics_world)
+BulletBody::BulletBody(int tag, const CollisionMesh& collision, float mass, boolean convex, btDiscreteDynamicsWorld* dynamics_world)
+	: _mass(mass), _convex(convex), _tag(tag), _transformationMatrix(collision.transformationMatrix), _dynamics_world(dynamics_world)
 {
-	createMeshShapeWithVertices();
+	createMeshShapeWithVertices(collision.positions, collision.indices);
 }
 
 BulletBody::BulletBody(int tag, GeometryData data, float mass, boolean convex, glm::vec3 position, btDiscreteDynamicsWorld* dynamics_world)
@@ -17,7 +17,7 @@ BulletBody::BulletBody(int tag, GeometryData data, float mass, boolean convex, g
 
 BulletBody::BulletBody() {}
 
-void BulletBody::createMeshShapeWithVertices()
+void BulletBody::createMeshShapeWithVertices(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
 {
 	glm::mat4 transform = aiMatrixToMat4(_transformationMatrix);
 
@@ -32,23 +32,26 @@ void BulletBody::createMeshShapeWithVertices()
 	if (_convex) {
 
 		_shape = new btConvexHullShape();
-		for (int i = 0; i < _data->mNumVertices; i++) {
+		for (size_t i = 0; i < positions.size(); i++) {
 
-			btVector3 btv = btVector3(_data->mVertices[i].x, _data->mVertices[i].y, _data->mVertices[i].z);
+			btVector3 btv = btVector3(positions[i].x, positions[i].y, positions[i].z);
 			((btConvexHullShape*)_shape)->addPoint(btv);
 		}
 
 	}
 	else {
-		// gather triangles by grouping vertices from the list of vertices
+		// gather triangles from the index list, the vertices are shared between triangles
 
 		btTriangleMesh* mesh = new btTriangleMesh();
 
-		for (int i = 0; i < _data->mNumVertices; i += 3) {
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
 
-			btVector3 bv1 = btVector3(_data->mVertices[i].x, _data->mVertices[i].y, _data->mVertices[i].z);
-			btVector3 bv2 = btVector3(_data->mVertices[i + 1].x, _data->mVertices[i + 1].y, _data->mVertices[i + 1].z);
-			btVector3 bv3 = btVector3(_data->mVertices[i + 2].x, _data->mVertices[i + 2].y, _data->mVertices[i + 2].z);
+			const glm::vec3& p1 = positions[indices[i]];
+			const glm::vec3& p2 = positions[indices[i + 1]];
+			const glm::vec3& p3 = positions[indices[i + 2]];
+			btVector3 bv1 = btVector3(p1.x, p1.y, p1.z);
+			btVector3 bv2 = btVector3(p2.x, p2.y, p2.z);
+			btVector3 bv3 = btVector3(p3.x, p3.y, p3.z);
 
 			mesh->addTriangle(bv1, bv2, bv3);
 			mesh->setScaling({ scale.x, scale.y, scale.z });
@@ -167,6 +170,20 @@ void BulletBody::destroyBody(btDiscreteDynamicsWorld* dynamics_world) {
 
 }
 
+void BulletBody::deleteBody(btDiscreteDynamicsWorld* dynamics_world) {
+	dynamics_world->removeRigidBody(_body);
+
+	// concave shapes own their triangle mesh
+	if (!_convex)
+		delete ((btBvhTriangleMeshShape*)_shape)->getMeshInterface();
+
+	delete _body->getMotionState();
+	delete _body;
+	delete _shape;
+	_body = nullptr;
+	_shape = nullptr;
+}
+
 glm::mat4 BulletBody::aiMatrixToMat4(const aiMatrix4x4& aiMatrix)
 {
 	glm::mat4 result = glm::mat4();
@@ -46,11 +46,6 @@ class BulletBody
 	*/
 	btCollisionShape* _shape;
 
-	/*!
-	*  data of geometry shape
-	*/
-	aiMesh* _data;
-
 	aiMatrix4x4 _transformationMatrix;
 
 	/*!
@@ -81,13 +76,12 @@ public:
 	/*!
 	* constructor
 	* @param tag: to specifiy the bullet object
-	* @param data: shape data from mesh
+	* @param collision: positions, triangle list and node transformation of the mesh, copied into the shape
 	* @param mass: mass of the body
 	* @param convex: if the shape is convec
-	* @param position: of the body
 	* @param dynamics_world: to add the bodies to the world
 	*/
-	BulletBody(int tag, aiMesh* data, aiMatrix4x4 transformationMatrix, float mass, boolean convex, btDiscreteDynamicsWorld* dynamics_world);
+	BulletBody(int tag, const CollisionMesh& collision, float mass, boolean convex, btDiscreteDynamicsWorld* dynamics_world);
 
 	/*!
 	* constructor
@@ -110,7 +104,7 @@ public:
 	void createShapeWithVertices();
 	//void createShapeWithVertices(float width, float height, float depth);
 
-	void createMeshShapeWithVertices();
+	void createMeshShapeWithVertices(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
 
 	/*!
 	 * Creates Body with mass
@@ -150,4 +144,11 @@ public:
 	*/
 	void BulletBody::destroyBody(btDiscreteDynamicsWorld* dynamics_world);
 
+	/*!
+	* removes the body from the world and frees the rigid body, its motion state and its shape
+	* the bullet body must not be used afterwards
+	* @param dynamics_world : bullet worlds
+	*/
+	void deleteBody(btDiscreteDynamicsWorld* dynamics_world);
+
 };
\ No newline at end of file
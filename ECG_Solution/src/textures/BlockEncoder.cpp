@@ -0,0 +1,612 @@
+#include "BlockEncoder.h"
+#include "../CpuFeatures.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+/* --------------------------------------------- */
+// Helpers
+/* --------------------------------------------- */
+
+// one 4x4 block as float planes (r, g, b, a), pixels row by row
+struct BlockPixels {
+	float channel[4][16];
+};
+
+// per-pixel kernels, all palettes and levels are ordered from the low to the high endpoint
+struct BlockKernels {
+	// nearest of 4 colors for every pixel, returns the squared error of the block
+	float (*nearest4)(const BlockPixels& block, const float palette[4][3], unsigned char levels[16]);
+	// levels by projection onto the endpoint axis, axis is scaled so the high endpoint projects to 3
+	void (*project4)(const BlockPixels& block, const float low[3], const float axis[3], unsigned char levels[16]);
+	// nearest of 8 evenly spaced values for every pixel, returns the squared error of the block
+	float (*quantize8)(const float values[16], float low, float high, unsigned char levels[16]);
+};
+
+// bc1 and bc4 indices of the levels
+static const unsigned char colorIndices[4] = { 1, 3, 2, 0 };
+static const unsigned char channelIndices[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+static float horizontalSum(__m128 v)
+{
+	__m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuffled);
+	shuffled = _mm_movehl_ps(shuffled, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+// stores the lowest byte of 4 32-bit lanes
+static void storeLevels4(__m128i levels, unsigned char* output)
+{
+	__m128i packed = _mm_packs_epi32(levels, levels);
+	packed = _mm_packus_epi16(packed, packed);
+	int bytes = _mm_cvtsi128_si32(packed);
+	std::memcpy(output, &bytes, 4);
+}
+
+/* --------------------------------------------- */
+// SSE kernels
+/* --------------------------------------------- */
+
+static float nearest4Sse(const BlockPixels& block, const float palette[4][3], unsigned char levels[16])
+{
+	__m128 total = _mm_setzero_ps();
+	for (int i = 0; i < 16; i += 4) {
+		__m128 r = _mm_loadu_ps(block.channel[0] + i);
+		__m128 g = _mm_loadu_ps(block.channel[1] + i);
+		__m128 b = _mm_loadu_ps(block.channel[2] + i);
+
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestLevel = _mm_setzero_si128();
+		for (int level = 0; level < 4; level++) {
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[level][0]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[level][1]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[level][2]));
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+			best = _mm_min_ps(distance, best);
+			bestLevel = _mm_or_si128(_mm_andnot_si128(closer, bestLevel), _mm_and_si128(closer, _mm_set1_epi32(level)));
+		}
+
+		total = _mm_add_ps(total, best);
+		storeLevels4(bestLevel, levels + i);
+	}
+	return horizontalSum(total);
+}
+
+static void project4Sse(const BlockPixels& block, const float low[3], const float axis[3], unsigned char levels[16])
+{
+	for (int i = 0; i < 16; i += 4) {
+		__m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block.channel[0] + i), _mm_set1_ps(low[0])), _mm_set1_ps(axis[0]));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block.channel[1] + i), _mm_set1_ps(low[1])), _mm_set1_ps(axis[1])));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block.channel[2] + i), _mm_set1_ps(low[2])), _mm_set1_ps(axis[2])));
+
+		// clamp before rounding, sse2 has no 32-bit integer min/max
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(3.0f));
+		storeLevels4(_mm_cvtps_epi32(t), levels + i);
+	}
+}
+
+static float quantize8Sse(const float values[16], float low, float high, unsigned char levels[16])
+{
+	__m128 scale = _mm_set1_ps(7.0f / (high - low));
+	__m128 step = _mm_set1_ps((high - low) / 7.0f);
+	__m128 base = _mm_set1_ps(low);
+	__m128 total = _mm_setzero_ps();
+
+	for (int i = 0; i < 16; i += 4) {
+		__m128 v = _mm_loadu_ps(values + i);
+		__m128 t = _mm_mul_ps(_mm_sub_ps(v, base), scale);
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(7.0f));
+		__m128i level = _mm_cvtps_epi32(t);
+
+		__m128 error = _mm_sub_ps(v, _mm_add_ps(base, _mm_mul_ps(_mm_cvtepi32_ps(level), step)));
+		total = _mm_add_ps(total, _mm_mul_ps(error, error));
+		storeLevels4(level, levels + i);
+	}
+	return horizontalSum(total);
+}
+
+/* --------------------------------------------- */
+// AVX2 kernels (8 pixels per step)
+/* --------------------------------------------- */
+
+AVX2_FUNCTION static float horizontalSum256(__m256 v)
+{
+	return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+AVX2_FUNCTION static void storeLevels8(__m256i levels, unsigned char* output)
+{
+	__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(levels), _mm256_extracti128_si256(levels, 1));
+	_mm_storel_epi64((__m128i*)output, _mm_packus_epi16(packed, packed));
+}
+
+AVX2_FUNCTION static float nearest4Avx2(const BlockPixels& block, const float palette[4][3], unsigned char levels[16])
+{
+	__m256 total = _mm256_setzero_ps();
+	for (int i = 0; i < 16; i += 8) {
+		__m256 r = _mm256_loadu_ps(block.channel[0] + i);
+		__m256 g = _mm256_loadu_ps(block.channel[1] + i);
+		__m256 b = _mm256_loadu_ps(block.channel[2] + i);
+
+		__m256 best = _mm256_set1_ps(FLT_MAX);
+		__m256i bestLevel = _mm256_setzero_si256();
+		for (int level = 0; level < 4; level++) {
+			__m256 dr = _mm256_sub_ps(r, _mm256_set1_ps(palette[level][0]));
+			__m256 dg = _mm256_sub_ps(g, _mm256_set1_ps(palette[level][1]));
+			__m256 db = _mm256_sub_ps(b, _mm256_set1_ps(palette[level][2]));
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dr, dr), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(db, db));
+
+			__m256i closer = _mm256_castps_si256(_mm256_cmp_ps(distance, best, _CMP_LT_OQ));
+			best = _mm256_min_ps(distance, best);
+			bestLevel = _mm256_blendv_epi8(bestLevel, _mm256_set1_epi32(level), closer);
+		}
+
+		total = _mm256_add_ps(total, best);
+		storeLevels8(bestLevel, levels + i);
+	}
+	return horizontalSum256(total);
+}
+
+AVX2_FUNCTION static void project4Avx2(const BlockPixels& block, const float low[3], const float axis[3], unsigned char levels[16])
+{
+	for (int i = 0; i < 16; i += 8) {
+		__m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(block.channel[0] + i), _mm256_set1_ps(low[0])), _mm256_set1_ps(axis[0]));
+		t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(block.channel[1] + i), _mm256_set1_ps(low[1])), _mm256_set1_ps(axis[1])));
+		t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(block.channel[2] + i), _mm256_set1_ps(low[2])), _mm256_set1_ps(axis[2])));
+
+		t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(3.0f));
+		storeLevels8(_mm256_cvtps_epi32(t), levels + i);
+	}
+}
+
+AVX2_FUNCTION static float quantize8Avx2(const float values[16], float low, float high, unsigned char levels[16])
+{
+	__m256 scale = _mm256_set1_ps(7.0f / (high - low));
+	__m256 step = _mm256_set1_ps((high - low) / 7.0f);
+	__m256 base = _mm256_set1_ps(low);
+	__m256 total = _mm256_setzero_ps();
+
+	for (int i = 0; i < 16; i += 8) {
+		__m256 v = _mm256_loadu_ps(values + i);
+		__m256 t = _mm256_mul_ps(_mm256_sub_ps(v, base), scale);
+		t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(7.0f));
+		__m256i level = _mm256_cvtps_epi32(t);
+
+		__m256 error = _mm256_sub_ps(v, _mm256_add_ps(base, _mm256_mul_ps(_mm256_cvtepi32_ps(level), step)));
+		total = _mm256_add_ps(total, _mm256_mul_ps(error, error));
+		storeLevels8(level, levels + i);
+	}
+	return horizontalSum256(total);
+}
+
+static const BlockKernels sseKernels = { nearest4Sse, project4Sse, quantize8Sse };
+static const BlockKernels avx2Kernels = { nearest4Avx2, project4Avx2, quantize8Avx2 };
+
+bool BlockEncoder::_avx2Enabled = CpuFeatures::hasAvx2();
+
+/* --------------------------------------------- */
+// Color blocks (BC1)
+/* --------------------------------------------- */
+
+// nearest 565 color of a color in [0, 255]
+static uint16_t packColor(const float color[3])
+{
+	int r = std::min(std::max(int(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+	int g = std::min(std::max(int(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+	int b = std::min(std::max(int(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// bounding box of the block, the diagonal follows the sign of the correlation with the widest channel
+static void boundingBoxEndpoints(const BlockPixels& block, float low[3], float high[3])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int c = 0; c < 3; c++) {
+		low[c] = high[c] = block.channel[c][0];
+		for (int i = 0; i < 16; i++) {
+			low[c] = std::min(low[c], block.channel[c][i]);
+			high[c] = std::max(high[c], block.channel[c][i]);
+			mean[c] += block.channel[c][i] / 16.0f;
+		}
+	}
+
+	int widest = 0;
+	for (int c = 1; c < 3; c++)
+		if (high[c] - low[c] > high[widest] - low[widest]) widest = c;
+
+	for (int c = 0; c < 3; c++) {
+		float covariance = 0.0f;
+		for (int i = 0; i < 16; i++)
+			covariance += (block.channel[c][i] - mean[c]) * (block.channel[widest][i] - mean[widest]);
+		if (covariance < 0.0f) std::swap(low[c], high[c]);
+
+		// pull the endpoints in a little, the extremes are usually outliers
+		float inset = (high[c] - low[c]) / 16.0f;
+		low[c] += inset;
+		high[c] -= inset;
+	}
+}
+
+// extremes of the block along the principal axis of its colors
+static void principalAxisEndpoints(const BlockPixels& block, float low[3], float high[3])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int c = 0; c < 3; c++)
+		for (int i = 0; i < 16; i++)
+			mean[c] += block.channel[c][i] / 16.0f;
+
+	float covariance[3][3] = {};
+	for (int i = 0; i < 16; i++) {
+		float d[3] = { block.channel[0][i] - mean[0], block.channel[1][i] - mean[1], block.channel[2][i] - mean[2] };
+		for (int a = 0; a < 3; a++)
+			for (int b = 0; b < 3; b++)
+				covariance[a][b] += d[a] * d[b];
+	}
+
+	// power iteration, converges quickly for the elongated color distributions of most blocks
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[3];
+		for (int a = 0; a < 3; a++)
+			next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (length < 1e-6f) break;
+		for (int a = 0; a < 3; a++) axis[a] = next[a] / length;
+	}
+
+	float minT = FLT_MAX, maxT = -FLT_MAX;
+	for (int i = 0; i < 16; i++) {
+		float t = (block.channel[0][i] - mean[0]) * axis[0] + (block.channel[1][i] - mean[1]) * axis[1] + (block.channel[2][i] - mean[2]) * axis[2];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	for (int c = 0; c < 3; c++) {
+		low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+		high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+	}
+}
+
+// least squares endpoints for fixed levels, false if the levels do not span a line
+static bool refineColorEndpoints(const BlockPixels& block, const unsigned char levels[16], float low[3], float high[3])
+{
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ap[3] = { 0.0f, 0.0f, 0.0f }, bp[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		float b = levels[i] / 3.0f, a = 1.0f - b;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < 3; c++) {
+			ap[c] += a * block.channel[c][i];
+			bp[c] += b * block.channel[c][i];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f) return false;
+
+	for (int c = 0; c < 3; c++) {
+		low[c] = std::min(std::max((bb * ap[c] - ab * bp[c]) / determinant, 0.0f), 255.0f);
+		high[c] = std::min(std::max((aa * bp[c] - ab * ap[c]) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+// levels and error for packed endpoints
+static float evaluateColorEndpoints(const BlockPixels& block, uint16_t packedLow, uint16_t packedHigh, BlockQuality quality, const BlockKernels& kernels, unsigned char levels[16])
+{
+	int low[3], high[3];
+	unpackColor(packedLow, low);
+	unpackColor(packedHigh, high);
+
+	if (quality == BlockQuality::FAST) {
+		float lowF[3], axis[3];
+		float length = 0.0f;
+		for (int c = 0; c < 3; c++) {
+			lowF[c] = float(low[c]);
+			axis[c] = float(high[c] - low[c]);
+			length += axis[c] * axis[c];
+		}
+		for (int c = 0; c < 3; c++)
+			axis[c] = length > 0.0f ? axis[c] * 3.0f / length : 0.0f;
+		kernels.project4(block, lowF, axis, levels);
+		return 0.0f;
+	}
+
+	float palette[4][3];
+	for (int c = 0; c < 3; c++) {
+		palette[0][c] = float(low[c]);
+		palette[1][c] = float((2 * low[c] + high[c]) / 3);
+		palette[2][c] = float((low[c] + 2 * high[c]) / 3);
+		palette[3][c] = float(high[c]);
+	}
+	return kernels.nearest4(block, palette, levels);
+}
+
+static void encodeColorBlock(const BlockPixels& block, BlockQuality quality, const BlockKernels& kernels, unsigned char* output)
+{
+	float low[3], high[3];
+	if (quality == BlockQuality::FAST)
+		boundingBoxEndpoints(block, low, high);
+	else
+		principalAxisEndpoints(block, low, high);
+
+	uint16_t packedLow = packColor(low), packedHigh = packColor(high);
+	unsigned char levels[16];
+	float error = evaluateColorEndpoints(block, packedLow, packedHigh, quality, kernels, levels);
+
+	// refit the endpoints to the chosen levels as long as the error goes down
+	if (quality == BlockQuality::HIGH) {
+		for (int iteration = 0; iteration < 4 && error > 0.0f; iteration++) {
+			if (!refineColorEndpoints(block, levels, low, high)) break;
+
+			uint16_t refinedLow = packColor(low), refinedHigh = packColor(high);
+			if (refinedLow == packedLow && refinedHigh == packedHigh) break;
+
+			unsigned char refinedLevels[16];
+			float refinedError = evaluateColorEndpoints(block, refinedLow, refinedHigh, quality, kernels, refinedLevels);
+			if (refinedError >= error) break;
+
+			packedLow = refinedLow;
+			packedHigh = refinedHigh;
+			error = refinedError;
+			std::memcpy(levels, refinedLevels, 16);
+		}
+	}
+
+	// the four color mode needs color0 > color1, equal colors use index 0 only
+	uint32_t indices = 0;
+	if (packedHigh < packedLow) {
+		std::swap(packedLow, packedHigh);
+		for (int i = 0; i < 16; i++) levels[i] = 3 - levels[i];
+	}
+	if (packedHigh != packedLow) {
+		for (int i = 0; i < 16; i++)
+			indices |= uint32_t(colorIndices[levels[i]]) << (2 * i);
+	}
+
+	output[0] = (unsigned char)(packedHigh & 0xff);
+	output[1] = (unsigned char)(packedHigh >> 8);
+	output[2] = (unsigned char)(packedLow & 0xff);
+	output[3] = (unsigned char)(packedLow >> 8);
+	for (int i = 0; i < 4; i++)
+		output[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+/* --------------------------------------------- */
+// Single channel blocks (BC4, alpha of BC3, channels of BC5)
+/* --------------------------------------------- */
+
+static void encodeChannelBlock(const float values[16], BlockQuality quality, const BlockKernels& kernels, unsigned char* output)
+{
+	float minValue = values[0], maxValue = values[0];
+	for (int i = 1; i < 16; i++) {
+		minValue = std::min(minValue, values[i]);
+		maxValue = std::max(maxValue, values[i]);
+	}
+
+	int low = int(minValue + 0.5f), high = int(maxValue + 0.5f);
+	unsigned char levels[16] = {};
+	float error = 0.0f;
+	if (high > low) {
+		error = kernels.quantize8(values, float(low), float(high), levels);
+
+		// refit the endpoints to the chosen levels as long as the error goes down
+		for (int iteration = 0; quality == BlockQuality::HIGH && iteration < 4 && error > 0.0f; iteration++) {
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f, ap = 0.0f, bp = 0.0f;
+			for (int i = 0; i < 16; i++) {
+				float b = levels[i] / 7.0f, a = 1.0f - b;
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				ap += a * values[i];
+				bp += b * values[i];
+			}
+
+			float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f) break;
+
+			int refinedLow = std::min(std::max(int((bb * ap - ab * bp) / determinant + 0.5f), 0), 255);
+			int refinedHigh = std::min(std::max(int((aa * bp - ab * ap) / determinant + 0.5f), 0), 255);
+			if (refinedHigh <= refinedLow || (refinedLow == low && refinedHigh == high)) break;
+
+			unsigned char refinedLevels[16];
+			float refinedError = kernels.quantize8(values, float(refinedLow), float(refinedHigh), refinedLevels);
+			if (refinedError >= error) break;
+
+			low = refinedLow;
+			high = refinedHigh;
+			error = refinedError;
+			std::memcpy(levels, refinedLevels, 16);
+		}
+	}
+
+	// eight value mode (value0 > value1), a flat block uses index 0 only
+	uint64_t indices = 0;
+	if (high > low) {
+		for (int i = 0; i < 16; i++)
+			indices |= uint64_t(channelIndices[levels[i]]) << (3 * i);
+	}
+
+	output[0] = (unsigned char)high;
+	output[1] = (unsigned char)low;
+	for (int i = 0; i < 6; i++)
+		output[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+/* --------------------------------------------- */
+// Decoding
+/* --------------------------------------------- */
+
+static void decodeColorBlock(const unsigned char* input, unsigned char output[16][4])
+{
+	uint16_t packed0 = uint16_t(input[0] | (input[1] << 8));
+	uint16_t packed1 = uint16_t(input[2] | (input[3] << 8));
+	uint32_t indices = uint32_t(input[4]) | (uint32_t(input[5]) << 8) | (uint32_t(input[6]) << 16) | (uint32_t(input[7]) << 24);
+
+	int palette[4][4];
+	unpackColor(packed0, palette[0]);
+	unpackColor(packed1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		if (packed0 > packed1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	palette[3][3] = packed0 > packed1 ? 255 : 0;
+
+	for (int i = 0; i < 16; i++) {
+		const int* color = palette[(indices >> (2 * i)) & 3];
+		for (int c = 0; c < 4; c++) output[i][c] = (unsigned char)color[c];
+	}
+}
+
+static void decodeChannelBlock(const unsigned char* input, unsigned char output[16][4], int channel)
+{
+	int value0 = input[0], value1 = input[1];
+	int palette[8] = { value0, value1 };
+	for (int i = 2; i < 8; i++) {
+		if (value0 > value1)
+			palette[i] = ((8 - i) * value0 + (i - 1) * value1) / 7;
+		else
+			palette[i] = i < 6 ? ((6 - i) * value0 + (i - 1) * value1) / 5 : (i == 6 ? 0 : 255);
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= uint64_t(input[2 + i]) << (8 * i);
+	for (int i = 0; i < 16; i++)
+		output[i][channel] = (unsigned char)palette[(indices >> (3 * i)) & 7];
+}
+
+/* --------------------------------------------- */
+// BlockEncoder
+/* --------------------------------------------- */
+
+unsigned int BlockEncoder::getBlockSize(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t BlockEncoder::getEncodedSize(BlockFormat format, int width, int height)
+{
+	return size_t((width + 3) / 4) * size_t((height + 3) / 4) * getBlockSize(format);
+}
+
+void BlockEncoder::encodeRows(const unsigned char* rgba, int width, int height, BlockFormat format, BlockQuality quality, int firstRow, int rowCount, unsigned char* output)
+{
+	const BlockKernels& kernels = _avx2Enabled ? avx2Kernels : sseKernels;
+	int blocksX = (width + 3) / 4;
+	unsigned int blockSize = getBlockSize(format);
+
+	BlockPixels block;
+	for (int blockY = firstRow; blockY < firstRow + rowCount; blockY++) {
+		for (int blockX = 0; blockX < blocksX; blockX++) {
+			// pixels outside of the image repeat the last row and column
+			for (int y = 0; y < 4; y++) {
+				int row = std::min(blockY * 4 + y, height - 1);
+				for (int x = 0; x < 4; x++) {
+					int column = std::min(blockX * 4 + x, width - 1);
+					const unsigned char* pixel = rgba + (size_t(row) * width + column) * 4;
+					for (int c = 0; c < 4; c++)
+						block.channel[c][y * 4 + x] = pixel[c];
+				}
+			}
+
+			unsigned char* blockOutput = output + (size_t(blockY) * blocksX + blockX) * blockSize;
+			switch (format) {
+			case BlockFormat::BC1:
+				encodeColorBlock(block, quality, kernels, blockOutput);
+				break;
+			case BlockFormat::BC3:
+				encodeChannelBlock(block.channel[3], quality, kernels, blockOutput);
+				encodeColorBlock(block, quality, kernels, blockOutput + 8);
+				break;
+			case BlockFormat::BC5:
+				encodeChannelBlock(block.channel[0], quality, kernels, blockOutput);
+				encodeChannelBlock(block.channel[1], quality, kernels, blockOutput + 8);
+				break;
+			}
+		}
+	}
+}
+
+std::vector<unsigned char> BlockEncoder::encode(const unsigned char* rgba, int width, int height, BlockFormat format, BlockQuality quality)
+{
+	std::vector<unsigned char> blocks(getEncodedSize(format, width, height));
+	encodeRows(rgba, width, height, format, quality, 0, (height + 3) / 4, blocks.data());
+	return blocks;
+}
+
+std::vector<unsigned char> BlockEncoder::decode(const unsigned char* blocks, int width, int height, BlockFormat format)
+{
+	std::vector<unsigned char> rgba(size_t(width) * size_t(height) * 4);
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned int blockSize = getBlockSize(format);
+
+	unsigned char pixels[16][4];
+	for (int blockY = 0; blockY < blocksY; blockY++) {
+		for (int blockX = 0; blockX < blocksX; blockX++) {
+			const unsigned char* input = blocks + (size_t(blockY) * blocksX + blockX) * blockSize;
+			switch (format) {
+			case BlockFormat::BC1:
+				decodeColorBlock(input, pixels);
+				break;
+			case BlockFormat::BC3:
+				decodeColorBlock(input + 8, pixels);
+				decodeChannelBlock(input, pixels, 3);
+				break;
+			case BlockFormat::BC5:
+				for (int i = 0; i < 16; i++) {
+					pixels[i][2] = 0;
+					pixels[i][3] = 255;
+				}
+				decodeChannelBlock(input, pixels, 0);
+				decodeChannelBlock(input + 8, pixels, 1);
+				break;
+			}
+
+			for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+				for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+					std::memcpy(&rgba[(size_t(blockY * 4 + y) * width + blockX * 4 + x) * 4], pixels[y * 4 + x], 4);
+		}
+	}
+	return rgba;
+}
+
+bool BlockEncoder::isAvx2Enabled()
+{
+	return _avx2Enabled;
+}
+
+void BlockEncoder::setAvx2Enabled(bool enabled)
+{
+	_avx2Enabled = enabled && CpuFeatures::hasAvx2();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * Block compressed formats the encoder can write
+ */
+enum class BlockFormat {
+	BC1,	// rgb, 8 bytes per 4x4 block
+	BC3,	// rgba, bc1 color + bc4 alpha, 16 bytes per block
+	BC5		// two channels (normal map xy), two bc4 blocks, 16 bytes per block
+};
+
+/*!
+ * Speed/quality trade-off of the encoder
+ */
+enum class BlockQuality {
+	FAST,		// bounding box endpoints, indices by projection onto the endpoint axis
+	NORMAL,		// principal axis endpoints, nearest palette entry per pixel
+	HIGH		// like NORMAL, endpoints refined by least squares until the error stops improving
+};
+
+/*!
+ * Encoder for 4x4 block compressed textures (BC1, BC3, BC5)
+ * The per-pixel work (palette search, index quantization, error sums) runs in SSE or AVX2
+ * kernels, AVX2 is used when the cpu supports it. Every block is encoded independently,
+ * so images can be split into rows of blocks and encoded on several threads.
+ */
+class BlockEncoder
+{
+protected:
+	/*!
+	 * Use the AVX2 kernels, initialized from the cpu features
+	 */
+	static bool _avx2Enabled;
+
+public:
+	/*!
+	 * @return bytes of one 4x4 block
+	 */
+	static unsigned int getBlockSize(BlockFormat format);
+
+	/*!
+	 * @return bytes of a whole image in the format
+	 */
+	static size_t getEncodedSize(BlockFormat format, int width, int height);
+
+	/*!
+	 * Encodes rows of blocks of an image, pixels outside of the image repeat the edge
+	 * @param rgba: image with 4 bytes per pixel
+	 * @param width, height: size of the image in pixels
+	 * @param format: block format
+	 * @param quality: speed/quality trade-off
+	 * @param firstRow, rowCount: range of block rows to encode
+	 * @param output: encoded image, the rows are written at their offsets
+	 */
+	static void encodeRows(const unsigned char* rgba, int width, int height, BlockFormat format, BlockQuality quality, int firstRow, int rowCount, unsigned char* output);
+
+	/*!
+	 * Encodes a whole image on the calling thread
+	 * @return the encoded blocks, row by row
+	 */
+	static std::vector<unsigned char> encode(const unsigned char* rgba, int width, int height, BlockFormat format, BlockQuality quality);
+
+	/*!
+	 * Decodes an encoded image, used to measure the quality of the encoder
+	 * Channels that are not stored by the format are 0 (color) or 255 (alpha)
+	 * @return the image with 4 bytes per pixel
+	 */
+	static std::vector<unsigned char> decode(const unsigned char* blocks, int width, int height, BlockFormat format);
+
+	/*!
+	 * @return true if the AVX2 kernels are used
+	 */
+	static bool isAvx2Enabled();
+
+	/*!
+	 * Switches between the AVX2 and the SSE kernels, AVX2 stays off if the cpu lacks it
+	 * @param enabled: true to use AVX2 when available
+	 */
+	static void setAvx2Enabled(bool enabled);
+};
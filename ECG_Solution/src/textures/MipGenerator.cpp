@@ -0,0 +1,356 @@
+#include "MipGenerator.h"
+#include "BlockEncoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define AVX_FUNCTION
+#else
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+
+// half width of the kaiser filter in target pixels and its shape parameter
+static const float KAISER_RADIUS = 3.0f;
+static const float KAISER_ALPHA = 4.0f;
+
+static const float PI = 3.14159265358979f;
+
+MipFilter MipGenerator::_filter = MipFilter::BOX;
+std::vector<std::string> MipGenerator::_cutoutNames;
+
+// weights of the source rows that make up one target row
+struct FilterTaps {
+	int first;
+	std::vector<float> weights;
+};
+
+// sRGB <-> linear conversion tables
+struct SrgbTables {
+	float toLinear[256];
+	// linear value halfway between two codes, quantizing against these is exact
+	float thresholds[255];
+	// first guess of the code for a linear value in steps of 1/4095
+	unsigned char guess[4096];
+
+	SrgbTables()
+	{
+		for (int i = 0; i < 256; i++) {
+			float c = i / 255.0f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 255; i++)
+			thresholds[i] = 0.5f * (toLinear[i] + toLinear[i + 1]);
+		for (int i = 0; i < 4096; i++)
+			guess[i] = (unsigned char)(std::upper_bound(thresholds, thresholds + 255, i / 4095.0f) - thresholds);
+	}
+};
+
+static const SrgbTables& srgbTables()
+{
+	static SrgbTables tables;
+	return tables;
+}
+
+static unsigned char linearToSrgb(float value)
+{
+	const SrgbTables& tables = srgbTables();
+	value = std::min(std::max(value, 0.0f), 1.0f);
+	int code = tables.guess[int(value * 4095.0f)];
+	while (code < 255 && value >= tables.thresholds[code]) code++;
+	while (code > 0 && value < tables.thresholds[code - 1]) code--;
+	return (unsigned char)code;
+}
+
+static unsigned char linearToUnorm(float value)
+{
+	return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// modified bessel function of the first kind, order 0
+static float besselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 20; k++) {
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+// filter weight at a distance in target pixels
+static float filterWeight(MipFilter filter, float x)
+{
+	if (filter == MipFilter::BOX)
+		return x >= -0.5f && x < 0.5f ? 1.0f : 0.0f;
+
+	if (std::abs(x) >= KAISER_RADIUS) return 0.0f;
+	float sinc = x == 0.0f ? 1.0f : std::sin(PI * x) / (PI * x);
+	float t = x / KAISER_RADIUS;
+	return sinc * besselI0(KAISER_ALPHA * std::sqrt(1.0f - t * t)) / besselI0(KAISER_ALPHA);
+}
+
+static std::vector<FilterTaps> computeTaps(int sourceSize, int targetSize, MipFilter filter)
+{
+	float scale = float(sourceSize) / float(targetSize);
+	float radius = (filter == MipFilter::BOX ? 0.5f : KAISER_RADIUS) * scale;
+
+	std::vector<FilterTaps> taps(targetSize);
+	for (int i = 0; i < targetSize; i++) {
+		float center = (i + 0.5f) * scale;
+		int first = (int)std::floor(center - radius);
+		int last = (int)std::ceil(center + radius);
+
+		FilterTaps& tap = taps[i];
+		float sum = 0.0f;
+		for (int j = first; j < last; j++) {
+			float weight = filterWeight(filter, (j + 0.5f - center) / scale);
+			tap.weights.push_back(weight);
+			sum += weight;
+		}
+
+		// drop zero weights at both ends
+		size_t begin = 0, end = tap.weights.size();
+		while (begin < end && tap.weights[begin] == 0.0f) begin++;
+		while (end > begin && tap.weights[end - 1] == 0.0f) end--;
+		tap.weights = std::vector<float>(tap.weights.begin() + begin, tap.weights.begin() + end);
+		tap.first = first + (int)begin;
+
+		for (float& weight : tap.weights) weight /= sum;
+	}
+	return taps;
+}
+
+// target += weight * source over one row
+static void accumulateRowSse(float* target, const float* source, float weight, int width)
+{
+	__m128 w = _mm_set1_ps(weight);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+		_mm_storeu_ps(target + x, _mm_add_ps(_mm_loadu_ps(target + x), _mm_mul_ps(w, _mm_loadu_ps(source + x))));
+	for (; x < width; x++)
+		target[x] += weight * source[x];
+}
+
+AVX_FUNCTION static void accumulateRowAvx(float* target, const float* source, float weight, int width)
+{
+	__m256 w = _mm256_set1_ps(weight);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+		_mm256_storeu_ps(target + x, _mm256_add_ps(_mm256_loadu_ps(target + x), _mm256_mul_ps(w, _mm256_loadu_ps(source + x))));
+	for (; x < width; x++)
+		target[x] += weight * source[x];
+}
+
+// filters the columns of a plane, every target row is a weighted sum of whole source rows
+static void filterColumns(const float* source, int width, int sourceHeight, const std::vector<FilterTaps>& taps, float* target)
+{
+	// the avx kernels are enabled together with the avx2 kernels of the block encoder
+	void (*accumulateRow)(float*, const float*, float, int) = BlockEncoder::isAvx2Enabled() ? accumulateRowAvx : accumulateRowSse;
+
+	for (size_t i = 0; i < taps.size(); i++) {
+		float* row = target + i * width;
+		std::fill(row, row + width, 0.0f);
+
+		const FilterTaps& tap = taps[i];
+		for (size_t k = 0; k < tap.weights.size(); k++) {
+			int sourceRow = ((tap.first + (int)k) % sourceHeight + sourceHeight) % sourceHeight;
+			accumulateRow(row, source + size_t(sourceRow) * width, tap.weights[k], width);
+		}
+	}
+}
+
+// target (height x width) = transposed source (width x height)
+static void transpose(const float* source, int width, int height, float* target)
+{
+	int x = 0, y = 0;
+	for (y = 0; y + 4 <= height; y += 4) {
+		for (x = 0; x + 4 <= width; x += 4) {
+			__m128 row0 = _mm_loadu_ps(source + size_t(y) * width + x);
+			__m128 row1 = _mm_loadu_ps(source + size_t(y + 1) * width + x);
+			__m128 row2 = _mm_loadu_ps(source + size_t(y + 2) * width + x);
+			__m128 row3 = _mm_loadu_ps(source + size_t(y + 3) * width + x);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			_mm_storeu_ps(target + size_t(x) * height + y, row0);
+			_mm_storeu_ps(target + size_t(x + 1) * height + y, row1);
+			_mm_storeu_ps(target + size_t(x + 2) * height + y, row2);
+			_mm_storeu_ps(target + size_t(x + 3) * height + y, row3);
+		}
+		for (; x < width; x++)
+			for (int i = 0; i < 4; i++)
+				target[size_t(x) * height + y + i] = source[size_t(y + i) * width + x];
+	}
+	for (; y < height; y++)
+		for (x = 0; x < width; x++)
+			target[size_t(x) * height + y] = source[size_t(y) * width + x];
+}
+
+// one plane to the next level: columns, transpose, columns of the transposed plane, transpose back
+static std::vector<float> downsample(const std::vector<float>& source, int width, int height, int targetWidth, int targetHeight,
+	const std::vector<FilterTaps>& rowTaps, const std::vector<FilterTaps>& columnTaps)
+{
+	std::vector<float> columns(size_t(width) * targetHeight);
+	filterColumns(source.data(), width, height, rowTaps, columns.data());
+
+	std::vector<float> transposed(columns.size());
+	transpose(columns.data(), width, targetHeight, transposed.data());
+
+	std::vector<float> filtered(size_t(targetHeight) * targetWidth);
+	filterColumns(transposed.data(), targetHeight, width, columnTaps, filtered.data());
+
+	std::vector<float> target(filtered.size());
+	transpose(filtered.data(), targetHeight, targetWidth, target.data());
+	return target;
+}
+
+// fraction of the pixels that pass the alpha test after scaling alpha
+static float alphaCoverage(const std::vector<float>& alpha, float cutoff, float scale)
+{
+	size_t passed = 0;
+	for (float a : alpha)
+		if (a * scale >= cutoff) passed++;
+	return alpha.empty() ? 0.0f : float(passed) / float(alpha.size());
+}
+
+// alpha scale that restores the coverage of level 0
+static float findCoverageScale(const std::vector<float>& alpha, float cutoff, float coverage)
+{
+	float low = 0.0f, high = 4.0f;
+	for (int i = 0; i < 12; i++) {
+		float middle = 0.5f * (low + high);
+		if (alphaCoverage(alpha, cutoff, middle) < coverage)
+			low = middle;
+		else
+			high = middle;
+	}
+	return high;
+}
+
+MipFilter MipGenerator::parseFilter(const std::string& filter)
+{
+	if (filter == "kaiser") return MipFilter::KAISER;
+	return MipFilter::BOX;
+}
+
+MipSettings MipGenerator::getSettings(const std::string& path)
+{
+	std::string name = path;
+	for (char& c : name) c = (char)std::tolower((unsigned char)c);
+
+	MipSettings settings;
+	settings.filter = _filter;
+	if (name.find("_normal") != std::string::npos) {
+		settings.srgb = false;
+		settings.normalMap = true;
+	}
+	else {
+		for (const std::string& cutout : _cutoutNames) {
+			if (name.size() >= cutout.size() && name.compare(name.size() - cutout.size(), cutout.size(), cutout) == 0)
+				settings.alphaCutoff = 0.5f;
+		}
+	}
+	return settings;
+}
+
+unsigned int MipGenerator::getLevelCount(int width, int height)
+{
+	unsigned int levels = 1;
+	while (width > 1 || height > 1) {
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+		levels++;
+	}
+	return levels;
+}
+
+std::vector<MipLevel> MipGenerator::generate(const unsigned char* pixels, int width, int height, int channels, const MipSettings& settings)
+{
+	std::vector<MipLevel> levels;
+	if (!pixels || channels < 1 || channels > 4) return levels;
+
+	const SrgbTables& tables = srgbTables();
+	bool hasAlpha = channels == 2 || channels == 4;
+	int colorChannels = hasAlpha ? channels - 1 : channels;
+	bool normalMap = settings.normalMap && colorChannels >= 3;
+	bool keepCoverage = hasAlpha && settings.alphaCutoff > 0.0f;
+
+	// level 0 as float planes, color in linear space
+	std::vector<std::vector<float>> planes(channels, std::vector<float>(size_t(width) * height));
+	for (size_t p = 0; p < size_t(width) * height; p++) {
+		for (int c = 0; c < channels; c++) {
+			unsigned char value = pixels[p * channels + c];
+			planes[c][p] = c < colorChannels && settings.srgb && !normalMap ? tables.toLinear[value] : value / 255.0f;
+		}
+	}
+
+	// an image that passes the test everywhere has nothing to preserve
+	float coverage = keepCoverage ? alphaCoverage(planes[channels - 1], settings.alphaCutoff, 1.0f) : 0.0f;
+	if (coverage >= 1.0f) keepCoverage = false;
+
+	while (width > 1 || height > 1) {
+		int targetWidth = std::max(width / 2, 1);
+		int targetHeight = std::max(height / 2, 1);
+		std::vector<FilterTaps> rowTaps = computeTaps(height, targetHeight, settings.filter);
+		std::vector<FilterTaps> columnTaps = computeTaps(width, targetWidth, settings.filter);
+
+		for (std::vector<float>& plane : planes)
+			plane = downsample(plane, width, height, targetWidth, targetHeight, rowTaps, columnTaps);
+		width = targetWidth;
+		height = targetHeight;
+
+		size_t pixelCount = size_t(width) * height;
+		if (normalMap) {
+			for (size_t p = 0; p < pixelCount; p++) {
+				float x = planes[0][p] * 2.0f - 1.0f, y = planes[1][p] * 2.0f - 1.0f, z = planes[2][p] * 2.0f - 1.0f;
+				float length = std::sqrt(x * x + y * y + z * z);
+				if (length > 0.0f) {
+					planes[0][p] = x / length * 0.5f + 0.5f;
+					planes[1][p] = y / length * 0.5f + 0.5f;
+					planes[2][p] = z / length * 0.5f + 0.5f;
+				}
+			}
+		}
+
+		// the scale only goes into this level, the next level is filtered from the unscaled alpha
+		float alphaScale = keepCoverage ? findCoverageScale(planes[channels - 1], settings.alphaCutoff, coverage) : 1.0f;
+
+		MipLevel level;
+		level.width = width;
+		level.height = height;
+		level.pixels.resize(pixelCount * channels);
+		for (size_t p = 0; p < pixelCount; p++) {
+			for (int c = 0; c < channels; c++) {
+				float value = planes[c][p];
+				if (c < colorChannels)
+					level.pixels[p * channels + c] = settings.srgb && !normalMap ? linearToSrgb(value) : linearToUnorm(value);
+				else
+					// fully opaque texels stay opaque, the scale only moves the edges
+					level.pixels[p * channels + c] = linearToUnorm(value >= 1.0f ? value : value * alphaScale);
+			}
+		}
+		levels.push_back(std::move(level));
+	}
+	return levels;
+}
+
+void MipGenerator::setFilter(MipFilter filter)
+{
+	_filter = filter;
+}
+
+void MipGenerator::setCutoutNames(const std::string& names)
+{
+	_cutoutNames.clear();
+	size_t start = 0;
+	while (start <= names.size()) {
+		size_t end = std::min(names.find(',', start), names.size());
+		std::string name = names.substr(start, end - start);
+		name.erase(0, name.find_first_not_of(" \t"));
+		name.erase(name.find_last_not_of(" \t") + 1);
+		for (char& c : name) c = (char)std::tolower((unsigned char)c);
+		if (!name.empty()) _cutoutNames.push_back(name);
+		start = end + 1;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*!
+ * Downsampling filter of the mip chain
+ */
+enum class MipFilter {
+	BOX,	// average of the covered pixels, 2x2 for power of two sizes
+	KAISER	// kaiser windowed sinc, sharper, may ring slightly at hard edges
+};
+
+/*!
+ * How the channels of an image are filtered
+ */
+struct MipSettings {
+	MipFilter filter = MipFilter::BOX;
+	/*!
+	 * Color channels are sRGB encoded and filtered in linear space, alpha is always linear
+	 */
+	bool srgb = true;
+	/*!
+	 * The first three channels are a unit vector in [0, 1] encoding and renormalized on every level
+	 */
+	bool normalMap = false;
+	/*!
+	 * Alpha test threshold whose coverage is kept on every level, 0 filters alpha plainly
+	 */
+	float alphaCutoff = 0.0f;
+};
+
+/*!
+ * One level of a mip chain, channels interleaved like the source image
+ */
+struct MipLevel {
+	int width, height;
+	std::vector<unsigned char> pixels;
+};
+
+/*!
+ * Builds mip chains on the cpu
+ * The image is converted to one float plane per channel, every level is filtered from the
+ * previous one with a separable filter: columns are filtered with SSE/AVX over whole rows,
+ * the plane is transposed (4x4 SSE blocks) and filtered again. Addressing wraps around like
+ * GL_REPEAT. 1 to 4 channels are supported, 2 and 4 channel images have alpha last.
+ */
+class MipGenerator
+{
+protected:
+	static MipFilter _filter;
+	/*!
+	 * Lower case file names of the alpha tested images
+	 */
+	static std::vector<std::string> _cutoutNames;
+
+public:
+	/*!
+	 * @param filter: "box" or "kaiser"
+	 * @return the filter, BOX for unknown names
+	 */
+	static MipFilter parseFilter(const std::string& filter);
+
+	/*!
+	 * Default settings for an image file: normal maps ("_normal" in the name) are linear and
+	 * renormalized, all other images are sRGB. Cut-out images (see setCutoutNames()) keep
+	 * their alpha test coverage, the alpha of all others is filtered plainly.
+	 * @param path: path of the image
+	 */
+	static MipSettings getSettings(const std::string& path);
+
+	/*!
+	 * @return number of levels of a full chain including level 0
+	 */
+	static unsigned int getLevelCount(int width, int height);
+
+	/*!
+	 * Generates the levels below level 0, down to 1x1
+	 * @param pixels: level 0, rows tightly packed
+	 * @param width, height: size of level 0
+	 * @param channels: 1 to 4
+	 * @param settings: filter and channel interpretation
+	 * @return levels 1 to n
+	 */
+	static std::vector<MipLevel> generate(const unsigned char* pixels, int width, int height, int channels, const MipSettings& settings);
+
+	/*!
+	 * @param filter: filter used by getSettings()
+	 */
+	static void setFilter(MipFilter filter);
+
+	/*!
+	 * @param names: comma separated file names of the images drawn with an alpha test, e.g. "smiley.png"
+	 */
+	static void setCutoutNames(const std::string& names);
+};
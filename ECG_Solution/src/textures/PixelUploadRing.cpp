@@ -0,0 +1,95 @@
+#include "PixelUploadRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+PixelUploadRing::PixelUploadRing(size_t slotSize, unsigned int slotCount)
+	: _buffer(0), _slotSize(slotSize), _slotCount(std::max(slotCount, 1u)), _next(0), _fences(_slotCount, nullptr), _mapped(nullptr)
+{
+	GLsizeiptr size = GLsizeiptr(_slotSize * _slotCount);
+
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+	if (GLEW_ARB_buffer_storage) {
+		// mapped once for the lifetime of the buffer, coherent so no explicit flushes are needed
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+		_mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelUploadRing::~PixelUploadRing()
+{
+	for (GLsync fence : _fences)
+		if (fence) glDeleteSync(fence);
+
+	if (_mapped) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &_buffer);
+}
+
+bool PixelUploadRing::isReady()
+{
+	GLsync& fence = _fences[_next];
+	if (!fence) return true;
+
+	// timeout 0 only polls the fence
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		_stats.busy++;
+		return false;
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+	return true;
+}
+
+bool PixelUploadRing::upload(GLuint texture, int width, int height, GLenum format, GLenum type, const void* pixels, size_t size)
+{
+	if (size > _slotSize) return false;
+	if (!isReady()) return false;
+
+	auto start = std::chrono::steady_clock::now();
+	size_t offset = _next * _slotSize;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+	if (_mapped) {
+		std::memcpy(_mapped + offset, pixels, size);
+	}
+	else {
+		// the fence already guarantees the gpu is done with this slot
+		void* slot = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (slot) {
+			std::memcpy(slot, pixels, size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+	}
+	auto copied = std::chrono::steady_clock::now();
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, (const void*)offset);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	_fences[_next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_next = (_next + 1) % _slotCount;
+
+	auto submitted = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> copyTime = copied - start;
+	std::chrono::duration<double, std::milli> submitTime = submitted - copied;
+	_stats.uploads++;
+	_stats.copyMs += copyTime.count();
+	_stats.submitMs += submitTime.count();
+	_stats.maxMs = std::max(_stats.maxMs, copyTime.count() + submitTime.count());
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+
+/*!
+ * Timing counters of a PixelUploadRing, times in milliseconds on the cpu
+ */
+struct PixelUploadStats {
+	unsigned int uploads = 0;
+	/*!
+	 * Uploads that were postponed because every slot was still read by the gpu
+	 */
+	unsigned int busy = 0;
+	/*!
+	 * Time spent copying pixels into the mapped buffer
+	 */
+	double copyMs = 0.0;
+	/*!
+	 * Time spent issuing glTexSubImage2D and the fence
+	 */
+	double submitMs = 0.0;
+	double maxMs = 0.0;
+};
+
+/*!
+ * Uploads images into a texture through a ring of pixel buffer slots
+ * Every slot is guarded by a fence, a slot is only written again after the gpu has finished
+ * reading it. If no slot is free the upload is postponed instead of waiting, so the render
+ * thread never stalls. With GL 4.4 / ARB_buffer_storage the buffer stays persistently mapped,
+ * otherwise each slot is mapped unsynchronized for the copy.
+ */
+class PixelUploadRing
+{
+protected:
+	GLuint _buffer;
+	size_t _slotSize;
+	unsigned int _slotCount;
+	unsigned int _next;
+	std::vector<GLsync> _fences;
+
+	/*!
+	 * Persistent mapping of the whole buffer, null without ARB_buffer_storage
+	 */
+	unsigned char* _mapped;
+
+	PixelUploadStats _stats;
+
+public:
+	/*!
+	 * @param slotSize: bytes of the largest image
+	 * @param slotCount: number of slots, 2 for double and 3 for triple buffering
+	 */
+	PixelUploadRing(size_t slotSize, unsigned int slotCount = 3);
+
+	~PixelUploadRing();
+
+	PixelUploadRing(const PixelUploadRing&) = delete;
+	PixelUploadRing& operator=(const PixelUploadRing&) = delete;
+
+	/*!
+	 * @return true if the next slot can be written without waiting for the gpu, counted as busy otherwise
+	 */
+	bool isReady();
+
+	/*!
+	 * Copies an image into the next slot and uploads it into level 0 of a texture
+	 * @param texture: texture with immutable storage of the image size
+	 * @param width, height: size of the image in pixels
+	 * @param format, type: pixel format of the image, e.g. GL_RGB and GL_UNSIGNED_BYTE
+	 * @param pixels: image data, rows tightly packed
+	 * @param size: bytes of the image, at most the slot size
+	 * @return false if no slot was free, nothing is uploaded then
+	 */
+	bool upload(GLuint texture, int width, int height, GLenum format, GLenum type, const void* pixels, size_t size);
+
+	const PixelUploadStats& getStats() const { return _stats; }
+
+	void resetStats() { _stats = PixelUploadStats(); }
+};
@@ -1,98 +1,43 @@
 
 #include "Texture.h"
+#include "TextureRegistry.h"
 
+#include <algorithm>
 
-Texture::Texture(std::string file, GLuint depthMap, string type) : _init(true), _depthMap(depthMap), _type(type) {
-
-	if (_type == "dds") {
-		DDSImage image = loadDDS(file.c_str());
-
-		glGenTextures(1, &_handle);
-		glBindTexture(GL_TEXTURE_2D, _handle);
-
-		glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
-			image.width, image.height, 0, image.size, image.data);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-
-	if (_type == "image") {
-		// load image
-		int nrChannels;
-		unsigned char* data = stbi_load(file.c_str(), &_width, &_height, &nrChannels, 0);
-
-		// generate texture
-		glGenTextures(1, &_handle);
-		glBindTexture(GL_TEXTURE_2D, _handle);
 
-		// set the texture wrapping/filtering options (on the currently bound texture object)
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+Texture::Texture(std::string file, GLuint depthMap, string type) : _init(true), _depthMap(depthMap), _type(type) {
 
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _width, _height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
-		else
+	if (_type == "image" || _type == "dds") {
+		// shared with all other users of the same image, .ktx/.dds files keep their block format and mip levels
+		_handle = TextureRegistry::instance().acquire(file);
+		if (_handle == 0)
 		{
 			std::cout << "Failed to load texture" << std::endl;
 		}
-
-		// free image memory
-		stbi_image_free(data);
 	}
 
 	if (type == "video") {
 
-		// load images	
-		_width = 500;
-		_height = 226;
-
-		// get number of frames
-		unsigned first = file.find("_");
-		unsigned last = file.find(".");
-		std::string filepre = file.substr(0, first+1);
-		std::string filepost = file.substr(last);
-
-		std::string frameNumber = file.substr(first+1, last - first -1);
-		_frameNumber = std::stoi(frameNumber);
-
-		for (int i = 0; i <= _frameNumber; i++) {
-			
-			std::string path;
-			path.append(filepre);
-
-			// create string of file
-			if (i < 10) {
-				path.append("0");
-			} 
-			// create string of file
-			if (i < 100 && _frameNumber > 100) {
-				path.append("0");
-			}
-			path.append(std::to_string(i));
-			path.append(filepost);
-
-			// std::cout << path << std::endl;
-
-			// load file to data structure
-			int width, height, nrChannels;
-
-			stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis
-			_imageData[i] = stbi_load(path.c_str(), &_width, &_height, &nrChannels, 0);
-			stbi_set_flip_vertically_on_load(false); // set it right for other textures
-			if (!_imageData[i])
-			{
-				std::cout << "Texture failed to load at path: " << path << std::endl;
-			}
+		ImageSequence sequence;
+		int channels;
+		_width = _height = 0;
+		if (sequence.parse(file) && stbi_info(sequence.getFramePath(0).c_str(), &_width, &_height, &channels)
+			&& VideoArray::fitsBudget(sequence, _width, _height)) {
+
+			// short clips are uploaded once, playback only selects the layer
+			_videoArray.reset(new VideoArray(sequence, _width, _height, 30.0));
+			_handle = _videoArray->getHandle();
+			std::cout << "video " << file << ": texture array, " << sequence.frameCount << " frames, "
+				<< _videoArray->getBytes() / (1024 * 1024) << " MB" << std::endl;
+			return;
 		}
+		std::cout << "video " << file << ": streamed" << std::endl;
+
+		// only the first frame is decoded here, the others follow on a worker a few frames ahead
+		_video.reset(new VideoSource(file, 30.0));
+		_width = _video->getWidth();
+		_height = _video->getHeight();
+
 		// generate texture
 		glGenTextures(1, &_handle);
 		glBindTexture(GL_TEXTURE_2D, _handle);
@@ -103,15 +48,56 @@ Texture::Texture(std::string file, GLuint depthMap, string type) : _init(true),
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _width, _height, 0, GL_RGB, GL_UNSIGNED_BYTE, _imageData[_index]);
+		// immutable storage, frames only replace the contents
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, std::max(_width, 1), std::max(_height, 1));
+		if (_video->getPixels()) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, GL_RGB, GL_UNSIGNED_BYTE, _video->getPixels());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+			// triple buffered, the gpu reads one slot while the next frames are copied into the others
+			_uploadRing.reset(new PixelUploadRing(size_t(_width) * size_t(_height) * 3, 3));
+			_videoFramePending = false;
+		}
 	}
 	
 }
 
+Texture::Texture(std::shared_ptr<TextureAtlas> atlas, std::string file, GLuint depthMap)
+	: _init(true), _handle(0), _depthMap(depthMap), _normalMap(0), _type("atlas"), _width(0), _height(0)
+{
+	if (atlas) _region = atlas->getRegion(file);
+
+	if (_region.isValid()) {
+		_atlas = atlas;
+		_handle = atlas->getHandle();
+	}
+	else {
+		_type = "image";
+		_handle = TextureRegistry::instance().acquire(file);
+		if (_handle == 0)
+		{
+			std::cout << "Failed to load texture" << std::endl;
+		}
+	}
+}
+
 void Texture::bind(unsigned int unit) {
 
+	if (_atlas) {
+		// unit 0 keeps whatever is bound, the shader reads the layer of the atlas
+		_atlas->bind(ATLAS_UNIT);
+		glActiveTexture(GL_TEXTURE1 + unit);
+		glBindTexture(GL_TEXTURE_2D, _depthMap);
+		return;
+	}
+
 	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, _handle);
+	glBindTexture(GL_TEXTURE_2D, _videoArray ? 0 : TextureRegistry::instance().resolve(_handle));
+	if (_videoArray) {
+		glActiveTexture(GL_TEXTURE0 + VIDEO_ARRAY_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	}
 
 	glActiveTexture(GL_TEXTURE1 + unit);
 	glBindTexture(GL_TEXTURE_2D, _depthMap);
@@ -119,11 +105,10 @@ void Texture::bind(unsigned int unit) {
 
 void Texture::bindNormal(unsigned int unit) {
 
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, _handle);
+	bind(unit);
 
-	glActiveTexture(GL_TEXTURE1 + unit);
-	glBindTexture(GL_TEXTURE_2D, _depthMap);
+	// a normal map in the atlas is covered by the atlas binding
+	if (_normalRegion.isValid()) return;
 
 	glActiveTexture(GL_TEXTURE2 + unit);
 	glBindTexture(GL_TEXTURE_2D, _normalMap);
@@ -133,12 +118,22 @@ void Texture::setNormalMap(GLuint normalMap) {
 	_normalMap = normalMap;
 }
 
+void Texture::setNormalMap(const Texture& normalMap) {
+	_normalMap = normalMap._handle;
+	_normalRegion = _atlas && normalMap._atlas == _atlas ? normalMap._region : AtlasRegion();
+}
+
 GLuint Texture::getHandle() {
 	return _handle;
 }
 
 Texture::~Texture()
 {
+	if ((_type == "image" || _type == "dds") && _handle != 0)
+		TextureRegistry::instance().release(_handle);
+	// the texture array deletes its own handle
+	if (_type == "video" && !_videoArray)
+		glDeleteTextures(1, &_handle);
 }
 
 Texture::Texture()
@@ -147,23 +142,34 @@ Texture::Texture()
 
 void Texture::updateVideo(double dt)
 {
-	if (!_init) return;
+	if (_videoArray) {
+		_videoArray->update(dt);
+		return;
+	}
+	if (!_uploadRing) return;
 
-	_time += dt;
-	if (_time > _frameRate) {
-		_time -= _frameRate;
+	// the clock runs every frame, while the gpu still reads every slot only the upload waits instead of stalling the render thread
+	if (_video->advance(dt)) _videoFramePending = true;
+	if (!_videoFramePending || !_uploadRing->isReady()) return;
+	_videoFramePending = false;
 
-		// activate texture 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, _handle);
+	// activate texture 
+	glActiveTexture(GL_TEXTURE0);
+	_uploadRing->upload(_handle, _width, _height, GL_RGB, GL_UNSIGNED_BYTE, _video->getPixels(), size_t(_width) * size_t(_height) * 3);
+}
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _width, _height, 0, GL_RGB, GL_UNSIGNED_BYTE, _imageData[_index]);
-		// glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, _imageData[_index]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+const PixelUploadStats* Texture::getUploadStats() const
+{
+	return _uploadRing ? &_uploadRing->getStats() : nullptr;
+}
 
-		_index = (_index + 1) % _frameNumber;
-	}
+void Texture::setVisible(bool visible)
+{
+	if (_video) _video->setPaused(!visible);
+	if (_videoArray) _videoArray->setPaused(!visible);
+}
+
+int Texture::getVideoLayer() const
+{
+	return _videoArray ? _videoArray->getLayer() : -1;
 }
\ No newline at end of file
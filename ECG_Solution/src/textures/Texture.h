@@ -7,8 +7,13 @@
 
 #include "stb_image.h"
 #include <string>
+#include <memory>
 #include <GL/glew.h>
 #include "../Utils.h"
+#include "VideoSource.h"
+#include "VideoArray.h"
+#include "TextureAtlas.h"
+#include "PixelUploadRing.h"
 
 /*!
  * 2D texture
@@ -25,21 +30,41 @@ protected:
 	string _type;
 	int _width, _height;
 
-	// for video
-	int _frameNumber;
-	unsigned char* _imageData[999];
-
-	double _frameRate = 1 / 30.;
-	double _time = 0;
-	int _index = 0;
+	// for video, frames are decoded in the background
+	std::unique_ptr<VideoSource> _video;
+	std::unique_ptr<PixelUploadRing> _uploadRing;
+	// a frame the video advanced to while the ring was busy, uploaded once a slot is free
+	bool _videoFramePending;
+	// short videos are preloaded into a texture array instead
+	std::unique_ptr<VideoArray> _videoArray;
 
+	// images packed into a texture array are addressed by layer and rect instead of a handle
+	std::shared_ptr<TextureAtlas> _atlas;
+	AtlasRegion _region;
+	AtlasRegion _normalRegion;
 
 public:
+	/*!
+	 * Texture unit of the video texture array, the shader samples it as videoTexture
+	 */
+	static const unsigned int VIDEO_ARRAY_UNIT = 3;
+
+	/*!
+	 * Texture unit of the material atlas, the shader samples it as atlasTexture
+	 */
+	static const unsigned int ATLAS_UNIT = 4;
+
 	/*!
 	 * Creates a texture from a file
 	 */
 	Texture(std::string file, GLuint depthMap, string type);
 
+	/*!
+	 * Creates a texture from an image packed into an atlas
+	 * Falls back to a separate image texture if there is no atlas or the image is not in it
+	 */
+	Texture(std::shared_ptr<TextureAtlas> atlas, std::string file, GLuint depthMap);
+
 	Texture();
 
 	~Texture();
@@ -56,6 +81,37 @@ public:
 
 	void setNormalMap(GLuint normalMap);
 
+	/*!
+	 * Uses the image of another texture as normal map, by region if both are in the same atlas
+	 */
+	void setNormalMap(const Texture& normalMap);
+
 	void updateVideo(double dt);
 
+	/*!
+	 * Pauses a video while nothing showing it is on screen
+	 * @param visible: true if the texture is visible this frame
+	 */
+	void setVisible(bool visible);
+
+	/*!
+	 * @return upload timing of a video texture, null for other textures
+	 */
+	const PixelUploadStats* getUploadStats() const;
+
+	/*!
+	 * @return layer of the current frame of a video texture array, -1 for other textures
+	 */
+	int getVideoLayer() const;
+
+	/*!
+	 * @return region of the image in the atlas, invalid for other textures
+	 */
+	const AtlasRegion& getAtlasRegion() const { return _region; }
+
+	/*!
+	 * @return region of the normal map in the atlas, invalid if it is a separate texture
+	 */
+	const AtlasRegion& getAtlasNormalRegion() const { return _normalRegion; }
+
 };
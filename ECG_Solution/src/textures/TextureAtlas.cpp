@@ -0,0 +1,231 @@
+#include "TextureAtlas.h"
+#include "TextureRegistry.h"
+#include "MipGenerator.h"
+#include "../ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stb_image.h>
+
+GLuint TextureAtlas::_bound = 0;
+
+static bool sameSettings(const MipSettings& a, const MipSettings& b)
+{
+	return a.filter == b.filter && a.srgb == b.srgb && a.normalMap == b.normalMap && a.alphaCutoff == b.alphaCutoff;
+}
+
+TextureAtlas::TextureAtlas(int pageSize, int padding)
+	: _pageSize(pageSize), _padding(std::max(padding, 1)), _handle(0), _layerCount(0)
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	if (_bound == _handle) _bound = 0;
+	if (_handle != 0) glDeleteTextures(1, &_handle);
+}
+
+void TextureAtlas::add(const std::string& path)
+{
+	std::string canonical = TextureRegistry::canonicalPath(path);
+	if (_byPath.find(canonical) != _byPath.end()) return;
+
+	Image image;
+	image.path = path;
+	image.width = image.height = 0;
+	image.x = image.y = 0;
+	_byPath[canonical] = (unsigned int)_images.size();
+	_images.push_back(image);
+}
+
+void TextureAtlas::pack()
+{
+	std::vector<unsigned int> atlasImages;
+	_layerCount = 0;
+
+	for (unsigned int i = 0; i < _images.size(); i++) {
+		Image& image = _images[i];
+		if (image.pixels.empty()) continue;
+
+		if (image.width == _pageSize && image.height == _pageSize) {
+			// a whole layer, all mip levels are its own
+			image.region.layer = _layerCount++;
+			image.region.rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+			image.region.maxLod = std::log2(float(_pageSize));
+		}
+		else if (image.width + 2 * _padding <= _pageSize && image.height + 2 * _padding <= _pageSize) {
+			atlasImages.push_back(i);
+		}
+		else {
+			std::cout << "TextureAtlas: " << image.path << " is larger than a page, kept as separate texture" << std::endl;
+		}
+	}
+
+	// shelf packing, tallest images first so every shelf is as high as its first image
+	std::stable_sort(atlasImages.begin(), atlasImages.end(), [this](unsigned int a, unsigned int b) {
+		return _images[a].height > _images[b].height;
+	});
+
+	// the bilinear footprint of mip level l is 2^(l+1) texels wide, it has to stay inside the border
+	float atlasMaxLod = std::max(std::log2(float(_padding)) - 1.0f, 0.0f);
+	int layer = -1;
+	int shelfX = 0, shelfY = 0, shelfHeight = 0;
+	for (unsigned int i : atlasImages) {
+		Image& image = _images[i];
+		int width = image.width + 2 * _padding;
+		int height = image.height + 2 * _padding;
+
+		if (layer < 0 || shelfX + width > _pageSize) {
+			shelfY += shelfHeight;
+			shelfX = 0;
+			shelfHeight = height;
+			if (layer < 0 || shelfY + height > _pageSize) {
+				layer = _layerCount++;
+				shelfY = 0;
+			}
+		}
+
+		image.x = shelfX + _padding;
+		image.y = shelfY + _padding;
+		shelfX += width;
+
+		float size = float(_pageSize);
+		image.region.layer = layer;
+		image.region.rect = glm::vec4(image.x / size, image.y / size, image.width / size, image.height / size);
+		image.region.maxLod = atlasMaxLod;
+	}
+}
+
+void TextureAtlas::blit(const Image& image, std::vector<unsigned char>& layer, int padding) const
+{
+	// the border wraps around, so repeating uvs filter across the edge like GL_REPEAT
+	for (int y = -padding; y < image.height + padding; y++) {
+		int srcY = (y + image.height) % image.height;
+		unsigned char* dst = &layer[(size_t(image.y + y) * _pageSize + image.x) * 4];
+		const unsigned char* src = &image.pixels[size_t(srcY) * image.width * 4];
+		for (int x = -padding; x < image.width + padding; x++) {
+			int srcX = (x + image.width) % image.width;
+			std::copy(src + srcX * 4, src + srcX * 4 + 4, dst + x * 4);
+		}
+	}
+}
+
+void TextureAtlas::build()
+{
+	// decode all images in parallel, the gl calls stay on this thread
+	ThreadPool::shared().parallelFor((unsigned int)_images.size(), [this](unsigned int i) {
+		Image& image = _images[i];
+		int channels;
+		unsigned char* pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &channels, 4);
+		if (!pixels) {
+			std::cout << "Texture failed to load at path: " << image.path << std::endl;
+			return;
+		}
+		image.pixels.assign(pixels, pixels + size_t(image.width) * size_t(image.height) * 4);
+		stbi_image_free(pixels);
+	});
+
+	pack();
+
+	if (_handle != 0) {
+		if (_bound == _handle) _bound = 0;
+		glDeleteTextures(1, &_handle);
+		_handle = 0;
+	}
+	if (_layerCount == 0) return;
+
+	// compose the layers and their mip chains on the workers
+	std::vector<std::vector<unsigned char>> layers(_layerCount);
+	std::vector<std::vector<MipLevel>> mips(_layerCount);
+	ThreadPool::shared().parallelFor(_layerCount, [&](unsigned int layer) {
+		layers[layer].assign(size_t(_pageSize) * size_t(_pageSize) * 4, 0);
+
+		std::vector<const Image*> layerImages;
+		for (const Image& image : _images) {
+			if (image.region.layer != (int)layer) continue;
+			// a whole layer has no room for a border, the sampler wraps it anyway
+			bool wholeLayer = image.width == _pageSize && image.height == _pageSize;
+			blit(image, layers[layer], wholeLayer ? 0 : _padding);
+			layerImages.push_back(&image);
+		}
+
+		// every image is filtered with its own settings: the layer is filtered once per distinct
+		// settings and each image copies its block, border included, from the matching chain
+		std::vector<MipSettings> chainSettings;
+		std::vector<std::vector<MipLevel>> chains;
+		for (const Image* image : layerImages) {
+			MipSettings settings = MipGenerator::getSettings(image->path);
+			size_t chain = 0;
+			while (chain < chainSettings.size() && !sameSettings(chainSettings[chain], settings)) chain++;
+			if (chain == chainSettings.size()) {
+				chainSettings.push_back(settings);
+				chains.push_back(MipGenerator::generate(layers[layer].data(), _pageSize, _pageSize, 4, settings));
+			}
+			if (chain == 0) continue;
+
+			bool wholeLayer = image->width == _pageSize && image->height == _pageSize;
+			int padding = wholeLayer ? 0 : _padding;
+			for (size_t l = 0; l < chains[0].size(); l++) {
+				MipLevel& target = chains[0][l];
+				const MipLevel& source = chains[chain][l];
+				int shift = int(l) + 1;
+				int x0 = (image->x - padding) >> shift, y0 = (image->y - padding) >> shift;
+				int x1 = std::min((image->x + image->width + padding + (1 << shift) - 1) >> shift, target.width);
+				int y1 = std::min((image->y + image->height + padding + (1 << shift) - 1) >> shift, target.height);
+				for (int y = y0; y < y1; y++) {
+					size_t row = (size_t(y) * target.width + x0) * 4;
+					std::copy(source.pixels.begin() + row, source.pixels.begin() + row + size_t(x1 - x0) * 4, target.pixels.begin() + row);
+				}
+			}
+		}
+		if (!chains.empty()) mips[layer] = std::move(chains[0]);
+	});
+
+	int levels = (int)MipGenerator::getLevelCount(_pageSize, _pageSize);
+	glGenTextures(1, &_handle);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, _pageSize, _pageSize, _layerCount);
+
+	for (unsigned int layer = 0; layer < _layerCount; layer++) {
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, _pageSize, _pageSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, layers[layer].data());
+		for (size_t l = 0; l < mips[layer].size() && int(l + 1) < levels; l++) {
+			const MipLevel& level = mips[layer][l];
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(l + 1), 0, 0, layer, level.width, level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, level.pixels.data());
+		}
+	}
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	// the unbind may have hit the atlas unit
+	_bound = 0;
+
+	// the gpu has its copy
+	for (Image& image : _images)
+		std::vector<unsigned char>().swap(image.pixels);
+}
+
+AtlasRegion TextureAtlas::getRegion(const std::string& path) const
+{
+	auto found = _byPath.find(TextureRegistry::canonicalPath(path));
+	if (found == _byPath.end()) return AtlasRegion();
+	return _images[found->second].region;
+}
+
+void TextureAtlas::bind(unsigned int unit) const
+{
+	if (_bound == _handle) return;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	_bound = _handle;
+}
+
+size_t TextureAtlas::getBytes() const
+{
+	size_t bytes = 0;
+	for (int size = _pageSize; size > 0; size /= 2)
+		bytes += size_t(size) * size_t(size) * 4;
+	return bytes * _layerCount;
+}
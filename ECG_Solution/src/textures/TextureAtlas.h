@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*!
+ * Place of an image inside a TextureAtlas
+ */
+struct AtlasRegion {
+	/*!
+	 * Layer of the texture array, -1 if the image is not in the atlas
+	 */
+	int layer = -1;
+	/*!
+	 * xy = offset, zw = size of the image in the layer in uv units
+	 */
+	glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	/*!
+	 * Coarsest mip level that does not mix in neighbouring images
+	 */
+	float maxLod = 0.0f;
+
+	bool isValid() const { return layer >= 0; }
+};
+
+/*!
+ * Packs images into the layers of one GL_TEXTURE_2D_ARRAY
+ * Images of exactly the page size get a layer of their own, smaller images share atlas
+ * layers (shelf packing) and are addressed through a uv rect. The border around an atlas
+ * image repeats the opposite edge, so it can still tile with fract(uv) in the shader.
+ * Images larger than a page are not packed, their region stays invalid. The mip levels of
+ * every image are filtered with its own MipGenerator settings, also in a shared layer.
+ * The images are decoded on load and stored as uncompressed RGBA8, KTX/DDS files are not used.
+ */
+class TextureAtlas
+{
+protected:
+	struct Image {
+		std::string path;
+		int width, height;
+		std::vector<unsigned char> pixels;
+		AtlasRegion region;
+		int x, y;
+	};
+
+	int _pageSize;
+	int _padding;
+	GLuint _handle;
+	unsigned int _layerCount;
+	std::vector<Image> _images;
+	std::unordered_map<std::string, unsigned int> _byPath;
+
+	/*!
+	 * Array bound to the atlas unit, to skip redundant binds
+	 */
+	static GLuint _bound;
+
+	/*!
+	 * Assigns layers and positions to all decoded images
+	 */
+	void pack();
+
+	/*!
+	 * Copies an image with its wrapped border into a layer
+	 * @param padding: width of the border, 0 for images that fill the whole layer
+	 */
+	void blit(const Image& image, std::vector<unsigned char>& layer, int padding) const;
+
+public:
+	/*!
+	 * @param pageSize: width and height of a layer, should be a power of two
+	 * @param padding: border around atlas images, limits their mip levels to log2(padding)
+	 */
+	TextureAtlas(int pageSize = 1024, int padding = 8);
+
+	~TextureAtlas();
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	/*!
+	 * Queues an image for the next build(), the same path is only packed once
+	 * @param path: path to the image file
+	 */
+	void add(const std::string& path);
+
+	/*!
+	 * Decodes the queued images and builds the mip chains of the layers on the thread pool,
+	 * then packs and uploads them
+	 */
+	void build();
+
+	/*!
+	 * @return region of an image, invalid if it was not added or did not fit
+	 */
+	AtlasRegion getRegion(const std::string& path) const;
+
+	/*!
+	 * Binds the array to a texture unit, nothing happens if it is already bound there
+	 * Only the atlas may use this unit
+	 */
+	void bind(unsigned int unit) const;
+
+	GLuint getHandle() const { return _handle; }
+
+	unsigned int getLayerCount() const { return _layerCount; }
+
+	/*!
+	 * @return gpu memory of the array including all mip levels
+	 */
+	size_t getBytes() const;
+};
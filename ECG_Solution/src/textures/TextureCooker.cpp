@@ -0,0 +1,292 @@
+#include "TextureCooker.h"
+#include "MipGenerator.h"
+#include "../ThreadPool.h"
+#include "../Utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sys/stat.h>
+#include <stb_image.h>
+#include <gli/gli.hpp>
+
+// rows of blocks encoded by one job, small enough to balance the workers on the last images
+static const int ROWS_PER_JOB = 8;
+
+struct CookLevel {
+	int width, height;
+	std::vector<unsigned char> rgba;
+	std::vector<unsigned char> blocks;
+};
+
+struct CookImage {
+	std::string path;
+	BlockFormat format;
+	std::vector<CookLevel> levels;
+};
+
+struct CookJob {
+	unsigned int image;
+	unsigned int level;
+	int firstRow;
+	int rowCount;
+};
+
+//modification time of a file, 0 if it does not exist
+static long long fileTime(const std::string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return 0;
+	return (long long)info.st_mtime;
+}
+
+static std::string toLower(std::string text)
+{
+	for (char& c : text) c = (char)std::tolower((unsigned char)c);
+	return text;
+}
+
+static const char* formatName(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1: return "BC1";
+	case BlockFormat::BC3: return "BC3";
+	default: return "BC5";
+	}
+}
+
+static const char* qualityName(BlockQuality quality)
+{
+	switch (quality) {
+	case BlockQuality::FAST: return "fast";
+	case BlockQuality::NORMAL: return "normal";
+	default: return "high";
+	}
+}
+
+static gli::format gliFormat(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1: return gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+	case BlockFormat::BC3: return gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+	default: return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+	}
+}
+
+// decodes all images on the thread pool, images that fail to load are left out
+static std::vector<CookImage> loadImages(const std::vector<std::string>& paths, bool mipmaps)
+{
+	std::vector<CookImage> images(paths.size());
+	std::vector<char> loaded(paths.size(), 0);
+
+	ThreadPool::shared().parallelFor((unsigned int)paths.size(), [&](unsigned int i) {
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(paths[i].c_str(), &width, &height, &channels, 4);
+		if (!pixels) return;
+
+		CookImage& image = images[i];
+		image.path = paths[i];
+		image.levels.resize(1);
+		image.levels[0].width = width;
+		image.levels[0].height = height;
+		image.levels[0].rgba.assign(pixels, pixels + size_t(width) * size_t(height) * 4);
+		stbi_image_free(pixels);
+
+		image.format = TextureCooker::chooseFormat(image.path, image.levels[0].rgba.data(), size_t(width) * size_t(height));
+		if (mipmaps) {
+			// alpha coverage only matters where alpha is stored
+			MipSettings settings = MipGenerator::getSettings(image.path);
+			if (image.format != BlockFormat::BC3) settings.alphaCutoff = 0.0f;
+
+			for (MipLevel& mip : MipGenerator::generate(image.levels[0].rgba.data(), width, height, 4, settings)) {
+				CookLevel level;
+				level.width = mip.width;
+				level.height = mip.height;
+				level.rgba = std::move(mip.pixels);
+				image.levels.push_back(std::move(level));
+			}
+		}
+		loaded[i] = 1;
+	});
+
+	std::vector<CookImage> result;
+	for (size_t i = 0; i < paths.size(); i++) {
+		if (loaded[i]) result.push_back(std::move(images[i]));
+		else std::cout << "ERROR::TEXTURECOOKER::failed to load " << paths[i] << std::endl;
+	}
+	return result;
+}
+
+// encodes all levels of all images with their format, one parallel loop over rows of blocks
+static void encodeImages(std::vector<CookImage>& images, BlockQuality quality)
+{
+	std::vector<CookJob> jobs;
+	for (unsigned int i = 0; i < images.size(); i++) {
+		for (unsigned int l = 0; l < images[i].levels.size(); l++) {
+			CookLevel& level = images[i].levels[l];
+			level.blocks.resize(BlockEncoder::getEncodedSize(images[i].format, level.width, level.height));
+
+			int rows = (level.height + 3) / 4;
+			for (int row = 0; row < rows; row += ROWS_PER_JOB)
+				jobs.push_back({ i, l, row, std::min(ROWS_PER_JOB, rows - row) });
+		}
+	}
+
+	ThreadPool::shared().parallelFor((unsigned int)jobs.size(), [&](unsigned int j) {
+		const CookJob& job = jobs[j];
+		CookImage& image = images[job.image];
+		CookLevel& level = image.levels[job.level];
+		BlockEncoder::encodeRows(level.rgba.data(), level.width, level.height, image.format, quality, job.firstRow, job.rowCount, level.blocks.data());
+	});
+}
+
+// psnr of the channels stored by the format, computed on the first level
+static double computePSNR(const CookImage& image)
+{
+	const CookLevel& level = image.levels[0];
+	std::vector<unsigned char> decoded = BlockEncoder::decode(level.blocks.data(), level.width, level.height, image.format);
+
+	int channels = image.format == BlockFormat::BC1 ? 3 : (image.format == BlockFormat::BC3 ? 4 : 2);
+	double squaredError = 0.0;
+	for (size_t p = 0; p < size_t(level.width) * size_t(level.height); p++) {
+		for (int c = 0; c < channels; c++) {
+			double difference = double(level.rgba[p * 4 + c]) - double(decoded[p * 4 + c]);
+			squaredError += difference * difference;
+		}
+	}
+
+	double meanError = squaredError / (double(level.width) * double(level.height) * channels);
+	return meanError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanError) : 99.99;
+}
+
+BlockQuality TextureCooker::parseQuality(const std::string& quality)
+{
+	if (quality == "fast") return BlockQuality::FAST;
+	if (quality == "high") return BlockQuality::HIGH;
+	return BlockQuality::NORMAL;
+}
+
+std::string TextureCooker::getOutputPath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) return path + ".ktx";
+	return path.substr(0, dot) + ".ktx";
+}
+
+BlockFormat TextureCooker::chooseFormat(const std::string& path, const unsigned char* rgba, size_t pixelCount)
+{
+	if (toLower(path).find("_normal") != std::string::npos) return BlockFormat::BC5;
+
+	for (size_t i = 0; i < pixelCount; i++)
+		if (rgba[i * 4 + 3] < 255) return BlockFormat::BC3;
+	return BlockFormat::BC1;
+}
+
+std::vector<std::string> TextureCooker::listImages(const std::string& directory)
+{
+	std::vector<std::string> paths;
+
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return paths;
+
+	do {
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+
+		std::string name = toLower(data.cFileName);
+		size_t dot = name.find_last_of('.');
+		std::string extension = dot == std::string::npos ? "" : name.substr(dot + 1);
+		if (extension == "jpg" || extension == "jpeg" || extension == "png")
+			paths.push_back(directory + "/" + data.cFileName);
+	} while (FindNextFileA(find, &data));
+
+	FindClose(find);
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+unsigned int TextureCooker::cook(const std::vector<std::string>& paths, BlockQuality quality, bool force)
+{
+	std::vector<std::string> outdated;
+	for (const std::string& path : paths) {
+		long long outputTime = fileTime(getOutputPath(path));
+		if (force || outputTime == 0 || outputTime < fileTime(path))
+			outdated.push_back(path);
+	}
+	if (outdated.empty()) return 0;
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<CookImage> images = loadImages(outdated, true);
+	encodeImages(images, quality);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	unsigned int written = 0;
+	double pixels = 0.0;
+	for (const CookImage& image : images) {
+		gli::texture2d texture(gliFormat(image.format), gli::texture2d::extent_type(image.levels[0].width, image.levels[0].height), image.levels.size());
+		for (size_t l = 0; l < image.levels.size(); l++) {
+			const CookLevel& level = image.levels[l];
+			std::memcpy(texture.data(0, 0, l), level.blocks.data(), std::min(texture.size(l), level.blocks.size()));
+			pixels += double(level.width) * double(level.height);
+		}
+
+		std::string output = getOutputPath(image.path);
+		if (!gli::save_ktx(texture, output)) {
+			std::cout << "ERROR::TEXTURECOOKER::failed to write " << output << std::endl;
+			continue;
+		}
+		std::cout << "cooked " << output << " (" << formatName(image.format) << ", " << image.levels.size() << " levels, " << texture.size() / 1024 << " KB)" << std::endl;
+		written++;
+	}
+
+	std::cout << "cooked " << written << " textures in " << elapsed.count() << " s (" << pixels / elapsed.count() / 1e6 << " MPixels/s, "
+		<< qualityName(quality) << " quality, " << (BlockEncoder::isAvx2Enabled() ? "avx2" : "sse") << ")" << std::endl;
+	return written;
+}
+
+void TextureCooker::benchmark(const std::vector<std::string>& paths)
+{
+	std::vector<CookImage> images = loadImages(paths, false);
+	if (images.empty()) return;
+
+	double pixels = 0.0;
+	for (const CookImage& image : images)
+		pixels += double(image.levels[0].width) * double(image.levels[0].height);
+
+	std::cout << "texture benchmark: " << images.size() << " images, " << std::fixed << std::setprecision(2) << pixels / 1e6
+		<< " MPixels, " << ThreadPool::shared().getThreadCount() << " threads" << std::endl;
+	std::cout << "format  quality  kernels     MPix/s   PSNR (dB)" << std::endl;
+
+	bool avx2 = BlockEncoder::isAvx2Enabled();
+	const BlockFormat formats[] = { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5 };
+	const BlockQuality qualities[] = { BlockQuality::FAST, BlockQuality::NORMAL, BlockQuality::HIGH };
+
+	for (BlockFormat format : formats) {
+		for (CookImage& image : images) image.format = format;
+
+		for (BlockQuality quality : qualities) {
+			for (int kernels = 0; kernels < (avx2 ? 2 : 1); kernels++) {
+				BlockEncoder::setAvx2Enabled(kernels == 1);
+
+				auto start = std::chrono::steady_clock::now();
+				encodeImages(images, quality);
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+				double psnr = 0.0;
+				for (const CookImage& image : images)
+					psnr += computePSNR(image) / double(images.size());
+
+				std::cout << std::left << std::setw(8) << formatName(format) << std::setw(9) << qualityName(quality) << std::setw(8) << (kernels == 1 ? "avx2" : "sse")
+					<< std::right << std::setw(11) << pixels / elapsed.count() / 1e6 << std::setw(12) << psnr << std::endl;
+			}
+		}
+	}
+
+	BlockEncoder::setAvx2Enabled(avx2);
+	std::cout << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BlockEncoder.h"
+
+/*!
+ * Converts jpg/png images into block compressed KTX files next to them, e.g. brick.jpg -> brick.ktx
+ * Normal maps ("_normal" in the name) become BC5, images with transparent pixels BC3 and all
+ * others BC1, every file gets a full mip chain from the MipGenerator (filtered in linear space,
+ * alpha test coverage kept, normals renormalized). The TextureRegistry loads the KTX files instead
+ * of the images (see [textures] prefer_compressed in settings.ini).
+ * Files are decoded in parallel and the rows of blocks of all files and mip levels are encoded
+ * as one parallel loop on the shared thread pool, so a few large images keep all workers busy.
+ */
+class TextureCooker
+{
+public:
+	/*!
+	 * @param quality: "fast", "normal" or "high"
+	 * @return the quality, NORMAL for unknown names
+	 */
+	static BlockQuality parseQuality(const std::string& quality);
+
+	/*!
+	 * @param path: path of an image file
+	 * @return path of the KTX file cooked from it
+	 */
+	static std::string getOutputPath(const std::string& path);
+
+	/*!
+	 * Chooses the block format for an image
+	 * @param path: path of the image, normal maps are recognized by name
+	 * @param rgba: image with 4 bytes per pixel
+	 * @param pixelCount: number of pixels
+	 */
+	static BlockFormat chooseFormat(const std::string& path, const unsigned char* rgba, size_t pixelCount);
+
+	/*!
+	 * @param directory: directory to be searched (not recursive)
+	 * @return paths of all jpg and png files in the directory
+	 */
+	static std::vector<std::string> listImages(const std::string& directory);
+
+	/*!
+	 * Writes the KTX files of the images
+	 * @param paths: image files
+	 * @param quality: speed/quality trade-off of the encoder
+	 * @param force: if false, images with an up to date KTX file are skipped
+	 * @return number of KTX files written
+	 */
+	static unsigned int cook(const std::vector<std::string>& paths, BlockQuality quality, bool force = false);
+
+	/*!
+	 * Encodes the images with every format, quality and kernel set and prints the
+	 * throughput in megapixels per second and the PSNR against the source images
+	 * @param paths: image files
+	 */
+	static void benchmark(const std::vector<std::string>& paths);
+};
@@ -0,0 +1,220 @@
+#include "TextureRegistry.h"
+#include "TextureStreamer.h"
+#include "TextureResidency.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+
+TextureRegistry::TextureRegistry() : _residentBytes(0), _preferCompressed(true)
+{
+}
+
+TextureRegistry& TextureRegistry::instance()
+{
+	static TextureRegistry registry;
+	return registry;
+}
+
+std::string TextureRegistry::canonicalPath(const std::string& path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+
+	for (size_t i = 0; i <= path.size(); i++) {
+		char c = i < path.size() ? path[i] : '/';
+		if (c != '/' && c != '\\') {
+			// the file system is case insensitive on windows
+			segment += (char)std::tolower((unsigned char)c);
+			continue;
+		}
+
+		if (segment == "..") {
+			if (!segments.empty() && segments.back() != "..") segments.pop_back();
+			else segments.push_back(segment);
+		}
+		else if (!segment.empty() && segment != ".") {
+			segments.push_back(segment);
+		}
+		segment.clear();
+	}
+
+	std::string result;
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (i > 0) result += '/';
+		result += segments[i];
+	}
+	return result;
+}
+
+uint64_t TextureRegistry::contentHash(const std::vector<unsigned char>& contents)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char byte : contents) {
+		hash ^= byte;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string TextureRegistry::compressedCounterpart(const std::string& path) const
+{
+	if (!_preferCompressed || TextureStreamer::isCompressedFile(path)) return path;
+
+	size_t dot = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	std::string stem = dot == std::string::npos || (separator != std::string::npos && dot < separator) ? path : path.substr(0, dot);
+
+	// ktx first, it keeps the swizzle of single and two channel formats
+	for (const char* extension : { ".ktx", ".dds" }) {
+		std::ifstream file(stem + extension, std::ios::binary);
+		if (file) return stem + extension;
+	}
+	return path;
+}
+
+GLuint TextureRegistry::acquire(const std::string& path, int priority)
+{
+	std::string canonical = canonicalPath(path);
+
+	// same path as an already loaded texture
+	auto byPath = _byPath.find(canonical);
+	if (byPath != _byPath.end()) {
+		_entries[byPath->second].refCount++;
+		return byPath->second;
+	}
+
+	// the entry stays keyed by the requested path, only the loaded file differs
+	std::string loadPath = compressedCounterpart(path);
+
+	// the texture is usable right away, the file is read, hashed and decoded in the background
+	GLuint handle;
+	glGenTextures(1, &handle);
+	TextureStreamer::setPlaceholder(handle);
+	TextureStreamer::instance().request(handle, std::vector<unsigned char>(), loadPath, priority);
+
+	Entry entry;
+	entry.handle = handle;
+	entry.hash = 0;
+	entry.alias = 0;
+	entry.refCount = 1;
+	entry.width = entry.height = 1;
+	entry.bytes = 4;
+	entry.paths.push_back(canonical);
+	entry.file = loadPath;
+
+	_byPath[canonical] = handle;
+	_entries[handle] = entry;
+	_residentBytes += entry.bytes;
+
+	return handle;
+}
+
+bool TextureRegistry::onDecoded(GLuint handle, uint64_t hash)
+{
+	// reloads of mip levels keep the texture they were decoded for
+	auto it = _entries.find(handle);
+	if (it == _entries.end() || it->second.hash != 0) return true;
+
+	Entry& entry = it->second;
+	entry.hash = hash;
+
+	auto byHash = _byHash.find(hash);
+	if (byHash == _byHash.end()) {
+		_byHash[hash] = handle;
+		return true;
+	}
+
+	// same contents under another path, e.g. a copied jpg, the paths move over so later acquires get the original
+	Entry& original = _entries[byHash->second];
+	for (const std::string& path : entry.paths) {
+		original.paths.push_back(path);
+		_byPath[path] = original.handle;
+	}
+	entry.paths.clear();
+	entry.alias = original.handle;
+	original.refCount++;
+
+	TextureResidency::instance().forget(handle);
+	return false;
+}
+
+GLuint TextureRegistry::resolve(GLuint handle) const
+{
+	auto it = _entries.find(handle);
+	return it != _entries.end() && it->second.alias != 0 ? it->second.alias : handle;
+}
+
+bool TextureRegistry::reload(GLuint handle, int firstLevel)
+{
+	auto it = _entries.find(handle);
+	if (it == _entries.end()) return false;
+
+	// the decode worker reads the file, the current levels stay bound until the upload
+	TextureStreamer::instance().request(handle, std::vector<unsigned char>(), it->second.file, 0, firstLevel);
+	return true;
+}
+
+void TextureRegistry::onUploaded(GLuint handle, int width, int height, size_t bytes)
+{
+	auto it = _entries.find(handle);
+	if (it == _entries.end()) return;
+
+	Entry& entry = it->second;
+	entry.width = width;
+	entry.height = height;
+
+	_residentBytes -= entry.bytes;
+	entry.bytes = bytes;
+	_residentBytes += entry.bytes;
+}
+
+void TextureRegistry::setPreferCompressed(bool preferCompressed)
+{
+	_preferCompressed = preferCompressed;
+}
+
+void TextureRegistry::retain(GLuint handle)
+{
+	auto it = _entries.find(handle);
+	if (it != _entries.end()) it->second.refCount++;
+}
+
+void TextureRegistry::release(GLuint handle)
+{
+	auto it = _entries.find(handle);
+	if (it == _entries.end()) return;
+
+	Entry& entry = it->second;
+	if (--entry.refCount > 0) return;
+
+	for (const std::string& path : entry.paths)
+		_byPath.erase(path);
+	auto byHash = _byHash.find(entry.hash);
+	if (byHash != _byHash.end() && byHash->second == entry.handle)
+		_byHash.erase(byHash);
+	_residentBytes -= entry.bytes;
+
+	GLuint alias = entry.alias;
+	TextureStreamer::instance().cancel(entry.handle);
+	TextureResidency::instance().forget(entry.handle);
+	glDeleteTextures(1, &entry.handle);
+	_entries.erase(it);
+
+	// an alias holds one reference on the texture with its image
+	if (alias != 0) release(alias);
+}
+
+unsigned int TextureRegistry::getTextureCount() const
+{
+	// aliases share the image of another texture
+	unsigned int count = 0;
+	for (const auto& entry : _entries)
+		if (entry.second.alias == 0) count++;
+	return count;
+}
+
+size_t TextureRegistry::getResidentBytes() const
+{
+	return _residentBytes;
+}
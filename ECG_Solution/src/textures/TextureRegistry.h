@@ -0,0 +1,166 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <GL/glew.h>
+#include "../Utils.h"
+
+/*!
+ * Process-wide registry of 2D image textures
+ * Textures are keyed by canonical path when they are acquired and by content hash once the
+ * decode worker has read the file, so the same image is uploaded only once, even if it is
+ * referenced under different paths. A texture whose contents turn out to duplicate another
+ * one is not uploaded and becomes an alias, resolve() maps it to the texture holding the image.
+ * GL handles are reference counted and deleted when the last user releases them.
+ */
+class TextureRegistry
+{
+protected:
+	struct Entry {
+		GLuint handle;
+		/*!
+		 * Content hash of the file, 0 until the first decode finished
+		 */
+		uint64_t hash;
+		/*!
+		 * Texture holding the image if this one is a duplicate, 0 otherwise
+		 * An alias keeps its placeholder and one reference on that texture, its own name stays
+		 * allocated until it is released, so it cannot be reused for another texture meanwhile.
+		 */
+		GLuint alias;
+		unsigned int refCount;
+		size_t bytes;
+		int width, height;
+		std::vector<std::string> paths;
+		/*!
+		 * File the texture was loaded from, e.g. the .ktx counterpart of the first path
+		 */
+		std::string file;
+	};
+
+	/*!
+	 * Canonical path -> texture handle
+	 */
+	std::unordered_map<std::string, GLuint> _byPath;
+
+	/*!
+	 * Content hash -> texture handle, filled when decodes finish
+	 */
+	std::unordered_map<uint64_t, GLuint> _byHash;
+
+	/*!
+	 * Texture handle -> entry
+	 */
+	std::unordered_map<GLuint, Entry> _entries;
+
+	/*!
+	 * Sum of the gpu memory of all resident textures (including mip chains)
+	 */
+	size_t _residentBytes;
+
+	/*!
+	 * Load a .ktx/.dds file next to a requested image instead of the image itself
+	 */
+	bool _preferCompressed;
+
+	TextureRegistry();
+
+	/*!
+	 * Looks for a block compressed counterpart of an image, e.g. "brick.ktx" for "brick.jpg"
+	 * @param path: path to the image file
+	 * @return path of the counterpart, the path itself if there is none
+	 */
+	std::string compressedCounterpart(const std::string& path) const;
+
+public:
+	TextureRegistry(const TextureRegistry&) = delete;
+	TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+	/*!
+	 * @return the registry instance
+	 */
+	static TextureRegistry& instance();
+
+	/*!
+	 * Normalizes separators, "." and ".." segments and case of a path
+	 * @param path: the path to be normalized
+	 * @return the canonical path
+	 */
+	static std::string canonicalPath(const std::string& path);
+
+	/*!
+	 * 64-bit FNV-1a hash of a byte buffer
+	 */
+	static uint64_t contentHash(const std::vector<unsigned char>& contents);
+
+	/*!
+	 * Returns the texture of an image file, loading it on first use
+	 * If compressed files are preferred and a .ktx or .dds file with the same name exists,
+	 * that file is loaded instead, so converted assets are picked up without code changes.
+	 * New textures hold a placeholder until the TextureStreamer has read, decoded and uploaded the image,
+	 * the file is not touched on the calling thread, so a file that cannot be read keeps the placeholder
+	 * Every call has to be paired with a release()
+	 * @param path: path to the image file
+	 * @param priority: upload priority, higher priorities are uploaded first
+	 * @return the texture handle
+	 */
+	GLuint acquire(const std::string& path, int priority = 0);
+
+	/*!
+	 * Called by the TextureStreamer before the first upload of a texture
+	 * If another texture already has the same contents, the texture becomes its alias
+	 * @param handle: the texture handle
+	 * @param hash: content hash of the decoded file
+	 * @return false if the image must not be uploaded because the texture became an alias
+	 */
+	bool onDecoded(GLuint handle, uint64_t hash);
+
+	/*!
+	 * @param handle: a texture handle
+	 * @return the texture holding the image of the handle, the handle itself unless it is an alias
+	 */
+	GLuint resolve(GLuint handle) const;
+
+	/*!
+	 * Loads the image of a texture again, uploading only the given mip level and coarser ones
+	 * @param handle: the texture handle
+	 * @param firstLevel: finest level that is uploaded
+	 * @return false if the texture is not in the registry
+	 */
+	bool reload(GLuint handle, int firstLevel);
+
+	/*!
+	 * Updates the size of a texture after the streamer uploaded its image or mip levels were dropped
+	 * @param bytes: gpu memory of the texture including all mip levels
+	 */
+	void onUploaded(GLuint handle, int width, int height, size_t bytes);
+
+	/*!
+	 * @param preferCompressed: if true, acquire() loads .ktx/.dds counterparts of images when they exist
+	 */
+	void setPreferCompressed(bool preferCompressed);
+
+	/*!
+	 * Adds a reference to an already acquired texture
+	 * @param handle: the texture handle
+	 */
+	void retain(GLuint handle);
+
+	/*!
+	 * Drops a reference, deletes the texture when it was the last one
+	 * @param handle: the texture handle
+	 */
+	void release(GLuint handle);
+
+	/*!
+	 * @return number of resident textures
+	 */
+	unsigned int getTextureCount() const;
+
+	/*!
+	 * @return gpu memory of all resident textures in bytes
+	 */
+	size_t getResidentBytes() const;
+};
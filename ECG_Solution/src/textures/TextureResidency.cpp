@@ -0,0 +1,215 @@
+#include "TextureResidency.h"
+#include "TextureRegistry.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <queue>
+
+bool TextureResidency::_enabled = true;
+size_t TextureResidency::_budgetBytes = 256 * 1024 * 1024;
+float TextureResidency::_bias = 0.0f;
+int TextureResidency::_minSize = 64;
+unsigned int TextureResidency::_maxLoads = 2;
+
+TextureResidency::TextureResidency() : _frame(1)
+{
+}
+
+TextureResidency& TextureResidency::instance()
+{
+	static TextureResidency residency;
+	return residency;
+}
+
+size_t TextureResidency::getBytes(const Entry& entry, int level)
+{
+	size_t bytes = 0;
+	for (size_t l = std::max(level, 0); l < entry.levelBytes.size(); l++)
+		bytes += entry.levelBytes[l];
+	return bytes;
+}
+
+int TextureResidency::getCoarsestLevel(const Entry& entry)
+{
+	int level = 0;
+	int last = (int)entry.levelBytes.size() - 1;
+	while (level < last && std::max(entry.width >> (level + 1), entry.height >> (level + 1)) >= _minSize)
+		level++;
+	return level;
+}
+
+float TextureResidency::computeUvDensity(const glm::vec3* positions, size_t positionStride, const glm::vec2* uvs, size_t uvStride, const std::vector<unsigned int>& indices)
+{
+	return computeUvDensity(positions, positionStride, uvs, uvStride, indices.data(), indices.size());
+}
+
+float TextureResidency::computeUvDensity(const glm::vec3* positions, size_t positionStride, const glm::vec2* uvs, size_t uvStride, const unsigned int* indices, size_t indexCount)
+{
+	const unsigned char* positionBytes = (const unsigned char*)positions;
+	const unsigned char* uvBytes = (const unsigned char*)uvs;
+
+	// both areas are doubled, which cancels out
+	double area = 0.0, uvArea = 0.0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		const glm::vec3& p0 = *(const glm::vec3*)(positionBytes + indices[i] * positionStride);
+		const glm::vec3& p1 = *(const glm::vec3*)(positionBytes + indices[i + 1] * positionStride);
+		const glm::vec3& p2 = *(const glm::vec3*)(positionBytes + indices[i + 2] * positionStride);
+		const glm::vec2& t0 = *(const glm::vec2*)(uvBytes + indices[i] * uvStride);
+		const glm::vec2& t1 = *(const glm::vec2*)(uvBytes + indices[i + 1] * uvStride);
+		const glm::vec2& t2 = *(const glm::vec2*)(uvBytes + indices[i + 2] * uvStride);
+
+		area += glm::length(glm::cross(p1 - p0, p2 - p0));
+		glm::vec2 e1 = t1 - t0, e2 = t2 - t0;
+		uvArea += std::abs(e1.x * e2.y - e1.y * e2.x);
+	}
+
+	if (area <= 0.0 || uvArea <= 0.0) return 0.0f;
+	return float(std::sqrt(uvArea / area));
+}
+
+void TextureResidency::request(GLuint handle, float pixelsPerUnit, float uvDensity)
+{
+	if (!_enabled || handle == 0) return;
+
+	// duplicates stream the mip levels of the texture holding their image
+	handle = TextureRegistry::instance().resolve(handle);
+
+	// the entry may be created before the first upload, its size is known afterwards
+	Entry& entry = _entries[handle];
+	entry.lastUsed = _frame;
+
+	// one screen pixel covers 2^level texels of level 0 at this level
+	int level = 0;
+	if (pixelsPerUnit > 0.0f && pixelsPerUnit < FLT_MAX && uvDensity > 0.0f && entry.width > 0) {
+		float texelsPerPixel = float(std::max(entry.width, entry.height)) * uvDensity / pixelsPerUnit;
+		level = std::max(int(std::floor(std::log2(std::max(texelsPerPixel, 1.0f)) + _bias)), 0);
+	}
+	entry.requestedLevel = std::min(entry.requestedLevel, level);
+}
+
+void TextureResidency::onUploaded(GLuint handle, int width, int height, const std::vector<size_t>& levelBytes, int firstLevel)
+{
+	Entry& entry = _entries[handle];
+	entry.width = width;
+	entry.height = height;
+	entry.levelBytes = levelBytes;
+	entry.residentLevel = firstLevel;
+	entry.loadingLevel = -1;
+}
+
+void TextureResidency::forget(GLuint handle)
+{
+	_entries.erase(handle);
+}
+
+void TextureResidency::drop(GLuint handle, Entry& entry, int level)
+{
+	glBindTexture(GL_TEXTURE_2D, handle);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+	// redefining the finer levels as empty images frees their storage, the texture stays complete from the base level on
+	GLint compressed = GL_FALSE, internalFormat = GL_RGBA;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+	for (int l = entry.residentLevel; l < level; l++) {
+		if (compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, internalFormat, 0, 0, 0, 0, nullptr);
+		else
+			glTexImage2D(GL_TEXTURE_2D, l, internalFormat, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	entry.residentLevel = level;
+	TextureRegistry::instance().onUploaded(handle, entry.width, entry.height, getBytes(entry, level));
+}
+
+void TextureResidency::update()
+{
+	if (!_enabled) return;
+
+	struct Candidate {
+		GLuint handle;
+		Entry* entry;
+		int target;
+		int coarsest;
+	};
+
+	// levels are only added here, without budget pressure textures keep what they have
+	std::vector<Candidate> candidates;
+	size_t total = 0;
+	for (auto& it : _entries) {
+		Entry& entry = it.second;
+		if (entry.levelBytes.empty() || entry.lastUsed == 0) continue;
+
+		int coarsest = getCoarsestLevel(entry);
+		if (entry.lastUsed == _frame)
+			entry.wantedLevel = std::min(entry.requestedLevel, coarsest);
+		entry.requestedLevel = INT32_MAX;
+
+		// only textures drawn this frame stream in finer levels
+		int current = entry.loadingLevel >= 0 ? std::min(entry.loadingLevel, entry.residentLevel) : entry.residentLevel;
+		int target = entry.lastUsed == _frame ? std::min(current, entry.wantedLevel) : current;
+		Candidate candidate = { it.first, &entry, target, coarsest };
+		total += getBytes(entry, candidate.target);
+		candidates.push_back(candidate);
+	}
+
+	// victims: textures holding more than they need, then the least recently drawn, then the largest level
+	auto worse = [&candidates](unsigned int a, unsigned int b) {
+		const Candidate& ca = candidates[a];
+		const Candidate& cb = candidates[b];
+		bool overA = ca.target < ca.entry->wantedLevel, overB = cb.target < cb.entry->wantedLevel;
+		if (overA != overB) return overB;
+		if (ca.entry->lastUsed != cb.entry->lastUsed) return ca.entry->lastUsed > cb.entry->lastUsed;
+		return ca.entry->levelBytes[ca.target] < cb.entry->levelBytes[cb.target];
+	};
+	std::priority_queue<unsigned int, std::vector<unsigned int>, decltype(worse)> victims(worse);
+	for (unsigned int i = 0; i < candidates.size(); i++)
+		if (candidates[i].target < candidates[i].coarsest) victims.push(i);
+
+	while (total > _budgetBytes && !victims.empty()) {
+		unsigned int i = victims.top();
+		victims.pop();
+
+		Candidate& candidate = candidates[i];
+		total -= candidate.entry->levelBytes[candidate.target];
+		candidate.target++;
+		if (candidate.target < candidate.coarsest) victims.push(i);
+	}
+
+	// drops are immediate, loads are queued a few per frame
+	unsigned int loads = 0;
+	for (Candidate& candidate : candidates) {
+		Entry& entry = *candidate.entry;
+		if (candidate.target > entry.residentLevel) {
+			drop(candidate.handle, entry, candidate.target);
+		}
+		else if (candidate.target < entry.residentLevel && entry.loadingLevel < 0 && loads < _maxLoads) {
+			if (TextureRegistry::instance().reload(candidate.handle, candidate.target)) {
+				entry.loadingLevel = candidate.target;
+				loads++;
+			}
+		}
+	}
+
+	_frame++;
+}
+
+size_t TextureResidency::getResidentBytes() const
+{
+	size_t bytes = 0;
+	for (const auto& it : _entries)
+		if (it.second.lastUsed != 0)
+			bytes += getBytes(it.second, it.second.residentLevel);
+	return bytes;
+}
+
+void TextureResidency::setSettings(bool enabled, size_t budgetBytes, float bias, int minSize, unsigned int maxLoads)
+{
+	_enabled = enabled;
+	_budgetBytes = budgetBytes;
+	_bias = bias;
+	_minSize = std::max(minSize, 1);
+	_maxLoads = std::max(maxLoads, 1u);
+}
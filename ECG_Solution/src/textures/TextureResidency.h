@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*!
+ * Keeps the mip levels of mesh textures within a gpu memory budget
+ * Every draw reports the finest level its texture needs at the current distance. Once per frame
+ * the finest needed levels are compared against the budget: while it is exceeded, levels are
+ * dropped from textures that hold more than they need, then from the least recently used ones.
+ * Dropped levels are cut off with GL_TEXTURE_BASE_LEVEL and their storage is freed, finer
+ * levels are streamed in again through the TextureStreamer when the texture comes closer.
+ * Only textures that are requested are managed, all others keep their full mip chain.
+ */
+class TextureResidency
+{
+protected:
+	struct Entry {
+		int width = 0, height = 0;
+		/*!
+		 * Gpu memory of every level of the full chain, empty until the first upload
+		 */
+		std::vector<size_t> levelBytes;
+		/*!
+		 * Finest level in gpu memory (GL_TEXTURE_BASE_LEVEL)
+		 */
+		int residentLevel = 0;
+		/*!
+		 * Level of a load in flight, -1 if there is none
+		 */
+		int loadingLevel = -1;
+		/*!
+		 * Finest level requested this frame and the level kept from the last frame it was drawn
+		 */
+		int requestedLevel = INT32_MAX;
+		int wantedLevel = 0;
+		uint64_t lastUsed = 0;
+	};
+
+	std::unordered_map<GLuint, Entry> _entries;
+	uint64_t _frame;
+
+	static bool _enabled;
+	static size_t _budgetBytes;
+	static float _bias;
+	static int _minSize;
+	static unsigned int _maxLoads;
+
+	TextureResidency();
+
+	/*!
+	 * @return bytes of the levels from the given level down to 1x1
+	 */
+	static size_t getBytes(const Entry& entry, int level);
+
+	/*!
+	 * @return coarsest level that is still at least the minimum size
+	 */
+	static int getCoarsestLevel(const Entry& entry);
+
+	/*!
+	 * Frees all levels finer than the given one (runs on the main thread)
+	 */
+	void drop(GLuint handle, Entry& entry, int level);
+
+public:
+	TextureResidency(const TextureResidency&) = delete;
+	TextureResidency& operator=(const TextureResidency&) = delete;
+
+	/*!
+	 * @return the residency instance
+	 */
+	static TextureResidency& instance();
+
+	/*!
+	 * Uv units per object space unit of a triangle mesh, the root of uv area over surface area
+	 * @param positions: first position, read with the given stride
+	 * @param uvs: first texture coordinate, read with the given stride
+	 * @param indices: triangle list
+	 * @return the density, 0 if the mesh has no uv area
+	 */
+	static float computeUvDensity(const glm::vec3* positions, size_t positionStride, const glm::vec2* uvs, size_t uvStride, const std::vector<unsigned int>& indices);
+
+	/*!
+	 * Same for a triangle list that is not in a vector, e.g. in a mapped mesh cache
+	 */
+	static float computeUvDensity(const glm::vec3* positions, size_t positionStride, const glm::vec2* uvs, size_t uvStride, const unsigned int* indices, size_t indexCount);
+
+	/*!
+	 * Reports that a texture is drawn this frame
+	 * @param handle: texture handle from the TextureRegistry
+	 * @param pixelsPerUnit: on screen size of one object space unit, see LodChain::getPixelsPerUnit()
+	 * @param uvDensity: uv units per object space unit of the mesh
+	 */
+	void request(GLuint handle, float pixelsPerUnit, float uvDensity);
+
+	/*!
+	 * Records the levels of a texture after the streamer uploaded it
+	 * @param levelBytes: gpu memory of every level of the full chain
+	 * @param firstLevel: finest level that was uploaded
+	 */
+	void onUploaded(GLuint handle, int width, int height, const std::vector<size_t>& levelBytes, int firstLevel);
+
+	/*!
+	 * Stops managing a deleted texture
+	 */
+	void forget(GLuint handle);
+
+	/*!
+	 * Enforces the budget for the levels requested this frame, drops levels and queues loads
+	 * Has to be called on the thread owning the GL context, once per frame after drawing
+	 */
+	void update();
+
+	/*!
+	 * @return gpu memory of the resident levels of all managed textures
+	 */
+	size_t getResidentBytes() const;
+
+	/*!
+	 * @param enabled: if false, requests are ignored and textures keep all levels
+	 * @param budgetBytes: gpu memory for managed textures
+	 * @param bias: added to the needed level, positive values save memory
+	 * @param minSize: levels smaller than this many pixels are never dropped
+	 * @param maxLoads: loads of finer levels queued per frame
+	 */
+	static void setSettings(bool enabled, size_t budgetBytes, float bias, int minSize, unsigned int maxLoads);
+};
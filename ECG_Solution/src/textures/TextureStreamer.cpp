@@ -0,0 +1,320 @@
+#include "TextureStreamer.h"
+#include "TextureRegistry.h"
+#include "TextureResidency.h"
+#include "../ThreadPool.h"
+
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <stb_image.h>
+#include <gli/gli.hpp>
+
+TextureStreamer::TextureStreamer() : _order(0), _inFlight(0), _pbo(0), _pboSize(0)
+{
+}
+
+TextureStreamer& TextureStreamer::instance()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+void TextureStreamer::setPlaceholder(GLuint handle)
+{
+	// neutral grey, so lighting still looks plausible until the image arrives
+	const unsigned char texel[4] = { 128, 128, 128, 255 };
+
+	glBindTexture(GL_TEXTURE_2D, handle);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+bool TextureStreamer::isCompressedFile(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) return false;
+
+	std::string extension = path.substr(dot + 1);
+	for (char& c : extension) c = (char)std::tolower((unsigned char)c);
+	return extension == "ktx" || extension == "dds";
+}
+
+void TextureStreamer::request(GLuint handle, std::vector<unsigned char> contents, const std::string& path, int priority, int firstLevel)
+{
+	Request request;
+	request.handle = handle;
+	request.priority = priority;
+	request.path = path;
+	request.contents = std::move(contents);
+	request.firstLevel = std::max(firstLevel, 0);
+	request.hash = 0;
+	request.pixels = nullptr;
+	request.width = request.height = request.channels = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		request.order = _order++;
+		_latest[handle] = request.order;
+		_pending.push(std::move(request));
+		_inFlight++;
+	}
+
+	// every job decodes whatever is most important at the time it starts
+	ThreadPool::shared().submit([this]() { decodeNext(); });
+}
+
+void TextureStreamer::decodeNext()
+{
+	Request request;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_pending.empty()) return;
+		request = std::move(const_cast<Request&>(_pending.top()));
+		_pending.pop();
+	}
+
+	// files are read and hashed here instead of on the main thread
+	if (request.contents.empty()) {
+		std::ifstream file(request.path, std::ios::binary);
+		request.contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	if (!request.contents.empty())
+		request.hash = TextureRegistry::contentHash(request.contents);
+
+	if (isCompressedFile(request.path)) {
+		// gli keeps the blocks and mip levels of the file as they are
+		request.compressed = std::make_shared<gli::texture>(gli::load((const char*)request.contents.data(), request.contents.size()));
+	}
+	else {
+		request.pixels = stbi_load_from_memory(request.contents.data(), (int)request.contents.size(), &request.width, &request.height, &request.channels, 0);
+		if (request.pixels)
+			request.levels = MipGenerator::generate(request.pixels, request.width, request.height, request.channels, MipGenerator::getSettings(request.path));
+	}
+	request.contents.clear();
+	request.contents.shrink_to_fit();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_decoded.push(std::move(request));
+}
+
+void TextureStreamer::cancel(GLuint handle)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_latest.erase(handle);
+}
+
+unsigned int TextureStreamer::update(double budgetMs)
+{
+	auto start = std::chrono::steady_clock::now();
+	unsigned int uploaded = 0;
+
+	while (true) {
+		Request request;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_decoded.empty()) break;
+			request = std::move(const_cast<Request&>(_decoded.top()));
+			_decoded.pop();
+			_inFlight--;
+
+			auto latest = _latest.find(request.handle);
+			if (latest == _latest.end() || latest->second != request.order) {
+				stbi_image_free(request.pixels);
+				request.compressed.reset();
+				continue;
+			}
+			_latest.erase(latest);
+		}
+
+		// duplicates of an already loaded image become aliases of it instead of being uploaded
+		if (request.hash != 0 && !TextureRegistry::instance().onDecoded(request.handle, request.hash)) {
+			stbi_image_free(request.pixels);
+			request.compressed.reset();
+			continue;
+		}
+
+		upload(request);
+		uploaded++;
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= budgetMs) break;
+	}
+
+	return uploaded;
+}
+
+void TextureStreamer::upload(Request& request)
+{
+	if (request.compressed) {
+		uploadCompressed(request);
+		return;
+	}
+
+	if (!request.pixels) {
+		std::cout << "Texture failed to load at path: " << request.path << std::endl;
+		return;
+	}
+
+	GLenum format = GL_RGB;
+	if (request.channels == 1)
+		format = GL_RED;
+	else if (request.channels == 2)
+		format = GL_RG;
+	else if (request.channels == 3)
+		format = GL_RGB;
+	else if (request.channels == 4)
+		format = GL_RGBA;
+
+	// level 0 is the decoded image, the generated levels follow
+	struct Level {
+		int width, height;
+		const unsigned char* pixels;
+		size_t size;
+	};
+	std::vector<Level> levels;
+	levels.push_back({ request.width, request.height, request.pixels, size_t(request.width) * size_t(request.height) * size_t(request.channels) });
+	for (const MipLevel& level : request.levels)
+		levels.push_back({ level.width, level.height, level.pixels.data(), level.pixels.size() });
+
+	// rgb is padded to rgba by most drivers
+	std::vector<size_t> levelBytes;
+	for (const Level& level : levels)
+		levelBytes.push_back(request.channels == 3 ? level.size / 3 * 4 : level.size);
+
+	// the uploaded levels back to back in the pbo
+	int firstLevel = std::min(request.firstLevel, (int)levels.size() - 1);
+	size_t size = 0;
+	for (size_t l = firstLevel; l < levels.size(); l++)
+		size += levels[l].size;
+
+	// copy into the pbo, orphaning the old storage so the driver does not wait for the previous upload
+	if (_pbo == 0) glGenBuffers(1, &_pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+	if (size > _pboSize) _pboSize = size;
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, _pboSize, nullptr, GL_STREAM_DRAW);
+	void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (staging) {
+		unsigned char* target = (unsigned char*)staging;
+		for (size_t l = firstLevel; l < levels.size(); l++) {
+			std::memcpy(target, levels[l].pixels, levels[l].size);
+			target += levels[l].size;
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, request.handle);
+
+	// grey images are stored in red, grey with alpha in red and green
+	GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+	if (request.channels == 1) {
+		swizzle[1] = swizzle[2] = GL_RED;
+		swizzle[3] = GL_ONE;
+	}
+	else if (request.channels == 2) {
+		swizzle[1] = swizzle[2] = GL_RED;
+		swizzle[3] = GL_GREEN;
+	}
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+	// rows of 1 and 3 channel images are not 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (staging) {
+		size_t offset = 0;
+		for (size_t l = firstLevel; l < levels.size(); l++) {
+			glTexImage2D(GL_TEXTURE_2D, GLint(l), format, levels[l].width, levels[l].height, 0, format, GL_UNSIGNED_BYTE, (void*)offset);
+			offset += levels[l].size;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	else {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		for (size_t l = firstLevel; l < levels.size(); l++)
+			glTexImage2D(GL_TEXTURE_2D, GLint(l), format, levels[l].width, levels[l].height, 0, format, GL_UNSIGNED_BYTE, levels[l].pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	stbi_image_free(request.pixels);
+	request.pixels = nullptr;
+	request.levels.clear();
+
+	size_t bytes = 0;
+	for (size_t l = firstLevel; l < levelBytes.size(); l++)
+		bytes += levelBytes[l];
+	TextureRegistry::instance().onUploaded(request.handle, request.width, request.height, bytes);
+	TextureResidency::instance().onUploaded(request.handle, request.width, request.height, levelBytes, firstLevel);
+}
+
+void TextureStreamer::uploadCompressed(Request& request)
+{
+	gli::texture& texture = *request.compressed;
+	if (texture.empty() || texture.target() != gli::TARGET_2D) {
+		std::cout << "Texture failed to load at path: " << request.path << " (no 2D KTX/DDS texture)" << std::endl;
+		request.compressed.reset();
+		return;
+	}
+
+	// internal format, external format and swizzle of the file format, e.g. GL_COMPRESSED_RG_RGTC2 for BC5 normal maps
+	gli::gl translator(gli::gl::PROFILE_GL33);
+	gli::gl::format format = translator.translate(texture.format(), texture.swizzles());
+	bool compressed = gli::is_compressed(texture.format());
+	GLint levels = (GLint)texture.levels();
+	GLint firstLevel = std::min(request.firstLevel, levels - 1);
+
+	glBindTexture(GL_TEXTURE_2D, request.handle);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, format.Swizzles[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, format.Swizzles[1]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, format.Swizzles[2]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, format.Swizzles[3]);
+
+	// every level comes from the file, nothing is generated at runtime
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (GLint level = firstLevel; level < levels; level++) {
+		gli::texture::extent_type extent = texture.extent(level);
+		if (compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format.Internal, extent.x, extent.y, 0, (GLsizei)texture.size(level), texture.data(0, 0, level));
+		else
+			glTexImage2D(GL_TEXTURE_2D, level, format.Internal, extent.x, extent.y, 0, format.External, format.Type, texture.data(0, 0, level));
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	std::vector<size_t> levelBytes;
+	size_t bytes = 0;
+	for (GLint level = 0; level < levels; level++) {
+		levelBytes.push_back(texture.size(level));
+		if (level >= firstLevel) bytes += levelBytes.back();
+	}
+
+	gli::texture::extent_type extent = texture.extent(0);
+	TextureRegistry::instance().onUploaded(request.handle, extent.x, extent.y, bytes);
+	TextureResidency::instance().onUploaded(request.handle, extent.x, extent.y, levelBytes, firstLevel);
+	request.compressed.reset();
+}
+
+void TextureStreamer::flush()
+{
+	while (getPendingCount() > 0) {
+		if (update(1000.0) == 0)
+			std::this_thread::yield();
+	}
+}
+
+unsigned int TextureStreamer::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _inFlight;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <GL/glew.h>
+#include "../Utils.h"
+#include "MipGenerator.h"
+
+namespace gli { class texture; }
+
+/*!
+ * Decodes image files on the shared thread pool and uploads them on the main thread
+ * KTX and DDS files are uploaded with the block compressed format and mip levels stored
+ * in the file, all other images are decoded with stb_image and get their mip chain from the
+ * MipGenerator on the same worker, so the main thread only uploads.
+ * Requested textures get a placeholder texel right away, so they can be bound before
+ * the real image arrives. Uploads go through a pixel buffer object and are limited by
+ * a per-frame time budget, most important textures first.
+ */
+class TextureStreamer
+{
+protected:
+	struct Request {
+		GLuint handle;
+		int priority;
+		// unique per request, identifies it in _latest
+		unsigned int order;
+		std::string path;
+		std::vector<unsigned char> contents;
+		// content hash of the file, computed by the decode worker, 0 if it could not be read
+		uint64_t hash;
+		// finest level that is uploaded, finer levels stay empty
+		int firstLevel;
+
+		// decoded image
+		unsigned char* pixels;
+		int width, height, channels;
+		// levels 1 to n of the decoded image
+		std::vector<MipLevel> levels;
+
+		// loaded KTX/DDS file, null for other images
+		std::shared_ptr<gli::texture> compressed;
+
+		// higher priority first, equal priorities in request order
+		bool operator<(const Request& other) const {
+			return priority != other.priority ? priority < other.priority : order > other.order;
+		}
+	};
+
+	/*!
+	 * Requests waiting for a decode worker
+	 */
+	std::priority_queue<Request> _pending;
+
+	/*!
+	 * Decoded requests waiting for the upload
+	 */
+	std::priority_queue<Request> _decoded;
+
+	/*!
+	 * Order of the latest request of every handle with a request in flight
+	 * Decodes of older or cancelled requests are dropped at upload, so a stale image never
+	 * lands in a texture that was requested again, deleted or whose name was reused.
+	 */
+	std::unordered_map<GLuint, unsigned int> _latest;
+
+	std::mutex _mutex;
+	unsigned int _order;
+	unsigned int _inFlight;
+
+	/*!
+	 * Pixel buffer object used as upload staging memory
+	 */
+	GLuint _pbo;
+	size_t _pboSize;
+
+	TextureStreamer();
+
+	/*!
+	 * Decodes the most important pending request (runs on a worker)
+	 */
+	void decodeNext();
+
+	/*!
+	 * Uploads a decoded image into its texture (runs on the main thread)
+	 */
+	void upload(Request& request);
+
+	/*!
+	 * Uploads all mip levels of a KTX/DDS file into its texture (runs on the main thread)
+	 */
+	void uploadCompressed(Request& request);
+
+public:
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	/*!
+	 * @return the streamer instance
+	 */
+	static TextureStreamer& instance();
+
+	/*!
+	 * Fills a texture with a single placeholder texel
+	 * @param handle: the texture handle
+	 */
+	static void setPlaceholder(GLuint handle);
+
+	/*!
+	 * @param path: path of an image file
+	 * @return true for KTX and DDS files, which are loaded through gli
+	 */
+	static bool isCompressedFile(const std::string& path);
+
+	/*!
+	 * Queues an encoded image file for decoding and upload
+	 * @param handle: texture that receives the image, should hold a placeholder
+	 * @param contents: encoded file contents, if empty the file is read by the decode worker
+	 * Before the upload the TextureRegistry gets the content hash and may drop the image of a duplicate
+	 * @param path: path of the file
+	 * @param priority: higher priorities are decoded and uploaded first
+	 * @param firstLevel: finest mip level that is uploaded, see TextureResidency
+	 */
+	void request(GLuint handle, std::vector<unsigned char> contents, const std::string& path, int priority, int firstLevel = 0);
+
+	/*!
+	 * Drops all requests of a texture that are not uploaded yet, e.g. because it was deleted
+	 * @param handle: the texture handle
+	 */
+	void cancel(GLuint handle);
+
+	/*!
+	 * Uploads decoded images until the time budget is used up, at least one per call
+	 * Has to be called on the thread owning the GL context, usually once per frame
+	 * @param budgetMs: time budget in milliseconds
+	 * @return number of textures uploaded
+	 */
+	unsigned int update(double budgetMs);
+
+	/*!
+	 * Blocks until all requested textures are uploaded
+	 */
+	void flush();
+
+	/*!
+	 * @return number of textures that are not uploaded yet
+	 */
+	unsigned int getPendingCount();
+};
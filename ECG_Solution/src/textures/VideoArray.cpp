@@ -0,0 +1,142 @@
+#include "VideoArray.h"
+#include "BlockEncoder.h"
+#include "../ThreadPool.h"
+#include "../Utils.h"
+
+#include <stb_image.h>
+
+size_t VideoArray::_budgetBytes = 64 * 1024 * 1024;
+bool VideoArray::_compress = true;
+
+VideoArray::VideoArray(const ImageSequence& sequence, int width, int height, double frameRate)
+	: _sequence(sequence), _width(width), _height(height), _compressed(_compress), _handle(0),
+	_state(std::make_shared<LoadState>()), _nextLoad(0), _inFlight(0), _resident(sequence.frameCount, false), _residentCount(0),
+	_layer(0), _frameDuration(1.0 / frameRate), _time(0.0), _paused(false)
+{
+	glGenTextures(1, &_handle);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, _compressed ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB8, _width, _height, _sequence.frameCount);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	loadFrames();
+}
+
+VideoArray::~VideoArray()
+{
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		_state->cancelled = true;
+	}
+	glDeleteTextures(1, &_handle);
+}
+
+size_t VideoArray::getArrayBytes(unsigned int frameCount, int width, int height, bool compressed)
+{
+	// rgb8 is padded to 4 bytes per pixel by most drivers
+	size_t frameBytes = compressed ? BlockEncoder::getEncodedSize(BlockFormat::BC1, width, height) : size_t(width) * size_t(height) * 4;
+	return frameBytes * frameCount;
+}
+
+bool VideoArray::fitsBudget(const ImageSequence& sequence, int width, int height)
+{
+	return sequence.frameCount > 0 && getArrayBytes(sequence.frameCount, width, height, _compress) <= _budgetBytes;
+}
+
+void VideoArray::loadFrames()
+{
+	unsigned int maxInFlight = ThreadPool::shared().getThreadCount();
+	for (; _nextLoad < _sequence.frameCount && _inFlight < maxInFlight; _nextLoad++, _inFlight++) {
+		std::shared_ptr<LoadState> state = _state;
+		std::string path = _sequence.getFramePath(_nextLoad);
+		unsigned int index = _nextLoad;
+		int width = _width, height = _height;
+		bool compressed = _compressed;
+
+		ThreadPool::shared().submit([state, path, index, width, height, compressed]() {
+			LoadedFrame frame;
+			frame.index = index;
+
+			bool cancelled;
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				cancelled = state->cancelled;
+			}
+
+			if (!cancelled) {
+				// the flag is per thread, reset it for the other jobs of this worker
+				int frameWidth, frameHeight, channels;
+				stbi_set_flip_vertically_on_load_thread(true);
+				unsigned char* pixels = stbi_load(path.c_str(), &frameWidth, &frameHeight, &channels, compressed ? 4 : 3);
+				stbi_set_flip_vertically_on_load_thread(false);
+
+				if (pixels && frameWidth == width && frameHeight == height) {
+					if (compressed)
+						frame.data = BlockEncoder::encode(pixels, width, height, BlockFormat::BC1, BlockQuality::NORMAL);
+					else
+						frame.data.assign(pixels, pixels + size_t(width) * size_t(height) * 3);
+				}
+				else {
+					std::cout << "Texture failed to load at path: " << path << std::endl;
+				}
+				stbi_image_free(pixels);
+			}
+
+			std::lock_guard<std::mutex> lock(state->mutex);
+			state->done.push_back(std::move(frame));
+		});
+	}
+}
+
+void VideoArray::update(double dt)
+{
+	if (_residentCount < _sequence.frameCount) {
+		std::vector<LoadedFrame> done;
+		{
+			std::lock_guard<std::mutex> lock(_state->mutex);
+			done.swap(_state->done);
+		}
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (LoadedFrame& frame : done) {
+			if (!frame.data.empty()) {
+				if (_compressed)
+					glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, frame.index, _width, _height, 1, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, (GLsizei)frame.data.size(), frame.data.data());
+				else
+					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, frame.index, _width, _height, 1, GL_RGB, GL_UNSIGNED_BYTE, frame.data.data());
+			}
+
+			// broken frames count as loaded, their layer stays undefined
+			_resident[frame.index] = true;
+			_inFlight--;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		while (_residentCount < _sequence.frameCount && _resident[_residentCount])
+			_residentCount++;
+		loadFrames();
+	}
+
+	if (_paused) return;
+
+	// playback is just the layer index
+	_time += dt;
+	while (_time >= _frameDuration) {
+		_time -= _frameDuration;
+		if (_layer + 1 < _residentCount)
+			_layer++;
+		else if (_residentCount == _sequence.frameCount)
+			_layer = 0;
+	}
+}
+
+void VideoArray::setSettings(size_t budgetBytes, bool compress)
+{
+	_budgetBytes = budgetBytes;
+	_compress = compress;
+}
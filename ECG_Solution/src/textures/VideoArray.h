@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <GL/glew.h>
+#include "VideoSource.h"
+
+/*!
+ * Short looping video preloaded into a GL_TEXTURE_2D_ARRAY, one layer per frame
+ * The frames are decoded (and optionally BC1 compressed) on the shared thread pool and
+ * uploaded as they arrive, afterwards playback only moves the layer index the shader reads.
+ * Until all layers are resident, playback holds at the last loaded frame.
+ */
+class VideoArray
+{
+protected:
+	struct LoadedFrame {
+		unsigned int index;
+		/*!
+		 * BC1 blocks or rgb pixels, empty if the frame failed to load
+		 */
+		std::vector<unsigned char> data;
+	};
+
+	/*!
+	 * Shared with the decode jobs, so they can finish after the array is gone
+	 */
+	struct LoadState {
+		std::mutex mutex;
+		std::vector<LoadedFrame> done;
+		bool cancelled = false;
+	};
+
+	ImageSequence _sequence;
+	int _width, _height;
+	bool _compressed;
+	GLuint _handle;
+
+	std::shared_ptr<LoadState> _state;
+	unsigned int _nextLoad;
+	unsigned int _inFlight;
+	std::vector<bool> _resident;
+	/*!
+	 * Number of frames from the start that are all resident
+	 */
+	unsigned int _residentCount;
+
+	unsigned int _layer;
+	double _frameDuration;
+	double _time;
+	bool _paused;
+
+	static size_t _budgetBytes;
+	static bool _compress;
+
+	/*!
+	 * Queues decode jobs, at most one per worker is in flight
+	 */
+	void loadFrames();
+
+public:
+	/*!
+	 * Allocates the array and starts loading the frames in the background
+	 * @param sequence: frames of the video
+	 * @param width, height: size of a frame
+	 * @param frameRate: frames per second
+	 */
+	VideoArray(const ImageSequence& sequence, int width, int height, double frameRate);
+
+	~VideoArray();
+
+	VideoArray(const VideoArray&) = delete;
+	VideoArray& operator=(const VideoArray&) = delete;
+
+	/*!
+	 * @return gpu memory of a clip stored as texture array
+	 */
+	static size_t getArrayBytes(unsigned int frameCount, int width, int height, bool compressed);
+
+	/*!
+	 * @return true if the clip fits into the video memory budget of the settings
+	 */
+	static bool fitsBudget(const ImageSequence& sequence, int width, int height);
+
+	/*!
+	 * Uploads finished frames and advances the layer, call once per frame
+	 * @param dt: time since the last call in seconds
+	 */
+	void update(double dt);
+
+	/*!
+	 * Stops the playback clock, loading continues
+	 */
+	void setPaused(bool paused) { _paused = paused; }
+
+	GLuint getHandle() const { return _handle; }
+
+	int getLayer() const { return (int)_layer; }
+
+	size_t getBytes() const { return getArrayBytes(_sequence.frameCount, _width, _height, _compressed); }
+
+	/*!
+	 * @param budgetBytes: largest clip that is preloaded, longer clips are streamed
+	 * @param compress: store the frames BC1 compressed (8x smaller than rgba)
+	 */
+	static void setSettings(size_t budgetBytes, bool compress);
+};
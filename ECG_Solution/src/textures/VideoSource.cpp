@@ -0,0 +1,153 @@
+#include "VideoSource.h"
+#include "../Utils.h"
+
+#include <algorithm>
+#include <stb_image.h>
+
+unsigned int VideoSource::_bufferFrames = 8;
+size_t VideoSource::_bufferBytes = 16 * 1024 * 1024;
+
+bool ImageSequence::parse(const std::string& lastFramePath)
+{
+	// "frame_47.jpg" -> frames 00 to 47
+	size_t separator = lastFramePath.find_last_of('_');
+	size_t dot = lastFramePath.find_last_of('.');
+	if (separator == std::string::npos || dot == std::string::npos || dot <= separator + 1) {
+		std::cout << "ERROR::VIDEOSOURCE::no frame number in " << lastFramePath << std::endl;
+		return false;
+	}
+	prefix = lastFramePath.substr(0, separator + 1);
+	suffix = lastFramePath.substr(dot);
+	digits = (unsigned int)(dot - separator - 1);
+	frameCount = (unsigned int)std::stoi(lastFramePath.substr(separator + 1, digits)) + 1;
+	return true;
+}
+
+std::string ImageSequence::getFramePath(unsigned int index) const
+{
+	std::string number = std::to_string(index);
+	if (number.size() < digits) number.insert(0, digits - number.size(), '0');
+	return prefix + number + suffix;
+}
+
+VideoSource::VideoSource(const std::string& lastFramePath, double frameRate)
+	: _width(0), _height(0), _frameDuration(1.0 / frameRate), _time(0.0),
+	_capacity(1), _nextDecode(0), _paused(false), _stop(false)
+{
+	_current.index = 0;
+	_current.pixels = nullptr;
+
+	if (!_sequence.parse(lastFramePath)) return;
+
+	// the first frame is needed for the texture size, everything else is decoded in the background
+	int channels;
+	stbi_set_flip_vertically_on_load_thread(true);
+	_current.pixels = stbi_load(_sequence.getFramePath(0).c_str(), &_width, &_height, &channels, 3);
+	stbi_set_flip_vertically_on_load_thread(false);
+	if (!_current.pixels) {
+		std::cout << "Texture failed to load at path: " << _sequence.getFramePath(0) << std::endl;
+		_width = _height = 0;
+		return;
+	}
+
+	size_t frameBytes = size_t(_width) * size_t(_height) * 3;
+	_capacity = (unsigned int)std::max<size_t>(1, std::min<size_t>(_bufferFrames, _bufferBytes / frameBytes));
+	_nextDecode = 1 % _sequence.frameCount;
+	_worker = std::thread([this]() { decodeLoop(); });
+}
+
+VideoSource::~VideoSource()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+	if (_worker.joinable()) _worker.join();
+
+	for (Frame& frame : _ready)
+		stbi_image_free(frame.pixels);
+	stbi_image_free(_current.pixels);
+}
+
+void VideoSource::decodeLoop()
+{
+	// the flag is per thread, this worker only decodes frames
+	stbi_set_flip_vertically_on_load_thread(true);
+
+	while (true) {
+		unsigned int index;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || (!_paused && _ready.size() < _capacity); });
+			if (_stop) return;
+
+			index = _nextDecode;
+			_nextDecode = (_nextDecode + 1) % _sequence.frameCount;
+		}
+
+		int width, height, channels;
+		Frame frame;
+		frame.index = index;
+		frame.pixels = stbi_load(_sequence.getFramePath(index).c_str(), &width, &height, &channels, 3);
+
+		// broken frames still take their slot, so a missing file does not make the worker spin
+		if (!frame.pixels || width != _width || height != _height) {
+			std::cout << "Texture failed to load at path: " << _sequence.getFramePath(index) << std::endl;
+			stbi_image_free(frame.pixels);
+			frame.pixels = nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_ready.push_back(frame);
+	}
+}
+
+bool VideoSource::advance(double dt)
+{
+	if (_paused || _sequence.frameCount < 2) return false;
+
+	_time += dt;
+	if (_time < _frameDuration) return false;
+
+	Frame next;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_ready.empty()) return false;
+		next = _ready.front();
+		_ready.pop_front();
+	}
+	_condition.notify_one();
+
+	// after a stall, continue from the shown frame instead of rushing to catch up
+	_time -= _frameDuration;
+	if (_time > _frameDuration) _time = 0.0;
+
+	if (!next.pixels) return false;
+
+	stbi_image_free(_current.pixels);
+	_current = next;
+	return true;
+}
+
+void VideoSource::setPaused(bool paused)
+{
+	if (paused == _paused) return;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_paused = paused;
+	}
+	_condition.notify_one();
+}
+
+size_t VideoSource::getBufferBytes() const
+{
+	// ring plus the frame on screen
+	return size_t(_capacity + 1) * size_t(_width) * size_t(_height) * 3;
+}
+
+void VideoSource::setSettings(unsigned int bufferFrames, size_t bufferBytes)
+{
+	_bufferFrames = std::max(bufferFrames, 1u);
+	_bufferBytes = bufferBytes;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*!
+ * Numbered image files of a video, frame i = prefix + i (zero padded to digits) + suffix
+ */
+struct ImageSequence {
+	std::string prefix, suffix;
+	unsigned int digits = 0;
+	unsigned int frameCount = 0;
+
+	/*!
+	 * @param lastFramePath: path of the last frame, e.g. "videotextures/goodgame/frame_47.jpg"
+	 * @return false if the path has no frame number
+	 */
+	bool parse(const std::string& lastFramePath);
+
+	std::string getFramePath(unsigned int index) const;
+};
+
+/*!
+ * Image sequence (frame_00.jpg, frame_01.jpg, ...) played back as a video
+ * A worker thread decodes the frames a few steps ahead of the playback clock into a small
+ * ring of buffers, so only a bounded number of frames is in memory at any time. While the
+ * source is paused, neither the clock nor the decoding advances.
+ */
+class VideoSource
+{
+protected:
+	struct Frame {
+		unsigned int index;
+		/*!
+		 * Decoded rgb pixels, null if the frame failed to load
+		 */
+		unsigned char* pixels;
+	};
+
+	ImageSequence _sequence;
+
+	int _width, _height;
+	double _frameDuration;
+	double _time;
+
+	/*!
+	 * Frame currently shown, owned by the main thread
+	 */
+	Frame _current;
+
+	/*!
+	 * Decoded frames waiting for playback, at most _capacity
+	 */
+	std::deque<Frame> _ready;
+	unsigned int _capacity;
+	unsigned int _nextDecode;
+	bool _paused;
+	bool _stop;
+
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::thread _worker;
+
+	static unsigned int _bufferFrames;
+	static size_t _bufferBytes;
+
+	/*!
+	 * Decodes frames while there is room in the ring (runs on the worker)
+	 */
+	void decodeLoop();
+
+public:
+	/*!
+	 * Opens an image sequence, only the first frame is decoded before returning
+	 * @param lastFramePath: path of the last frame, e.g. "videotextures/goodgame/frame_47.jpg"
+	 * @param frameRate: frames per second
+	 */
+	VideoSource(const std::string& lastFramePath, double frameRate);
+
+	/*!
+	 * Stops the worker and frees all frames
+	 */
+	~VideoSource();
+
+	VideoSource(const VideoSource&) = delete;
+	VideoSource& operator=(const VideoSource&) = delete;
+
+	/*!
+	 * Advances the playback clock, the video waits instead of skipping if the worker falls behind
+	 * @param dt: time since the last call in seconds
+	 * @return true if a new frame became current
+	 */
+	bool advance(double dt);
+
+	/*!
+	 * Pauses or resumes playback and decoding, e.g. while the screen is not visible
+	 */
+	void setPaused(bool paused);
+
+	/*!
+	 * @return rgb pixels of the current frame, rows bottom to top, null if nothing could be loaded
+	 */
+	const unsigned char* getPixels() const { return _current.pixels; }
+
+	int getWidth() const { return _width; }
+
+	int getHeight() const { return _height; }
+
+	/*!
+	 * @return the largest amount of memory the decoded frames can take
+	 */
+	size_t getBufferBytes() const;
+
+	/*!
+	 * @param bufferFrames: frames decoded ahead of playback
+	 * @param bufferBytes: upper limit for the memory of these frames, wins over bufferFrames
+	 */
+	static void setSettings(unsigned int bufferFrames, size_t bufferBytes);
+};
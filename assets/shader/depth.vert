@@ -2,11 +2,25 @@
 
 layout(location = 0) in vec3 position;
 
-uniform mat4 lightSpaceMatrix;
+// per-instance model matrix of InstancedGeometry, read instead of modelMatrix if instanced is set
+layout(location = 3) in mat4 instanceModelMatrix;
+uniform bool instanced = false;
+
+// per-frame data written by FrameUniforms, the same block in every shader that reads it
+layout(std140, binding = 0) uniform Frame {
+	mat4 viewProjMatrix;
+	mat4 lightSpaceMatrix;
+	vec4 cameraWorld; // w unused
+	float brightness;
+	int lightsOn; // when lightsOn is 0 only one point light is active
+};
+
 uniform mat4 modelMatrix;
+uniform mat4 positionDequant = mat4(1.0);
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * modelMatrix * vec4(position, 1.0);
+    mat4 model = instanced ? instanceModelMatrix : modelMatrix;
+    gl_Position = lightSpaceMatrix * model * positionDequant * vec4(position, 1.0);
 } 
 
@@ -15,11 +15,32 @@ in VertexData {
 	vec4 FragPosLightSpace;
 } vert;
 
-uniform vec3 lightColor;
+// lights written by FrameUniforms, the arrays are sized like FrameUniforms::MAX_DIR_LIGHTS and MAX_POINT_LIGHTS
+struct DirectionalLight {
+	vec4 color;
+	vec4 direction;
+};
+
+struct PointLight {
+	vec4 color;
+	vec4 position;
+	vec4 attenuation; // x = light.constant, y = light.linear, z = light.quadratic
+};
+
+layout(std140, binding = 1) uniform Lights {
+	int dirLightCount;
+	int pointLightCount;
+	DirectionalLight dirLights[4];
+	PointLight pointLights[32];
+};
+
+uniform int lightIndex; // the point light the cube shows
+flat in int materialIndex; // instanced cubes store their light as material index
 
 void main() {	
 
-	FragColor = vec4(lightColor, 1.0);
+	int light = materialIndex >= 0 ? materialIndex : lightIndex;
+	FragColor = vec4(pointLights[light].color.rgb, 1.0);
     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
     if ( brightness > 1.0)
         BrightColor = vec4(FragColor.rgb, 1.0);
@@ -15,36 +15,52 @@ in VertexData {
 layout (location = 0) out vec4 fragColor;
 layout (location = 1) out vec4 brightColor;
 
-uniform float brightness;
-uniform vec3 camera_world;
-
 uniform vec3 materialCoefficients; // x = ambient, y = diffuse, z = specular 
 uniform float specularAlpha;
 uniform sampler2D diffuseTexture;
+uniform sampler2DArray videoTexture;
+uniform int videoLayer = -1; // frame of a video preloaded into a texture array, -1 for diffuseTexture
+uniform sampler2DArray atlasTexture;
+uniform int atlasLayer = -1; // layer of the diffuse image in the material atlas, -1 for diffuseTexture
+uniform vec4 atlasRect; // xy = offset, zw = size of the image in the layer
+uniform float atlasMaxLod;
+uniform int atlasNormalLayer = -1; // -1 for normalTexture
+uniform vec4 atlasNormalRect;
+uniform float atlasNormalMaxLod;
 uniform sampler2D normalTexture;
 uniform bool ifNormal = false;
-uniform bool lightsOn; // when lightsOn = falseonly one point light is active 
 
 uniform sampler2D shadowTexture;
-uniform mat4 lightSpaceMatrix;
-
-uniform struct DirectionalLight {
-	vec3 color;
-	vec3 direction;
-} ;
-
-uniform struct PointLight {
-	vec3 color;
-	vec3 position;
-	vec3 attenuation; // x = light.constant, y = light.linear, z = light.quadratic
-} ;
-
-#define NR_DIR_LIGHTS 3
-uniform DirectionalLight dirLights[NR_DIR_LIGHTS];
-uniform sampler2D shadowTextures[NR_DIR_LIGHTS];
 
-#define NR_POINT_LIGHTS 8 
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+// per-frame data written by FrameUniforms, the same block in every shader that reads it
+layout(std140, binding = 0) uniform Frame {
+	mat4 viewProjMatrix;
+	mat4 lightSpaceMatrix;
+	vec4 cameraWorld; // w unused
+	float brightness;
+	int lightsOn; // when lightsOn is 0 only one point light is active
+};
+
+// lights written by FrameUniforms, the arrays are sized like FrameUniforms::MAX_DIR_LIGHTS and MAX_POINT_LIGHTS
+struct DirectionalLight {
+	vec4 color;
+	vec4 direction;
+};
+
+struct PointLight {
+	vec4 color;
+	vec4 position;
+	vec4 attenuation; // x = light.constant, y = light.linear, z = light.quadratic
+};
+
+layout(std140, binding = 1) uniform Lights {
+	int dirLightCount;
+	int pointLightCount;
+	DirectionalLight dirLights[4];
+	PointLight pointLights[32];
+};
+
+uniform int pointLightMask = -1; // bit i is set if point light i reaches the object
 
 vec3 phong(vec3 normal, vec3 lightDir, vec3 viewDir, vec3 diffuseC, float diffuseF, vec3 specularC, float specularF, float alpha, bool attenuate, vec3 attenuation) {
 	
@@ -121,42 +137,58 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
     return shadow;  
 }
 
+vec4 sampleAtlas(int layer, vec4 rect, float maxLod) {
+	// repeat inside the rect, the lod comes from the unwrapped uv so there is no seam at the wrap
+	vec2 uv = rect.xy + fract(vert.uv) * rect.zw;
+	float lod = min(textureQueryLod(atlasTexture, vert.uv * rect.zw).y, maxLod);
+	return textureLod(atlasTexture, vec3(uv, layer), lod);
+}
+
 void main() {	
 	
 	vec3 normal;
 	if (ifNormal) {
-		// obtain normal from normal map in range [0,1]
-		normal = texture(normalTexture, vert.uv).rgb;
-		// transform normal vector to range [-1,1]
-		normal = normalize(normal * 2.0 - 1.0);
+		// obtain normal from normal map in range [0,1] and transform it to range [-1,1]
+		// only x and y are read, so two channel (BC5) normal maps work too, z is reconstructed
+		vec2 normalTex = atlasNormalLayer >= 0 ? sampleAtlas(atlasNormalLayer, atlasNormalRect, atlasNormalMaxLod).rg : texture(normalTexture, vert.uv).rg;
+		normal.xy = normalTex * 2.0 - 1.0;
+		normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+		normal = normalize(normal);
 	} else {
 		normal = normalize(vert.normal_world);
 	}
 	
-	vec3 viewDir = normalize(camera_world - vert.position_world);
+	vec3 viewDir = normalize(cameraWorld.xyz - vert.position_world);
 	
-	vec3 texColor = texture(diffuseTexture, vert.uv).rgb;
+	vec3 texColor;
+	if (videoLayer >= 0)
+		texColor = texture(videoTexture, vec3(vert.uv, videoLayer)).rgb;
+	else if (atlasLayer >= 0)
+		texColor = sampleAtlas(atlasLayer, atlasRect, atlasMaxLod).rgb;
+	else
+		texColor = texture(diffuseTexture, vert.uv).rgb;
 	vec3 result = vec3(texColor * materialCoefficients.x); // ambient
 
 	// phase 1: Directional lighting
 	// add directional light contribution
 	
-	if (lightsOn) {
-	for(int i = 0; i < NR_DIR_LIGHTS; i++) {
+	if (lightsOn != 0) {
+	for(int i = 0; i < dirLightCount; i++) {
 	// phase 1.5: Shadow Mapping
 	// calculate shadow
-	float shadow = ShadowCalculation(lightSpaceMatrix * vert.FragPosLightSpace, normal, -dirLights[i].direction);  
-	 result += (1-shadow) * brightness * phong(normal, -dirLights[i].direction, viewDir, dirLights[i].color * texColor, materialCoefficients.y, dirLights[i].color, materialCoefficients.z, specularAlpha, false, vec3(0));
+	float shadow = ShadowCalculation(lightSpaceMatrix * vert.FragPosLightSpace, normal, -dirLights[i].direction.xyz);  
+	 result += (1-shadow) * brightness * phong(normal, -dirLights[i].direction.xyz, viewDir, dirLights[i].color.rgb * texColor, materialCoefficients.y, dirLights[i].color.rgb, materialCoefficients.z, specularAlpha, false, vec3(0));
 	}
 	}
 	// phase 2: Point lights
 	// add point light contribution
-	if (lightsOn) {
-	for(int i = 0; i < NR_POINT_LIGHTS; i++){
-	 result += brightness * phong(normal, pointLights[i].position - vert.position_world, viewDir, pointLights[i].color * texColor, materialCoefficients.y, pointLights[i].color, materialCoefficients.z, specularAlpha, true, pointLights[i].attenuation);
+	if (lightsOn != 0) {
+	for(int i = 0; i < pointLightCount; i++){
+	 if ((pointLightMask & (1 << i)) == 0) continue;
+	 result += brightness * phong(normal, pointLights[i].position.xyz - vert.position_world, viewDir, pointLights[i].color.rgb * texColor, materialCoefficients.y, pointLights[i].color.rgb, materialCoefficients.z, specularAlpha, true, pointLights[i].attenuation.xyz);
 	}
-	} else {
-		 result += brightness * phong(normal, pointLights[0].position - vert.position_world, viewDir, pointLights[0].color * texColor, materialCoefficients.y, pointLights[0].color, materialCoefficients.z, specularAlpha, true, pointLights[0].attenuation);
+	} else if (pointLightCount > 0 && (pointLightMask & 1) != 0) {
+		 result += brightness * phong(normal, pointLights[0].position.xyz - vert.position_world, viewDir, pointLights[0].color.rgb * texColor, materialCoefficients.y, pointLights[0].color.rgb, materialCoefficients.z, specularAlpha, true, pointLights[0].attenuation.xyz);
 
 	}	
 	
@@ -9,6 +9,12 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 uv; // texture
 
+// per-instance data of InstancedGeometry, read instead of the uniforms if instanced is set
+layout(location = 3) in mat4 instanceModelMatrix;
+layout(location = 7) in mat3 instanceNormalMatrix;
+layout(location = 10) in int instanceMaterial;
+uniform bool instanced = false;
+
 out VertexData {
 	vec3 position_world;
 	vec3 normal_world;
@@ -16,17 +22,46 @@ out VertexData {
 	vec4 FragPosLightSpace;
 } vert;
 
+flat out int materialIndex; // material of the instance, -1 for single draws
+
 
 uniform mat4 modelMatrix;
-uniform mat4 viewProjMatrix;
 uniform mat3 normalMatrix;
 
+// per-frame data written by FrameUniforms, the same block in every shader that reads it
+layout(std140, binding = 0) uniform Frame {
+	mat4 viewProjMatrix;
+	mat4 lightSpaceMatrix;
+	vec4 cameraWorld; // w unused
+	float brightness;
+	int lightsOn; // when lightsOn is 0 only one point light is active
+};
+
+// decoding of quantized vertex formats, the defaults are the float layout
+uniform mat4 positionDequant = mat4(1.0);
+uniform vec4 uvTransform = vec4(1.0, 1.0, 0.0, 0.0);
+uniform int octahedralNormals = 0;
+
+vec3 decodeNormal(vec3 n) {
+	if (octahedralNormals == 0) return n;
+
+	// octahedral normals only fill xy, unfold the lower hemisphere
+	vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+	float t = max(-v.z, 0.0);
+	v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+	return normalize(v);
+}
+
 void main() {
-    vec4 position_world_ = modelMatrix * vec4(position, 1);
+	mat4 model = instanced ? instanceModelMatrix : modelMatrix;
+	mat3 normalModel = instanced ? instanceNormalMatrix : normalMatrix;
+	materialIndex = instanced ? instanceMaterial : -1;
+
+    vec4 position_world_ = model * positionDequant * vec4(position, 1);
 	vert.position_world = position_world_.xyz;
 
-	vert.normal_world = normalMatrix * normal;
-	vert.uv = uv;
+	vert.normal_world = normalModel * decodeNormal(normal);
+	vert.uv = uv * uvTransform.xy + uvTransform.zw;
 
 	vert.FragPosLightSpace = vec4(vert.position_world, 1.0);
 